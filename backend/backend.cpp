@@ -44,7 +44,7 @@ ITERATE_BACKENDS(REGISTER_BACKEND)
 /////////////////////////////////////////////////////////////////////
 
 // all functions registered for any backend.
-typedef HashTable<String*,TFunction,HashObject> FunctionTable;
+typedef FlatHashTable<String*,TFunction,HashObject> FunctionTable;
 static FunctionTable g_functions;
 
 static bool started_backends = false;
@@ -88,14 +88,10 @@ bool TransactionBackend::RunFunction(Transaction *t, const char *name,
   Assert(started_backends);
 
   String *key = String::Make(name);
-  Vector<TFunction> *functions = g_functions.Lookup(key);
+  TFunction *function = g_functions.Lookup(key);
 
-  if (functions != NULL) {
-    Assert(functions->Size() == 1);
-
-    TFunction function = functions->At(0);
-    return function(t, arguments, result);
-  }
+  if (function != NULL)
+    return (*function)(t, arguments, result);
 
   logout << "ERROR: Unknown backend function: " << name << endl;
   return false;
@@ -109,14 +105,10 @@ void TransactionBackend::RegisterFunction(const char *name,
                                           TFunction function)
 {
   String *key = String::Make(name);
-  Vector<TFunction> *functions = g_functions.Lookup(key, true);
-
-  if (!functions->Empty()) {
+  if (g_functions.Insert(key, function)) {
     logout << "ERROR: Duplicate function names in backends: " << name << endl;
     Assert(false);
   }
-
-  functions->PushBack(function);
 }
 
 NAMESPACE_XGILL_END
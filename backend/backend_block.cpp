@@ -46,6 +46,9 @@ static Xdb *g_body_xdb = NULL;
 static Xdb *g_init_xdb = NULL;
 static Xdb *g_comp_xdb = NULL;
 
+// database for storing the versions and content hashes of function bodies.
+static Xdb *g_body_hash_xdb = NULL;
+
 // databases for storing file contents.
 static Xdb *g_source_xdb = NULL;
 static Xdb *g_preproc_xdb = NULL;
@@ -64,8 +67,8 @@ static bool g_have_body = false;
 // will be written out).
 static bool g_incremental = false;
 
-typedef HashSet<String*,String> StringSet;
-typedef HashTable<String*,String*,String> StringMap;
+typedef FlatHashSet<String*,String> StringSet;
+typedef FlatHashTable<String*,String*,String> StringMap;
 
 // names of all program values we've written out.
 static StringSet g_write_body;
@@ -89,7 +92,7 @@ static StringSet g_body_reanalyze;
 static StringMap g_body_file;
 
 // map from function names to their version. subset of g_write_body.
-static HashTable<String*,VersionId,String> g_body_version;
+static FlatHashTable<String*,VersionId,String> g_body_version;
 
 // list of filenames whose source has changed since a previous run, only used
 // for incremental builds.
@@ -122,7 +125,7 @@ struct KeyAnnotationInfo
 // information about annotations for all blocks queried or written at some
 // point. blocks not in these hashes have not had their annotations read
 // or modified.
-typedef HashTable<String*,KeyAnnotationInfo*,String> AnnotationHash;
+typedef FlatHashTable<String*,KeyAnnotationInfo*,String> AnnotationHash;
 static AnnotationHash g_annot_body;
 static AnnotationHash g_annot_init;
 static AnnotationHash g_annot_comp;
@@ -130,7 +133,7 @@ static AnnotationHash g_annot_comp;
 // sets of escape/callgraph information which the block backend has received.
 typedef HashTable<String*,EscapeEdgeSet*,String> EscapeEdgeHash;
 typedef HashTable<String*,EscapeAccessSet*,String> EscapeAccessHash;
-typedef HashSet<CallEdgeSet*,HashObject> CallEdgeHash;
+typedef FlatHashSet<CallEdgeSet*,HashObject> CallEdgeHash;
 static EscapeEdgeHash g_escape_forward;
 static EscapeEdgeHash g_escape_backward;
 static EscapeAccessHash g_escape_accesses;
@@ -139,8 +142,8 @@ static CallEdgeHash g_callees;
 
 // quickly check whether escape information has been seen.
 // these do not hold references.
-static HashSet<EscapeEdgeSet*,HashObject> g_seen_escape_edges;
-static HashSet<EscapeAccessSet*,HashObject> g_seen_escape_accesses;
+static FlatHashSet<EscapeEdgeSet*,HashObject> g_seen_escape_edges;
+static FlatHashSet<EscapeAccessSet*,HashObject> g_seen_escape_accesses;
 
 // open the block databases if they are not already open.
 void LoadDatabases()
@@ -153,6 +156,7 @@ void LoadDatabases()
   g_body_xdb = GetDatabase(BODY_DATABASE, true);
   g_init_xdb = GetDatabase(INIT_DATABASE, true);
   g_comp_xdb = GetDatabase(COMP_DATABASE, true);
+  g_body_hash_xdb = GetDatabase(BODY_HASH_DATABASE, true);
 
   g_source_xdb = GetDatabase(SOURCE_DATABASE, true);
   g_preproc_xdb = GetDatabase(PREPROC_DATABASE, true);
@@ -166,13 +170,54 @@ void LoadDatabases()
     g_incremental = true;
 }
 
+// get the version and content hashes stored for the CFGs of function by
+// a previous WriteBodyHashes. returns false if there are no stored hashes,
+// in which case the old CFGs themselves need to be compared.
+bool ReadBodyHashes(String *function, VersionId *pversion,
+                    Vector<uint64_t> *hashes)
+{
+  static Buffer scratch_buf;
+  if (!XdbFindUncompressed(g_body_hash_xdb, function, &scratch_buf))
+    return false;
+
+  Buffer read_buf(scratch_buf.base, scratch_buf.pos - scratch_buf.base);
+
+  uint32_t version = 0;
+  Try(ReadTagUInt32(&read_buf, TAG_Version, &version));
+  *pversion = version;
+
+  while (read_buf.pos != read_buf.base + read_buf.size) {
+    uint64_t hash = 0;
+    Try(ReadUInt64(&read_buf, &hash));
+    hashes->PushBack(hash);
+  }
+
+  scratch_buf.Reset();
+  return true;
+}
+
+// store the version and content hashes for the CFGs of function which are
+// being written to the body database.
+void WriteBodyHashes(String *function, VersionId version,
+                     const Vector<uint64_t> &hashes)
+{
+  static Buffer scratch_buf;
+
+  WriteTagUInt32(&scratch_buf, TAG_Version, version);
+  for (size_t ind = 0; ind < hashes.Size(); ind++)
+    WriteUInt64(&scratch_buf, hashes[ind]);
+
+  XdbReplaceCompress(g_body_hash_xdb, function, &scratch_buf);
+  scratch_buf.Reset();
+}
+
 // get the annotation info for key within hash, filling it in from xdb
 // if necessary.
 KeyAnnotationInfo* GetAnnotations(Xdb *xdb, AnnotationHash &hash, String *key)
 {
-  Vector<KeyAnnotationInfo*> *entries = hash.Lookup(key, true);
-  if (!entries->Empty())
-    return entries->At(0);
+  KeyAnnotationInfo **pinfo = hash.Lookup(key);
+  if (pinfo)
+    return *pinfo;
 
   KeyAnnotationInfo *info = new KeyAnnotationInfo(key);
 
@@ -184,7 +229,7 @@ KeyAnnotationInfo* GetAnnotations(Xdb *xdb, AnnotationHash &hash, String *key)
     scratch_buf.Reset();
   }
 
-  entries->PushBack(info);
+  hash.Insert(key, info);
   return info;
 }
 
@@ -821,6 +866,10 @@ void WriteWorklistIncremental()
       XdbReplaceCompress(g_body_xdb, function, &stub_buf);
       stub_buf.Reset();
 
+      Vector<uint64_t> stub_hashes;
+      stub_hashes.PushBack(stub_cfg->GetContentHash());
+      WriteBodyHashes(function, stub_cfg->GetVersion(), stub_hashes);
+
       new_functions.PushBack(function);
       continue;
     }
@@ -877,11 +926,124 @@ static Vector<Vector<String*>*> g_stage_worklist;
 static Vector<String*> g_overflow_worklist;
 
 // any modsets to write out at the end of the stage.
-static HashTable<String*,Buffer*,String> g_pending_modsets;
+static FlatHashTable<String*,Buffer*,String> g_pending_modsets;
 
 // the names of any modsets we are waiting to receive before starting the
 // next stage. the value is the time at which the wait will timeout.
-static HashTable<String*,uint64_t,String> g_wait_modsets;
+static FlatHashTable<String*,uint64_t,String> g_wait_modsets;
+
+// whether the worklist was loaded for an incremental analysis, where only
+// new or changed functions are initially analyzed.
+static bool g_incremental_worklist = false;
+
+// content hashes of the compressed modsets in the modset database, filled in
+// as they are needed. zero for functions without a modset.
+static FlatHashTable<String*,uint64_t,String> g_modset_hashes;
+
+// for incremental analysis, functions which were analyzed using a modset
+// that changed during the current stage, to analyze in the next stage.
+static StringSet g_modset_invalidated;
+
+// get the content hash of the modset stored for function.
+uint64_t GetModsetHash(String *function)
+{
+  uint64_t *phash = g_modset_hashes.Lookup(function);
+  if (phash)
+    return *phash;
+
+  Xdb *modset_xdb = GetDatabase(MODSET_DATABASE, true);
+  Buffer key_buf((const uint8_t*) function->Value(),
+                 strlen(function->Value()) + 1);
+
+  static Buffer scratch_buf;
+
+  uint64_t hash = 0;
+  if (modset_xdb->Find(&key_buf, &scratch_buf))
+    hash = HashBlock64(scratch_buf.base, scratch_buf.pos - scratch_buf.base);
+  scratch_buf.Reset();
+
+  g_modset_hashes.Insert(function, hash);
+  return hash;
+}
+
+// record the content hashes of the modsets for callees which were used when
+// computing the modset for function.
+void WriteModsetDependencies(String *function, const Vector<String*> &callees)
+{
+  Xdb *dep_xdb = GetDatabase(MODSET_DEPENDENCY_DATABASE, true);
+
+  static Buffer scratch_buf;
+
+  for (size_t ind = 0; ind < callees.Size(); ind++) {
+    String::WriteWithTag(&scratch_buf, callees[ind], TAG_Name);
+    WriteUInt64(&scratch_buf, GetModsetHash(callees[ind]));
+  }
+
+  XdbReplaceCompress(dep_xdb, function, &scratch_buf);
+  scratch_buf.Reset();
+}
+
+// get in phash the content hash of the modset for callee which was used when
+// computing the modset for function. returns false if function did not
+// record using a modset for callee.
+bool GetModsetDependency(String *function, String *callee, uint64_t *phash)
+{
+  Xdb *dep_xdb = GetDatabase(MODSET_DEPENDENCY_DATABASE, true);
+
+  static Buffer scratch_buf;
+  if (!XdbFindUncompressed(dep_xdb, function, &scratch_buf))
+    return false;
+
+  Buffer read_buf(scratch_buf.base, scratch_buf.pos - scratch_buf.base);
+  bool found = false;
+
+  while (read_buf.pos != read_buf.base + read_buf.size) {
+    String *name = String::ReadWithTag(&read_buf, TAG_Name);
+
+    uint64_t hash = 0;
+    Try(ReadUInt64(&read_buf, &hash));
+
+    if (name == callee) {
+      *phash = hash;
+      found = true;
+    }
+  }
+
+  scratch_buf.Reset();
+  return found;
+}
+
+// the modset for function has changed and now has the specified content
+// hash. add to g_modset_invalidated any callers of function which were
+// analyzed using a different modset for it.
+void InvalidateModsetCallers(String *function, uint64_t hash)
+{
+  Xdb *caller_xdb = GetDatabase(CALLER_DATABASE, true);
+
+  static Buffer scratch_buf;
+  if (!XdbFindUncompressed(caller_xdb, function, &scratch_buf))
+    return;
+
+  Buffer read_buf(scratch_buf.base, scratch_buf.pos - scratch_buf.base);
+  CallEdgeSet *callers = CallEdgeSet::Read(&read_buf);
+  scratch_buf.Reset();
+
+  for (size_t ind = 0; ind < callers->GetEdgeCount(); ind++) {
+    const CallEdge &edge = callers->GetEdge(ind);
+    if (edge.callee->GetName() != function ||
+        edge.where.id->Kind() == B_Initializer)
+      continue;
+
+    // callers which have not recorded their dependencies were analyzed
+    // before these were tracked, and are left alone.
+    String *caller = edge.where.id->Function();
+
+    uint64_t caller_hash = 0;
+    if (GetModsetDependency(caller, function, &caller_hash) &&
+        caller_hash != hash)
+      g_modset_invalidated.Insert(caller);
+  }
+}
 
 // flush any pending modsets to the database.
 void FlushModsets()
@@ -893,6 +1055,13 @@ void FlushModsets()
       String *key = g_pending_modsets.ItKey();
       Buffer *buf = g_pending_modsets.ItValueSingle();
 
+      // for incremental analysis, only the callers of functions whose
+      // modset actually changed need to be reanalyzed.
+      uint64_t hash = HashBlock64(buf->base, buf->pos - buf->base);
+      if (g_incremental_worklist && hash != GetModsetHash(key))
+        InvalidateModsetCallers(key, hash);
+      g_modset_hashes.Insert(key, hash);
+
       Buffer key_buf((const uint8_t*) key->Value(), strlen(key->Value()) + 1);
       Buffer write_buf(buf->base, buf->pos - buf->base);
       modset_xdb->Replace(&key_buf, &write_buf);
@@ -1164,6 +1333,13 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
       // CFGs we read in should be unversioned.
       Assert(function_cfgs.Back()->GetVersion() == 0);
 
+      // content hashes of the CFGs, stored alongside function bodies.
+      Vector<uint64_t> content_hashes;
+      if (id->Kind() == B_Function) {
+        for (size_t ind = 0; ind < count; ind++)
+          content_hashes.PushBack(function_cfgs[ind]->GetContentHash());
+      }
+
       // if we're doing an incremental build, we need to compute the
       // versions for the CFGs, and see if they represent a change from any
       // CFGs for the same function from the previous build.
@@ -1171,8 +1347,34 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
         // look for an old function and check if the new one is isomorphic.
         bool incremental_new = false;
 
+        // whether there is an old function, and its version.
+        bool found_old = false;
+        VersionId old_version = 0;
+
+        // compare against the content hashes of the old CFGs if we have
+        // them, which avoids reading in the old CFGs at all.
+        Vector<uint64_t> old_hashes;
+
         static Buffer compare_buf;
-        if (XdbFindUncompressed(g_body_xdb, name, &compare_buf)) {
+        if (ReadBodyHashes(name, &old_version, &old_hashes)) {
+          found_old = true;
+
+          if (old_hashes.Size() == content_hashes.Size()) {
+            for (size_t ind = 0; ind < old_hashes.Size(); ind++) {
+              if (old_hashes[ind] != content_hashes[ind]) {
+                // change in the contents of this function/loop.
+                incremental_new = true;
+              }
+            }
+          }
+          else {
+            // change in the number of loops.
+            incremental_new = true;
+          }
+        }
+        else if (XdbFindUncompressed(g_body_xdb, name, &compare_buf)) {
+          found_old = true;
+
           // clone the old CFGs when reading them in to distinguish them
           // from the new CFGs we're writing out.
           Vector<BlockCFG*> old_cfgs;
@@ -1193,10 +1395,15 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
             incremental_new = true;
           }
 
+          old_version = old_cfgs.Back()->GetVersion();
+          compare_buf.Reset();
+        }
+
+        if (found_old) {
           // compute the version to use for the new CFGs. this is the old
           // version if the new CFGs are equivalent to the old CFGs,
           // otherwise the old version plus one.
-          VersionId new_version = old_cfgs.Back()->GetVersion();
+          VersionId new_version = old_version;
           if (incremental_new) new_version++;
 
           g_body_version.Insert(name, new_version);
@@ -1204,8 +1411,6 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
           // update the versions for the CFGs before writing them out.
           for (size_t ind = 0; ind < count; ind++)
             function_cfgs[ind]->SetVersion(new_version);
-
-          compare_buf.Reset();
         }
         else {
           // this is a new function, there is no old one to compare with.
@@ -1231,6 +1436,9 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
         XdbReplaceCompress(g_body_xdb, name, &write_buf);
         RemoveAnnotations(g_annot_body_xdb, g_annot_body, name);
 
+        VersionId version = function_cfgs.Back()->GetVersion();
+        WriteBodyHashes(name, version, content_hashes);
+
         // remember the file this function was defined in.
         String *file = function_cfgs.Back()->GetBeginLocation()->FileName();
         g_body_file.Insert(name, file);
@@ -1298,7 +1506,7 @@ bool BlockWriteList(Transaction *t, const Vector<TOperand*> &arguments,
     }
   }
 
-  if (IsHighVmUsage()) {
+  if (IsHighMemoryUsage()) {
     logout << "WARNING: High memory usage, flushing caches..." << endl;
     FlushEscape();
   }
@@ -1441,6 +1649,8 @@ bool BlockLoadWorklist(Transaction *t, const Vector<TOperand*> &arguments,
     g_stage_worklist.PushBack(new Vector<String*>());
   }
 
+  g_incremental_worklist = incremental;
+
   *result = new TOperandInteger(t, g_stage_worklist.Size() - 1);
   return true;
 }
@@ -1526,12 +1736,13 @@ bool BlockPopWorklist(Transaction *t, const Vector<TOperand*> &arguments,
   // clear any modset results which timed out.
   g_wait_modsets.Clear();
 
+  // flush any callgraph edges before advancing the stage. these are used
+  // when flushing modsets to find callers affected by modset changes.
+  FlushEscape();
+
   // flush any pending modsets.
   FlushModsets();
 
-  // flush any callgraph edges before advancing the stage.
-  FlushEscape();
-
   g_stage++;
 
   if (g_stage >= g_stage_worklist.Size()) {
@@ -1541,6 +1752,15 @@ bool BlockPopWorklist(Transaction *t, const Vector<TOperand*> &arguments,
     BackendStringHash *next_hash =
       GetNamedHash((const uint8_t*) WORKLIST_FUNC_NEXT);
 
+    // add any functions invalidated by modset changes which are not
+    // already in the hash.
+    HashIterate(g_modset_invalidated) {
+      String *function = g_modset_invalidated.ItKey();
+      if (!next_hash || !next_hash->Lookup(function, false))
+        g_overflow_worklist.PushBack(function);
+    }
+    g_modset_invalidated.Clear();
+
     if (next_hash) {
       HashIteratePtr(next_hash)
         g_overflow_worklist.PushBack(next_hash->ItKey());
@@ -1554,15 +1774,33 @@ bool BlockPopWorklist(Transaction *t, const Vector<TOperand*> &arguments,
 bool BlockWriteModset(Transaction *t, const Vector<TOperand*> &arguments,
                       TOperand **result)
 {
-  BACKEND_ARG_COUNT(2);
+  BACKEND_ARG_COUNT(3);
   BACKEND_ARG_STRING(0, name, name_length);
   BACKEND_ARG_DATA(1, modset_data, modset_length);
+  BACKEND_ARG_LIST(2, callee_list);
 
   String *key = String::Make((const char*) name);
 
   if (g_pending_modsets.Lookup(key))
     BACKEND_FAIL(arguments[0]);
 
+  Vector<String*> callees;
+  for (size_t ind = 0; ind < callee_list->GetCount(); ind++) {
+    if (callee_list->GetOperand(ind)->Kind() != TO_String)
+      BACKEND_FAIL(callee_list->GetOperand(ind));
+
+    TOperandString *str = callee_list->GetOperand(ind)->AsString();
+    if (!ValidString(str->GetData(), str->GetDataLength()))
+      BACKEND_FAIL(str);
+
+    callees.PushBack(String::Make((const char*) str->GetData()));
+  }
+
+  // remember the callee modsets this was computed from. these are the
+  // modsets currently in the database, as new modsets are not visible
+  // until the end of the stage.
+  WriteModsetDependencies(key, callees);
+
   Buffer *buf = new Buffer();
   buf->Append(modset_data, modset_length);
 
@@ -1694,11 +1932,13 @@ TAction* BlockPopWorklist(Transaction *t, size_t var_result)
   return call;
 }
 
-TAction* BlockWriteModset(Transaction *t, TOperand *key, TOperand *modset_data)
+TAction* BlockWriteModset(Transaction *t, TOperand *key, TOperand *modset_data,
+                          TOperandList *callees)
 {
   BACKEND_CALL(BlockWriteModset, 0);
   call->PushArgument(key);
   call->PushArgument(modset_data);
+  call->PushArgument(callees);
   return call;
 }
 
@@ -101,9 +101,12 @@ TAction* BlockPopWorklist(Transaction *t, size_t var_result);
 
 // writes out a modset result for a worklist item. modsets are special as the
 // newly written modset will not be seen when doing lookups until the start
-// of the next stage.
+// of the next stage. callees is a list of the functions whose modsets were
+// used when computing this one. for incremental analysis, once the modset
+// for a function changes any callers which used a different version of it
+// are added to the worklist for the next stage.
 TAction* BlockWriteModset(Transaction *t, TOperand *key,
-                          TOperand *modset_data);
+                          TOperand *modset_data, TOperandList *callees);
 
 NAMESPACE_END(Backend)
 
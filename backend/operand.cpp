@@ -121,13 +121,10 @@ TOperand* TOperand::Read(Buffer *buf, Transaction *t)
       list->PushOperand(ops[oind]);
     return list;
   }
-  case TO_String: {
+  case TO_String:
+    // refer to the string's data in place, see Transaction::Read.
     Try(str_base);
-    Buffer *buf = new Buffer(str_len);
-    t->AddBuffer(buf);
-    buf->Append(str_base, str_len);
-    return new TOperandString(t, buf->base, str_len);
-  }
+    return new TOperandString(t, str_base, str_len);
   case TO_Boolean:
     Try(is_true || is_false);
     return new TOperandBoolean(t, is_true);
@@ -22,6 +22,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
+#include <sys/wait.h>
 
 #include "transaction.h"
 #include "operand.h"
@@ -374,6 +375,21 @@ ConfigOption trans_remote(CK_String, "remote", "",
 ConfigOption trans_initial(CK_Flag, "initial", NULL,
                            "whether to submit an initialize transaction");
 
+ConfigOption alloc_sample(CK_UInt, "alloc-sample", "0",
+                          "sample allocation stacks every N allocations");
+
+ConfigOption log_buffer(CK_Flag, "log-buffer", NULL,
+                        "buffer log output instead of writing on each flush");
+
+ConfigOption log_verbosity(CK_UInt, "log-level", "3",
+                           "log level: 0 error, 1 warning, 2 info, 3 verbose");
+
+ConfigOption fork_batch(CK_UInt, "fork-batch", "0",
+  "fork a child process for each batch of this many work items (0 == off)");
+
+// minimum interval in milliseconds between writes of buffered log output.
+#define LOG_FLUSH_INTERVAL 1000
+
 // flag for one-time setup.
 static bool prepared_analysis = false;
 
@@ -386,22 +402,59 @@ static int remotefd = 0;
 // buffer to hold packet contents for remote submission.
 static Buffer remote_buf("Buffer_remote_transaction");
 
+// address of the remote manager.
+static struct sockaddr_in remote_addr;
+
+// open a connection to the remote manager in remotefd.
+static void ConnectRemote()
+{
+  remotefd = socket(PF_INET, SOCK_STREAM, 0);
+  if (remotefd == -1) {
+    logout << "ERROR: socket() failure: " << strerror(errno) << endl << flush;
+    abort();
+  }
+
+  int ret = connect(remotefd, (sockaddr*) &remote_addr, sizeof(remote_addr));
+  if (ret == -1) {
+    // we get ECONNREFUSED when the manager is not there anymore.
+    // treat this as a success, presumably the manager finished its work
+    // and shut down.
+    if (errno == ECONNREFUSED) {
+      logout << "Manager has been terminated, exiting..." << endl << flush;
+      exit(0);
+    }
+
+    logout << "ERROR: connect() failure: " << strerror(errno) << endl << flush;
+    abort();
+  }
+}
+
 // these handlers abort because trying to do normal program teardown
 // can deadlock when freeing memory. we really should be using a
 // thread unsafe libc.
 
 static void termination_handler(int signal)
 {
-  logout << "ERROR: Termination signal received, aborting..." << endl << flush;
+  logout << "ERROR: Termination signal received, aborting..." << endl;
+  FlushLog();
   abort();
 }
 
 static void timeout_handler(int signal)
 {
-  logout << "ERROR: Analysis timed out, aborting..." << endl << flush;
+  logout << "ERROR: Analysis timed out, aborting..." << endl;
+  FlushLog();
   abort();
 }
 
+// write out any buffered log data before the process dies. the default
+// action for the signal is taken when this returns.
+static void crash_handler(int sig)
+{
+  FlushLog();
+  signal(sig, SIG_DFL);
+}
+
 void AnalysisPrepare(const char *remote_address)
 {
   Assert(!prepared_analysis);
@@ -412,6 +465,22 @@ void AnalysisPrepare(const char *remote_address)
   signal(SIGTERM, termination_handler);
   signal(SIGALRM, timeout_handler);
 
+  PrepareAllocProfile(alloc_sample.UIntValue());
+
+  log_level = (LogLevel) log_verbosity.UIntValue();
+
+  if (log_buffer.IsSpecified() && log_stream == &cout) {
+    cout.Flush();
+
+    log_buffered = new BufferedOutStream(fileno(stdout), LOG_FLUSH_INTERVAL);
+    log_stream = log_buffered;
+
+    atexit(FlushLog);
+    signal(SIGABRT, crash_handler);
+    signal(SIGSEGV, crash_handler);
+    signal(SIGBUS,  crash_handler);
+  }
+
   // we can get the remote address either from our argument or the option.
   if (trans_remote.IsSpecified()) {
     Assert(!remote_address);
@@ -443,18 +512,9 @@ void AnalysisPrepare(const char *remote_address)
     abort();
   }
 
-  int ret;
+  memset(&remote_addr, 0, sizeof(remote_addr));
 
-  remotefd = socket(PF_INET, SOCK_STREAM, 0);
-  if (remotefd == -1) {
-    logout << "ERROR: socket() failure: " << strerror(errno) << endl << flush;
-    abort();
-  }
-
-  struct sockaddr_in addr;
-  memset(&addr, 0, sizeof(addr));
-
-  ret = inet_pton(PF_INET, address, &addr.sin_addr);
+  int ret = inet_pton(PF_INET, address, &remote_addr.sin_addr);
   if (ret == 0) {
     logout << "ERROR: invalid address for inet_pton()" << endl << flush;
     abort();
@@ -464,23 +524,10 @@ void AnalysisPrepare(const char *remote_address)
     abort();
   }
 
-  addr.sin_family = PF_INET;
-  addr.sin_port = htons((unsigned short) port);
-
-  ret = connect(remotefd, (sockaddr*) &addr, sizeof(addr));
-  if (ret == -1) {
-    // we get ECONNREFUSED when the manager is not there anymore.
-    // treat this as a success, presumably the manager finished its work
-    // and shut down.
-    if (errno == ECONNREFUSED) {
-      logout << "Manager has been terminated, exiting..." << endl << flush;
-      exit(0);
-    }
-
-    logout << "ERROR: connect() failure: " << strerror(errno) << endl << flush;
-    abort();
-  }
+  remote_addr.sin_family = PF_INET;
+  remote_addr.sin_port = htons((unsigned short) port);
 
+  ConnectRemote();
   remote_submit = true;
 }
 
@@ -502,6 +549,156 @@ void ResetTimeout(uint32_t offset)
     alarm(seconds + offset);
 }
 
+// exit status for a forked child which finished its batch of work items.
+#define FORK_EXIT_BATCH 3
+
+// number of consecutive forked children which can fail before giving up.
+#define FORK_MAX_FAILURES 10
+
+// whether this is a forked child process.
+static bool fork_child = false;
+
+// remaining work items for a forked child.
+static size_t fork_remaining = 0;
+
+// worker loop state passed to ForkWorker, and in a child the pipe used
+// to send that state back to the server.
+static void *fork_state = NULL;
+static size_t fork_state_size = 0;
+static int fork_state_fd = -1;
+
+void (*g_callback_ForkChildExit)() = NULL;
+void (*g_callback_ForkServerWarm)() = NULL;
+
+// exit a forked child process. this skips the normal program teardown,
+// none of the child's data needs to be freed.
+static void ForkChildExit(int code)
+{
+  if (g_callback_ForkChildExit)
+    g_callback_ForkChildExit();
+
+  logout << flush;
+  FlushLog();
+
+  if (fork_state_size) {
+    ssize_t written = write(fork_state_fd, fork_state, fork_state_size);
+    Assert(written == (ssize_t) fork_state_size);
+  }
+
+  _exit(code);
+}
+
+bool ForkWorker(void *state, size_t state_size)
+{
+  size_t batch = fork_batch.UIntValue();
+  if (!batch || !remote_submit)
+    return true;
+
+  if (fork_child) {
+    if (fork_remaining == 0)
+      ForkChildExit(FORK_EXIT_BATCH);
+    fork_remaining--;
+    return true;
+  }
+
+  // number of consecutive children which have failed.
+  size_t failures = 0;
+
+  while (true) {
+    // don't let the child inherit any unwritten log data.
+    logout << flush;
+    FlushLog();
+
+    int state_fds[2];
+    if (pipe(state_fds) == -1) {
+      logout << "ERROR: pipe() failure: " << strerror(errno) << endl << flush;
+      abort();
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+      logout << "ERROR: fork() failure: " << strerror(errno) << endl << flush;
+      abort();
+    }
+
+    if (pid == 0) {
+      fork_child = true;
+      fork_remaining = batch - 1;
+
+      close(state_fds[0]);
+      fork_state = state;
+      fork_state_size = state_size;
+      fork_state_fd = state_fds[1];
+
+      // use a separate connection for each child, so that a child which
+      // dies in the middle of a transaction does not leave an unread
+      // response on the connection for the next child.
+      close(remotefd);
+      ConnectRemote();
+      return true;
+    }
+
+    close(state_fds[1]);
+
+    // the child writes its final state just before exiting, and this fits
+    // in the pipe buffer so we can read it after the child is gone.
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+      if (errno != EINTR) {
+        logout << "ERROR: waitpid() failure: "
+               << strerror(errno) << endl << flush;
+        abort();
+      }
+    }
+
+    bool exited = WIFEXITED(status);
+    int code = exited ? WEXITSTATUS(status) : 0;
+
+    // pick up the state of a child which finished its batch, so the next
+    // child resumes from it. a failed child's state is dropped along
+    // with its batch.
+    if (exited && code == FORK_EXIT_BATCH && state_size) {
+      if (read(state_fds[0], state, state_size) != (ssize_t) state_size) {
+        logout << "ERROR: Could not read worker child state" << endl << flush;
+        abort();
+      }
+    }
+
+    close(state_fds[0]);
+
+    // the child ran out of work items, the analysis is finished.
+    if (exited && code == 0)
+      return false;
+
+    if (exited && code == FORK_EXIT_BATCH) {
+      failures = 0;
+      if (g_callback_ForkServerWarm)
+        g_callback_ForkServerWarm();
+      continue;
+    }
+
+    // the child crashed or timed out, and whatever work it was doing
+    // has been lost. keep going with a new child.
+    if (WIFSIGNALED(status))
+      logout << "WARNING: Worker child killed by signal "
+             << WTERMSIG(status) << endl;
+    else
+      logout << "WARNING: Worker child exited with status " << code << endl;
+
+    if (++failures == FORK_MAX_FAILURES) {
+      logout << "ERROR: Too many worker child failures, aborting..."
+             << endl << flush;
+      abort();
+    }
+  }
+}
+
+void ForkWorkerFinish()
+{
+  if (fork_child)
+    ForkChildExit(0);
+}
+
 void AnalysisCleanup()
 {
   TransactionBackend::FinishBackend();
@@ -510,6 +707,7 @@ void AnalysisCleanup()
 
 void AnalysisFinish(int code)
 {
+  PrintAllocProfile();
   AnalysisCleanup();
   exit(code);
 }
@@ -520,16 +718,15 @@ void SubmitTransaction(Transaction *t)
   Timer _timer(&transaction_timer);
 
   Assert(prepared_analysis);
+  CheckAllocProfile();
 
   if (remote_submit) {
     Assert(remote_buf.pos == remote_buf.base);
-    remote_buf.Ensure(UINT32_LENGTH);
-    remote_buf.pos += UINT32_LENGTH;
     t->Write(&remote_buf);
 
-    Buffer write_buf(remote_buf.base, remote_buf.pos - remote_buf.base);
-
-    bool success = WritePacket(remotefd, &write_buf);
+    size_t written = 0;
+    bool success = WritePacket(remotefd, remote_buf.base,
+                               remote_buf.pos - remote_buf.base, &written);
     if (!success) {
       logout << "ERROR: Could not write entire transaction." << endl;
       Assert(false);
@@ -537,26 +734,24 @@ void SubmitTransaction(Transaction *t)
 
     remote_buf.Reset();
 
-    // keep reading and blocking until we get a response.
-    do {
-      success = ReadPacket(remotefd, &remote_buf);
-    } while (!success);
-
-    size_t data_length = remote_buf.pos - remote_buf.base - UINT32_LENGTH;
-
-    // make a new buffer to hold the contents read from the buffer,
-    // as ReadResult may put internal pointers to the buffer into
+    // read the response into a buffer owned by the transaction,
+    // as ReadResult will put internal pointers to the buffer into
     // the transaction. if we use a single buffer the data for this
     // transaction's result will be invalidated when the next transaction
     // is submitted.
 
-    Buffer *read_buf = new Buffer(data_length);
+    Buffer *read_buf = new Buffer();
     t->AddBuffer(read_buf);
 
-    memcpy(read_buf->base, remote_buf.base + UINT32_LENGTH, data_length);
-    remote_buf.Reset();
+    // keep reading and blocking until we get a response.
+    do {
+      success = ReadPacket(remotefd, read_buf);
+    } while (!success);
+
+    size_t data_length = read_buf->pos - read_buf->base - UINT32_LENGTH;
+    Buffer result_buf(read_buf->base + UINT32_LENGTH, data_length);
 
-    if (!t->ReadResult(read_buf)) {
+    if (!t->ReadResult(&result_buf)) {
       logout << "ERROR: Corrupt packet data." << endl;
       Assert(false);
     }
@@ -107,10 +107,13 @@ class Transaction
   // information related to serialization.
 
   // read/write the actions required to execute this transaction.
+  // string operands which are read refer directly to the data in buf,
+  // which must either be owned by the transaction or outlive it.
   void Write(Buffer *buf) const;
   bool Read(Buffer *buf);
 
-  // read/write the results of executing this transaction.
+  // read/write the results of executing this transaction. as with Read,
+  // the buffer's data must last as long as the transaction.
   void WriteResult(Buffer *buf) const;
   bool ReadResult(Buffer *buf);
 
@@ -202,6 +205,10 @@ class Transaction
 extern ConfigOption timeout;
 extern ConfigOption trans_remote;
 extern ConfigOption trans_initial;
+extern ConfigOption alloc_sample;
+extern ConfigOption log_buffer;
+extern ConfigOption log_verbosity;
+extern ConfigOption fork_batch;
 
 // setup any data structures for transaction submission and error recovery,
 // and determine whether transactions will be executed locally or remotely.
@@ -225,6 +232,29 @@ uint32_t GetTimeout();
 // additional seconds to pad the user timeout with.
 void ResetTimeout(uint32_t offset = 0);
 
+// fork server support for remote workers. if -fork-batch is specified then
+// the first call to ForkWorker turns this process into a server which forks
+// a child for each batch of work items and waits for it to exit. if a child
+// crashes or hits a hard timeout only its batch is lost. children inherit
+// the server's caches copy-on-write. state points to plain data for the
+// worker's loop, which a child sends back to the server when it finishes its
+// batch so that the next child resumes from it. ForkWorker should be called
+// before fetching each work item, and returns true if the item should be
+// fetched and processed by this process, false if a child has finished the
+// analysis and the server should stop. ForkWorkerFinish must be called once
+// the worker runs out of items, and exits if this is a child.
+bool ForkWorker(void *state = NULL, size_t state_size = 0);
+void ForkWorkerFinish();
+
+// callbacks for a fork server, which are NULL by default.
+// g_callback_ForkChildExit is called in a child which is about to exit after
+// running out of items or finishing its batch. g_callback_ForkServerWarm is
+// called in the server after a child finishes its batch and before the next
+// one is forked, so that the server can pick up data the child saved (e.g. a
+// cache snapshot) for later children to inherit.
+extern void (*g_callback_ForkChildExit)();
+extern void (*g_callback_ForkServerWarm)();
+
 // execute the transaction, either locally or by sending it to a manager
 // and blocking until the result is received.
 void SubmitTransaction(Transaction *t);
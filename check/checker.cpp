@@ -32,6 +32,10 @@ ConfigOption checker_verbose(CK_Flag, "ck-verbose", NULL,
 ConfigOption checker_depth(CK_UInt, "ck-depth", "3",
                            "maximum recursive depth for a func/loop");
 
+// number of indirect callees whose data is fetched together when expanding
+// an indirect call.
+#define CALLEE_PREFETCH_COUNT 4
+
 // returns whether the error condition is satisfiable within frame.
 bool TestErrorSatisfiable(CheckerState *state, CheckerFrame *frame, Bit *bit)
 {
@@ -177,7 +181,10 @@ bool CheckFrameList(CheckerState *state, CheckerFrame *frame,
       // exploring this path. when the timeout occurs all satisfiable
       // queries become false so we will end up here.
       if (TimerAlarm::ActiveExpired()) {
-        logout << "Timeout: ";
+        if (TimerAlarm::ActiveHeapExceeded())
+          logout << "Memory budget exceeded: ";
+        else
+          logout << "Timeout: ";
         PrintTime(TimerAlarm::ActiveElapsed());
         logout << endl;
 
@@ -902,6 +909,21 @@ bool CheckFrame(CheckerState *state, CheckerFrame *frame,
       for (size_t cind = 0; cind < callee_vars.Size(); cind++) {
         Variable *callee = callee_vars[cind];
 
+        // we may need to make frames for several of the callees, but will
+        // stop at the first one which works. fetch the data for the next
+        // few callees together, instead of with separate lookups for each.
+        if (cind % CALLEE_PREFETCH_COUNT == 0) {
+          Vector<BlockId*> prefetch_ids;
+          for (size_t pind = cind;
+               pind < callee_vars.Size() &&
+                 pind < cind + CALLEE_PREFETCH_COUNT;
+               pind++) {
+            prefetch_ids.PushBack(BlockId::Make(B_Function,
+                                                callee_vars[pind]));
+          }
+          PrefetchBlockData(prefetch_ids);
+        }
+
         if (checker_verbose.IsSpecified())
           logout << "CHECK: " << frame
                  << ": Expanding indirect callee at " << point
@@ -1125,6 +1147,9 @@ bool CheckFrame(CheckerState *state, CheckerFrame *frame,
 
 CheckerState* CheckAssertion(BlockId *id, const AssertInfo &info)
 {
+  static BaseTimer check_timer("checker_assertion");
+  Timer _timer(&check_timer);
+
   Assert(info.cls == ASC_Check);
 
   CheckerState *state = new CheckerState(info.kind);
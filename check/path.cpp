@@ -739,14 +739,14 @@ DisplayPoint* DisplayPath::MakePoint(CheckerFrame *chk_frame, PPoint cfg_point)
 
   // find an edge which may have side effects at this point.
 
-  const Vector<PEdge*> &outgoing =
-    mcfg->GetCFG()->GetOutgoingEdges(cfg_point);
+  PEdgeList outgoing = mcfg->GetCFG()->GetOutgoingEdges(cfg_point);
 
   PEdge *after_edge = NULL;
 
   if (outgoing.Size() == 1) {
-    PEdge *edge = outgoing[0];
-    if (edge->IsAssign() || edge->IsLoop() || edge->IsCall()) {
+    PEdgeKind kind = outgoing.Kind(0);
+    if (kind == EGK_Assign || kind == EGK_Loop || kind == EGK_Call) {
+      PEdge *edge = outgoing[0];
       after_edge = edge;
 
       // highlight edges which can GC when generating GC safety reports.
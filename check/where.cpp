@@ -123,7 +123,7 @@ class RemoveFrameMapper : public ExpMapper
 public:
   FrameId frame;
   RemoveFrameMapper(FrameId _frame)
-    : ExpMapper(VISK_All, WIDK_Drop), frame(_frame)
+    : ExpMapper(VISK_All, WIDK_Drop, true), frame(_frame)
   {}
 
   Exp* Map(Exp *exp, Exp*)
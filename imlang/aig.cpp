@@ -0,0 +1,344 @@
+
+// Sixgill: Static assertion checker for C/C++ programs.
+// Copyright (C) 2009-2010  Stanford University
+// Author: Brian Hackett
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "aig.h"
+
+NAMESPACE_XGILL_BEGIN
+
+bool (*g_callback_AigEquivalent)(Bit*, Bit*) = NULL;
+
+// number of 64 bit words of random input values to simulate when sweeping.
+#define AIG_SIM_WORDS 4
+
+// maximum number of equivalence checks to perform during a single sweep.
+#define AIG_SWEEP_CHECKS 50
+
+// simulated values for a node, used to find candidates for merging.
+// signatures are normalized so that the first simulated value is zero,
+// allowing nodes which are negations of one another to be found.
+struct AigSignature {
+  uint64_t words[AIG_SIM_WORDS];
+
+  static uint32_t Hash(uint32_t hash, const AigSignature &sig) {
+    return HashBlock(hash, (const uint8_t*) sig.words, sizeof(sig.words));
+  }
+
+  bool operator == (const AigSignature &osig) const {
+    return !memcmp(words, osig.words, sizeof(words));
+  }
+};
+
+/////////////////////////////////////////////////////////////////////
+// BitAig static
+/////////////////////////////////////////////////////////////////////
+
+Bit* BitAig::Compact(Bit *bit)
+{
+  BitAig aig;
+  AigLit lit = aig.FromBit(bit);
+
+  if (g_callback_AigEquivalent)
+    lit = aig.Sweep(lit);
+
+  Bit *res = aig.ToBit(lit);
+  if (res != bit && res->Size() < bit->Size())
+    return res;
+  return bit;
+}
+
+/////////////////////////////////////////////////////////////////////
+// BitAig
+/////////////////////////////////////////////////////////////////////
+
+BitAig::BitAig()
+{
+  // node zero is the constant false.
+  AddNode(NULL, AIG_FALSE, AIG_FALSE);
+}
+
+uint32_t BitAig::AddNode(Bit *input, AigLit left, AigLit right)
+{
+  AigNode node;
+  node.input = input;
+  node.left = left;
+  node.right = right;
+
+  m_nodes.PushBack(node);
+  return m_nodes.Size() - 1;
+}
+
+AigLit BitAig::MakeInput(Bit *bit)
+{
+  Assert(bit->Kind() == BIT_Var);
+
+  uint32_t *pnode = m_input_table.Lookup(bit);
+  if (pnode)
+    return *pnode * 2;
+
+  uint32_t node = AddNode(bit, AIG_FALSE, AIG_FALSE);
+  m_input_table.Insert(bit, node);
+  return node * 2;
+}
+
+AigLit BitAig::MakeAnd(AigLit lit0, AigLit lit1)
+{
+  if (lit0 > lit1) {
+    AigLit tmp = lit0;
+    lit0 = lit1;
+    lit1 = tmp;
+  }
+
+  // constant fold and remove duplicates/contradictions.
+  if (lit0 == AIG_FALSE)
+    return AIG_FALSE;
+  if (lit0 == AIG_TRUE)
+    return lit1;
+  if (lit0 == lit1)
+    return lit0;
+  if (lit0 == MakeNot(lit1))
+    return AIG_FALSE;
+
+  AigAndKey key(lit0, lit1);
+
+  uint32_t *pnode = m_and_table.Lookup(key);
+  if (pnode)
+    return *pnode * 2;
+
+  uint32_t node = AddNode(NULL, lit0, lit1);
+  m_and_table.Insert(key, node);
+  return node * 2;
+}
+
+AigLit BitAig::MakeOr(AigLit lit0, AigLit lit1)
+{
+  return MakeNot(MakeAnd(MakeNot(lit0), MakeNot(lit1)));
+}
+
+AigLit BitAig::FromBit(Bit *bit)
+{
+  AigLit *plit = m_from_table.Lookup(bit);
+  if (plit)
+    return *plit;
+
+  AigLit res = AIG_FALSE;
+
+  switch (bit->Kind()) {
+  case BIT_False:
+    res = AIG_FALSE;
+    break;
+  case BIT_True:
+    res = AIG_TRUE;
+    break;
+  case BIT_Var:
+    res = MakeInput(bit);
+    break;
+  case BIT_Not:
+    res = MakeNot(FromBit(bit->GetOperand(0)));
+    break;
+  case BIT_And:
+  case BIT_Or:
+    res = FromBitList(bit, 0, bit->GetOperandCount());
+    break;
+  default:
+    Assert(false);
+  }
+
+  m_from_table.Insert(bit, res);
+  return res;
+}
+
+AigLit BitAig::FromBitList(Bit *bit, size_t start, size_t end)
+{
+  // split the operands in half to keep the depth of the graph logarithmic
+  // in the number of operands.
+
+  Assert(start < end);
+  if (start + 1 == end)
+    return FromBit(bit->GetOperand(start));
+
+  size_t mid = (start + end) / 2;
+  AigLit left = FromBitList(bit, start, mid);
+  AigLit right = FromBitList(bit, mid, end);
+
+  if (bit->Kind() == BIT_And)
+    return MakeAnd(left, right);
+  return MakeOr(left, right);
+}
+
+Bit* BitAig::ToBit(AigLit lit)
+{
+  if (lit < m_to_table.Size() && m_to_table[lit])
+    return m_to_table[lit];
+
+  const AigNode &node = m_nodes[lit / 2];
+  bool negate = (lit & 1);
+
+  Bit *res = NULL;
+
+  if (lit / 2 == 0) {
+    res = Bit::MakeConstant(negate);
+  }
+  else if (node.input) {
+    res = negate ? Bit::MakeNot(node.input, BSIMP_Fold) : node.input;
+  }
+  else if (negate) {
+    // convert negated conjunctions back to disjunctions, so we don't end
+    // up with negations all over the resulting bit.
+    AigLit left = MakeNot(node.left);
+    AigLit right = MakeNot(node.right);
+    res = Bit::MakeOr(ToBit(left), ToBit(right), BSIMP_Fold);
+  }
+  else {
+    AigLit left = node.left;
+    AigLit right = node.right;
+    res = Bit::MakeAnd(ToBit(left), ToBit(right), BSIMP_Fold);
+  }
+
+  while (m_to_table.Size() <= lit)
+    m_to_table.PushBack(NULL);
+  m_to_table[lit] = res;
+
+  return res;
+}
+
+size_t BitAig::Size(AigLit lit)
+{
+  Vector<bool> marked(m_nodes.Size());
+  size_t count = 0;
+  SizeMark(lit, &marked, &count);
+  return count;
+}
+
+void BitAig::SizeMark(AigLit lit, Vector<bool> *marked, size_t *count)
+{
+  uint32_t index = lit / 2;
+  if (marked->At(index))
+    return;
+  marked->At(index) = true;
+
+  const AigNode &node = m_nodes[index];
+  if (index != 0 && !node.input) {
+    (*count)++;
+    SizeMark(node.left, marked, count);
+    SizeMark(node.right, marked, count);
+  }
+}
+
+// get a pseudo-random value for simulating the graph. this uses a fixed
+// seed for each sweep so that the results are deterministic.
+static inline uint64_t SimulateRandom(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+AigLit BitAig::Sweep(AigLit lit)
+{
+  // sweeping adds new nodes to the graph, only look at the existing ones.
+  size_t count = m_nodes.Size();
+
+  // get the nodes reachable from lit. nodes are always added after their
+  // operands, so visiting these in order is a topological traversal.
+  Vector<bool> marked(count);
+  size_t and_count = 0;
+  SizeMark(lit, &marked, &and_count);
+  marked[0] = true;
+
+  // simulated values for each node, unnormalized.
+  Vector<AigSignature> values(count);
+
+  // literal for each node in the merged version of the graph.
+  Vector<AigLit> merged(count);
+
+  // map from normalized signatures to the first node with that signature.
+  FlatHashTable<AigSignature,uint32_t,AigSignature> classes;
+
+  uint64_t state = 0x9e3779b97f4a7c15ULL;
+  size_t checks = 0;
+
+  for (size_t index = 0; index < count; index++) {
+    if (!marked[index])
+      continue;
+
+    const AigNode &node = m_nodes[index];
+    AigSignature &sig = values[index];
+
+    if (index == 0) {
+      memset(sig.words, 0, sizeof(sig.words));
+      merged[index] = AIG_FALSE;
+    }
+    else if (node.input) {
+      for (size_t ind = 0; ind < AIG_SIM_WORDS; ind++)
+        sig.words[ind] = SimulateRandom(&state);
+      merged[index] = index * 2;
+    }
+    else {
+      const AigSignature &left = values[node.left / 2];
+      const AigSignature &right = values[node.right / 2];
+      uint64_t left_mask = (node.left & 1) ? (uint64_t) -1 : 0;
+      uint64_t right_mask = (node.right & 1) ? (uint64_t) -1 : 0;
+
+      for (size_t ind = 0; ind < AIG_SIM_WORDS; ind++) {
+        sig.words[ind] = (left.words[ind] ^ left_mask) &
+                         (right.words[ind] ^ right_mask);
+      }
+
+      AigLit new_left = merged[node.left / 2] ^ (node.left & 1);
+      AigLit new_right = merged[node.right / 2] ^ (node.right & 1);
+      merged[index] = MakeAnd(new_left, new_right);
+    }
+
+    AigSignature key = sig;
+    bool phase = (key.words[0] & 1);
+    if (phase) {
+      for (size_t ind = 0; ind < AIG_SIM_WORDS; ind++)
+        key.words[ind] = ~key.words[ind];
+    }
+
+    uint32_t *prep = classes.Lookup(key);
+    if (!prep) {
+      classes.Insert(key, index);
+      continue;
+    }
+
+    // this node agrees with an earlier node on every simulated input.
+    // check with the callback whether they are actually equivalent.
+
+    uint32_t rep = *prep;
+    bool rep_phase = (values[rep].words[0] & 1);
+    AigLit target = merged[rep] ^ (phase != rep_phase ? 1 : 0);
+
+    if (merged[index] == target)
+      continue;
+
+    if (!g_callback_AigEquivalent || checks >= AIG_SWEEP_CHECKS)
+      continue;
+    checks++;
+
+    if (g_callback_AigEquivalent(ToBit(merged[index]), ToBit(target)))
+      merged[index] = target;
+  }
+
+  return merged[lit / 2] ^ (lit & 1);
+}
+
+NAMESPACE_XGILL_END
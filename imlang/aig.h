@@ -0,0 +1,130 @@
+
+// Sixgill: Static assertion checker for C/C++ programs.
+// Copyright (C) 2009-2010  Stanford University
+// Author: Brian Hackett
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+// and-inverter graph representation of Bit formulas. every node in the
+// graph is either a leaf BIT_Var or the conjunction of two other nodes,
+// and edges may be negated. nodes are structurally hashed, so that the same
+// conjunction is never represented twice. converting a Bit to this form and
+// back can be used to compact bits which are too large.
+
+#include "bit.h"
+
+NAMESPACE_XGILL_BEGIN
+
+// literal in a BitAig. this is the index of a node times two, plus one if
+// the node is negated. node zero is the constant false.
+typedef uint32_t AigLit;
+
+#define AIG_FALSE ((AigLit) 0)
+#define AIG_TRUE  ((AigLit) 1)
+
+// callback to check whether two bits are equivalent, used when sweeping a
+// BitAig. this is NULL by default, in which case no nodes will be merged
+// which are not structurally identical. this is set by clients which have
+// access to the solver, e.g. to Solver::BitEquivalent.
+extern bool (*g_callback_AigEquivalent)(Bit*, Bit*);
+
+// key for structural hashing of conjunction nodes.
+struct AigAndKey {
+  AigLit left;
+  AigLit right;
+
+  AigAndKey() : left(0), right(0) {}
+  AigAndKey(AigLit _left, AigLit _right) : left(_left), right(_right) {}
+
+  static uint32_t Hash(uint32_t hash, const AigAndKey &key) {
+    hash = Hash32(hash, key.left);
+    return Hash32(hash, key.right);
+  }
+
+  bool operator == (const AigAndKey &okey) const {
+    return left == okey.left && right == okey.right;
+  }
+};
+
+class BitAig
+{
+ public:
+  // convert bit to a graph and back, sweeping any equivalent nodes.
+  // returns whichever of the original bit and the converted bit is smaller.
+  static Bit* Compact(Bit *bit);
+
+ public:
+  BitAig();
+
+  // get the negation of a literal.
+  static AigLit MakeNot(AigLit lit) { return lit ^ 1; }
+
+  // get the literal for a leaf BIT_Var.
+  AigLit MakeInput(Bit *bit);
+
+  // get the conjunction or disjunction of two literals.
+  AigLit MakeAnd(AigLit lit0, AigLit lit1);
+  AigLit MakeOr(AigLit lit0, AigLit lit1);
+
+  // convert between bits and literals in this graph.
+  AigLit FromBit(Bit *bit);
+  Bit* ToBit(AigLit lit);
+
+  // get the number of conjunction nodes reachable from lit.
+  size_t Size(AigLit lit);
+
+  // get the total number of nodes in this graph.
+  size_t GetNodeCount() const { return m_nodes.Size(); }
+
+  // merge nodes reachable from lit which are equivalent according to
+  // g_callback_AigEquivalent, and return the literal for the merged
+  // version of lit. candidates for merging are found by simulating the
+  // graph with random values for the inputs, so only nodes which agree
+  // on every simulated input will be checked.
+  AigLit Sweep(AigLit lit);
+
+ private:
+  struct AigNode {
+    // leaf variable for input nodes, NULL for conjunctions and node zero.
+    Bit *input;
+
+    // operands of conjunction nodes.
+    AigLit left;
+    AigLit right;
+  };
+
+  Vector<AigNode> m_nodes;
+
+  // structural hash of conjunction nodes.
+  FlatHashTable<AigAndKey,uint32_t,AigAndKey> m_and_table;
+
+  // input nodes for each leaf variable.
+  FlatHashTable<Bit*,uint32_t,Bit> m_input_table;
+
+  // memoized results of FromBit.
+  FlatHashTable<Bit*,AigLit,Bit> m_from_table;
+
+  // memoized results of ToBit, indexed by literal. NULL if not computed.
+  Vector<Bit*> m_to_table;
+
+  // add a node to the graph and get its index.
+  uint32_t AddNode(Bit *input, AigLit left, AigLit right);
+
+  AigLit FromBitList(Bit *bit, size_t start, size_t end);
+  void SizeMark(AigLit lit, Vector<bool> *marked, size_t *count);
+};
+
+NAMESPACE_XGILL_END
@@ -17,6 +17,7 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "bit.h"
+#include <util/hashcache.h>
 
 NAMESPACE_XGILL_BEGIN
 
@@ -267,6 +268,113 @@ Bit* Bit::MakeImply(Bit *op0, Bit *op1, BitSimplifyLevel level)
   return MakeOr(nop0, op1, level);
 }
 
+// key for bucketing bits in a BitImpliedIndex. two bits can only imply one
+// another (per Bit::IsBitImplied) if they have the same key. after removing
+// any negations, the key for a comparison against a constant is the
+// expression being compared, the key for other comparisons is the
+// (unordered) pair of compared expressions, the key for any other variable
+// is that variable, and the key for any other bit is the bit itself.
+struct ImpliedKey {
+  void *first;
+  void *second;
+
+  ImpliedKey() : first(NULL), second(NULL) {}
+  ImpliedKey(void *_first, void *_second) : first(_first), second(_second) {}
+
+  static uint32_t Hash(uint32_t hash, const ImpliedKey &key) {
+    hash = Hash32(hash, (uint32_t) (size_t) key.first);
+    return Hash32(hash, (uint32_t) (size_t) key.second);
+  }
+
+  bool operator == (const ImpliedKey &okey) const {
+    return first == okey.first && second == okey.second;
+  }
+};
+
+static ImpliedKey GetImpliedKey(Bit *bit)
+{
+  while (bit->Kind() == BIT_Not)
+    bit = bit->GetOperand(0);
+
+  // true and false are negations of one another.
+  if (bit->Kind() == BIT_True || bit->Kind() == BIT_False)
+    return ImpliedKey();
+
+  if (bit->Kind() != BIT_Var)
+    return ImpliedKey(bit, NULL);
+
+  Exp *var = bit->GetVar();
+  ExpBinop *nvar = var->IfBinop();
+  if (!nvar)
+    return ImpliedKey(var, NULL);
+
+  // bits related by IsBitNegation or ComputeEquals need the same key.
+  // IsBitNegation treats pointer comparisons like integer ones, so they
+  // are normalized the same way here. ComputeEquals ignores pointer
+  // comparisons, which can give keys shared with bits they are not
+  // implied by, but such candidates are rejected by IsBitImplied.
+  BinopKind kind = NonPointerBinop(nvar->GetBinopKind());
+  Exp *left_var = nvar->GetLeftOperand();
+  Exp *right_var = nvar->GetRightOperand();
+
+  if (kind == B_Equal || kind == B_NotEqual) {
+    if (left_var->IfInt())
+      return ImpliedKey(right_var, NULL);
+    if (right_var->IfInt())
+      return ImpliedKey(left_var, NULL);
+  }
+
+  // a < b is the negation of b <= a, so don't distinguish the order.
+  if (left_var < right_var)
+    return ImpliedKey(left_var, right_var);
+  return ImpliedKey(right_var, left_var);
+}
+
+// index from implication keys to the positions of the operands with
+// that key, so that ReplaceImplied only needs to compare each bit
+// against the operands which might imply it, rather than all of them.
+class BitImpliedIndex
+{
+ public:
+  BitImpliedIndex(const Vector<Bit*> &operands)
+  {
+    for (size_t oind = 0; oind < operands.Size(); oind++)
+      m_table.Insert(GetImpliedKey(operands[oind]), oind);
+  }
+
+  // get the positions of operands which might imply bit, or NULL.
+  // these are not in any particular order.
+  Vector<size_t>* Lookup(Bit *bit)
+  {
+    return m_table.Lookup(GetImpliedKey(bit));
+  }
+
+  // the operand at position oind has changed from old_bit to new_bit.
+  void Replace(size_t oind, Bit *old_bit, Bit *new_bit)
+  {
+    ImpliedKey old_key = GetImpliedKey(old_bit);
+    ImpliedKey new_key = GetImpliedKey(new_bit);
+    if (old_key == new_key)
+      return;
+
+    Vector<size_t> *old_list = m_table.Lookup(old_key);
+    Assert(old_list);
+
+    for (size_t ind = 0; ind < old_list->Size(); ind++) {
+      if (old_list->At(ind) == oind) {
+        old_list->At(ind) = old_list->Back();
+        old_list->PopBack();
+        break;
+      }
+    }
+
+    m_table.Insert(new_key, oind);
+  }
+
+ private:
+  HashTable<ImpliedKey,size_t,ImpliedKey> m_table;
+};
+
 Bit* Bit::ReduceBit(Bit *bit, Bit *base)
 {
   Bit *res = NULL;
@@ -291,7 +399,7 @@ Bit* Bit::ReduceBit(Bit *bit, Bit *base)
 
     Assert(!g_replace_used);
     g_replace_used = true;
-    res = ReplaceImplied(bit, operands, operands.Size(), true,
+    res = ReplaceImplied(bit, operands, NULL, operands.Size(), true,
                          REPLACE_IMPLIED_MAX_DEPTH);
     g_replace_used = false;
 
@@ -304,12 +412,19 @@ Bit* Bit::ReduceBit(Bit *bit, Bit *base)
     for (size_t oind = 0; oind < base->GetOperandCount(); oind++)
       operands.PushBack(base->GetOperand(oind));
 
+    BitImpliedIndex *index = NULL;
+    if (operands.Size() >= IMPLIED_INDEX_MINIMUM)
+      index = new BitImpliedIndex(operands);
+
     Assert(!g_replace_used);
     g_replace_used = true;
-    res = ReplaceImplied(bit, operands, operands.Size(), true,
+    res = ReplaceImplied(bit, operands, index, operands.Size(), true,
                          REPLACE_IMPLIED_MAX_DEPTH);
     g_replace_used = false;
 
+    if (index)
+      delete index;
+
     bit->ClearReplaceExtra();
     break;
   }
@@ -326,6 +441,98 @@ Bit* Bit::ReduceBit(Bit *bit, Bit *base)
   return res;
 }
 
+// log2 of the number of entries in the simplification memo table.
+#define SIMPLIFY_MEMO_BITS  16
+#define SIMPLIFY_MEMO_SIZE  (1 << SIMPLIFY_MEMO_BITS)
+
+// memo table for the results of Bit::SimplifyBit. the bit being simplified
+// is hash-consed first, so it uniquely identifies the kind and operands and
+// together with the simplification level is the key for the memo. the table
+// is direct mapped, with newer entries overwriting older ones, so its size
+// is bounded. this is threaded into the global cache list so its hit rate is
+// printed along with the other caches.
+class BitSimplifyMemo : public BaseHashCache
+{
+ public:
+  BitSimplifyMemo()
+    : BaseHashCache("BitSimplify"), m_entries(NULL), m_entry_count(0)
+  {}
+
+  // get the memoized result of simplifying bit, NULL if there is none.
+  Bit* Lookup(Bit *bit, BitSimplifyLevel level)
+  {
+    if (m_entries) {
+      Entry &e = m_entries[Index(bit, level)];
+      if (e.bit == bit && e.level == level) {
+        m_hits++;
+        return e.result;
+      }
+    }
+
+    m_misses++;
+    return NULL;
+  }
+
+  // remember that bit simplifies to result.
+  void Insert(Bit *bit, BitSimplifyLevel level, Bit *result)
+  {
+    if (!m_entries) {
+      m_entries = new Entry[SIMPLIFY_MEMO_SIZE];
+      memset(m_entries, 0, SIMPLIFY_MEMO_SIZE * sizeof(Entry));
+    }
+
+    Entry &e = m_entries[Index(bit, level)];
+    if (e.bit)
+      m_evictions++;
+    else
+      m_entry_count++;
+
+    e.bit = bit;
+    e.level = level;
+    e.result = result;
+    m_inserts++;
+  }
+
+  // inherited methods.
+
+  void SetPolicy(HashCachePolicy policy) {}
+  size_t GetEntryCount() const { return m_entry_count; }
+
+  size_t Shed(size_t count)
+  {
+    // entries are not ordered, so remove everything.
+    size_t old_count = m_entry_count;
+    if (m_entries) {
+      delete[] m_entries;
+      m_entries = NULL;
+    }
+    m_entry_count = 0;
+    return old_count;
+  }
+
+ private:
+  struct Entry {
+    Bit *bit;
+    BitSimplifyLevel level;
+    Bit *result;
+  };
+
+  // direct mapped table of entries, allocated on first insert.
+  Entry *m_entries;
+  size_t m_entry_count;
+
+  static size_t Index(Bit *bit, BitSimplifyLevel level)
+  {
+    // the structural hash of bits is fairly weak for this purpose, and bits
+    // are never deleted, so the address is used instead. this only affects
+    // which entries are evicted, not the results of simplification.
+    uint32_t hash = (uint32_t) (((size_t) bit >> 3) * 4 + level);
+    return (uint32_t) (hash * 2654435769U) >> (32 - SIMPLIFY_MEMO_BITS);
+  }
+};
+
+static BitSimplifyMemo g_simplify_memo;
+
 #define TRY_PRINT(where)                          \
   do {                                            \
     if (printing) {                               \
@@ -344,6 +551,15 @@ Bit* Bit::SimplifyBit(Bit &b, BitSimplifyLevel level)
   // keep a second reference around for debugging and checking purposes.
   Bit *old_nb = nb;
 
+  // check if we have already simplified this bit.
+  if (level != BSIMP_None) {
+    if (Bit *memo_nb = g_simplify_memo.Lookup(nb, level)) {
+      if (g_callback_BitSimplify)
+        g_callback_BitSimplify(old_nb, memo_nb);
+      return memo_nb;
+    }
+  }
+
   bool printing = false;
 
   if (printing)
@@ -380,6 +596,9 @@ Bit* Bit::SimplifyBit(Bit &b, BitSimplifyLevel level)
     break;
   }
 
+  if (level != BSIMP_None)
+    g_simplify_memo.Insert(old_nb, level, nb);
+
   if (g_callback_BitSimplify)
     g_callback_BitSimplify(old_nb, nb);
 
@@ -782,19 +1001,31 @@ void Bit::SimplifyImplied(Bit **pbit)
   // outer binop other than the currently examined one are true or false.
   bool operands_true = (obit->Kind() == BIT_And);
 
+  // for wide binops, index the operands so we don't have to compare
+  // every sub-operand against every other operand.
+  BitImpliedIndex *index = NULL;
+  if (op_list.Size() >= IMPLIED_INDEX_MINIMUM)
+    index = new BitImpliedIndex(op_list);
+
   for (size_t oind = 0; oind < op_list.Size(); oind++) {
     Bit *ibit = op_list[oind];
 
     Assert(!g_replace_used);
     g_replace_used = true;
-    Bit *nbit = ReplaceImplied(ibit, op_list, oind, operands_true,
+    Bit *nbit = ReplaceImplied(ibit, op_list, index, oind, operands_true,
                                REPLACE_IMPLIED_DEPTH);
     g_replace_used = false;
 
     ibit->ClearReplaceExtra();
     op_list[oind] = nbit;
+
+    if (index && nbit != ibit)
+      index->Replace(oind, ibit, nbit);
   }
 
+  if (index)
+    delete index;
+
   // see if any bits in the list changed
   bool changed = false;
   for (size_t oind = 0; oind < op_list.Size(); oind++) {
@@ -818,6 +1049,7 @@ void Bit::SimplifyImplied(Bit **pbit)
 }
 
 Bit* Bit::ReplaceImplied(Bit *bit, const Vector<Bit*> &operands,
+                         BitImpliedIndex *index,
                          size_t cur_operand, bool operands_true,
                          size_t depth)
 {
@@ -836,14 +1068,35 @@ Bit* Bit::ReplaceImplied(Bit *bit, const Vector<Bit*> &operands,
 
   // is this bit directly implied as true or false by another operand?
   Bit *result = NULL;
-  for (size_t oind = 0; oind < operands.Size(); oind++) {
-    if (oind != cur_operand) {
-      bool implied_result;
-      bool implied = IsBitImplied(bit, operands[oind],
-                                  operands_true, &implied_result);
-      if (implied) {
-        result = MakeConstant(implied_result);
-        break;
+  if (index) {
+    // only look at the operands which might imply this one. use the first
+    // operand which implies the bit, same as for the unindexed case.
+    Vector<size_t> *candidates = index->Lookup(bit);
+    size_t min_oind = operands.Size();
+
+    for (size_t ind = 0; candidates && ind < candidates->Size(); ind++) {
+      size_t oind = candidates->At(ind);
+      if (oind != cur_operand && oind < min_oind) {
+        bool implied_result;
+        bool implied = IsBitImplied(bit, operands[oind],
+                                    operands_true, &implied_result);
+        if (implied) {
+          result = MakeConstant(implied_result);
+          min_oind = oind;
+        }
+      }
+    }
+  }
+  else {
+    for (size_t oind = 0; oind < operands.Size(); oind++) {
+      if (oind != cur_operand) {
+        bool implied_result;
+        bool implied = IsBitImplied(bit, operands[oind],
+                                    operands_true, &implied_result);
+        if (implied) {
+          result = MakeConstant(implied_result);
+          break;
+        }
       }
     }
   }
@@ -862,7 +1115,7 @@ Bit* Bit::ReplaceImplied(Bit *bit, const Vector<Bit*> &operands,
     bool changed = false;
     for (size_t iind = 0; iind < bit->GetOperandCount(); iind++) {
       Bit *ibit = bit->GetOperand(iind);
-      Bit *nibit = ReplaceImplied(ibit, operands, cur_operand,
+      Bit *nibit = ReplaceImplied(ibit, operands, index, cur_operand,
                                   operands_true, depth - 1);
       if (ibit != nibit)
         changed = true;
@@ -1205,144 +1458,12 @@ void Bit::RecursivePrintTree(OutStream &out, size_t pad_spaces)
 
 void Bit::DoVisit(ExpVisitor *visitor, bool revisit)
 {
-  if (!revisit) {
-    Assert(!g_base_used);
-    g_base_used = true;
-  }
-
-  RecursiveVisit(visitor, revisit);
-
-  if (!revisit) {
-    g_base_used = false;
-    ClearBaseExtra();
-  }
-}
-
-void Bit::RecursiveVisit(ExpVisitor *visitor, bool revisit)
-{
-  if (visitor->IsFinished())
-    return;
-
-  if (!revisit) {
-    Assert(g_base_used);
-    if (m_base_extra) {
-      // we already visited this bit. don't revisit.
-      return;
-    }
-
-    // make sure we only visit this once during the crawl.
-    // TODO: the visitor might care about the phase of the bit. we need to
-    // visit the bit twice in situations where it appears in both phases.
-    m_base_extra = true;
-  }
-
-  switch (m_kind) {
-  case BIT_True:
-  case BIT_False:
-    return;
-  case BIT_Var:
-    GetVar()->DoVisit(visitor);
-    return;
-  case BIT_Not:
-    visitor->FlipPhase();
-    GetOperand(0)->RecursiveVisit(visitor, revisit);
-    visitor->FlipPhase();
-    return;
-  case BIT_Or:
-    if (visitor->IgnoreDisjunction())
-      return;
-    // fall through.
-  case BIT_And:
-    for (size_t oind = 0; oind < GetOperandCount(); oind++)
-      GetOperand(oind)->RecursiveVisit(visitor, revisit);
-    break;
-  default:
-    Assert(false);
-  }
+  VisitBit(this, visitor, revisit);
 }
 
 Bit* Bit::DoMap(ExpMapper *mapper)
 {
-  // don't memoize bits encountered multiple times during mapping.
-  // mapping should only be used for relatively compact bits.
-  Bit *use_bit = NULL;
-
-  switch (m_kind) {
-
-  case BIT_True:
-  case BIT_False:
-    use_bit = this;
-    break;
-
-  case BIT_Var: {
-    Exp *new_var = GetVar()->DoMap(mapper);
-    if (new_var) {
-      use_bit = Exp::MakeNonZeroBit(new_var);
-    }
-    else {
-      switch (mapper->Widen()) {
-      case WIDK_Drop:   use_bit = NULL; break;
-      case WIDK_Widen:  use_bit = MakeConstant(true);  break;
-      case WIDK_Narrow: use_bit = MakeConstant(false); break;
-      }
-    }
-    break;
-  }
-
-  case BIT_Not: {
-    mapper->FlipWiden();
-    Bit *new_op = GetOperand(0)->DoMap(mapper);
-    mapper->FlipWiden();
-
-    if (new_op) {
-      use_bit = MakeNot(new_op);
-    }
-    else {
-      Assert(mapper->Widen() == WIDK_Drop);
-      use_bit = NULL;
-    }
-    break;
-  }
-
-  case BIT_And:
-  case BIT_Or: {
-    Vector<Bit*> op_list;
-    bool drop_op_list = false;
-
-    for (size_t oind = 0; oind < GetOperandCount(); oind++) {
-      Bit *new_op = GetOperand(oind)->DoMap(mapper);
-
-      if (new_op) {
-        op_list.PushBack(new_op);
-      }
-      else {
-        Assert(mapper->Widen() == WIDK_Drop);
-        drop_op_list = true;
-        break;
-      }
-    }
-
-    if (drop_op_list) {
-      use_bit = NULL;
-    }
-    else {
-      SortBitList(&op_list);
-
-      if (m_kind == BIT_And) {
-        use_bit = MakeAnd(op_list);
-      }
-      else {
-        use_bit = MakeOr(op_list);
-      }
-    }
-    break;
-  }
-
-  default:
-    Assert(false);
-  }
-
-  return use_bit;
+  return MapBit(this, mapper);
 }
 
 // helper for MultiMap. fill in res with all the possible permutations
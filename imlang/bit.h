@@ -44,12 +44,20 @@ enum BitKind {
 // maximum possible replace implied depth.
 #define REPLACE_IMPLIED_MAX_DEPTH ((uint32_t)-1)
 
+// minimum number of operands to replace implied bits with before
+// building an index of those operands. for smaller lists the operands
+// are compared one by one.
+#define IMPLIED_INDEX_MINIMUM 8
+
 enum BitSimplifyLevel {
   BSIMP_None = 0, // don't do any simplification
   BSIMP_Fold = 1, // constant fold and other trivial simplification
   BSIMP_Full = 2  // full simplification
 };
 
+// index over operands to replace implied bits with, defined in bit.cpp.
+class BitImpliedIndex;
+
 // the type of boolean formulas over expressions
 class Bit : public HashObject
 {
@@ -132,6 +140,7 @@ class Bit : public HashObject
   // visit the expressions in this bit with the specified visitor/mapper.
   // if revisit is set then child bits will only be visited the first
   // time they are encountered (revisit == true allows reentrancy).
+  // these use the VisitBit and MapBit templates.
   void DoVisit(ExpVisitor *visitor, bool revisit = false);
   Bit* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Bit*> *res);
@@ -158,7 +167,12 @@ class Bit : public HashObject
   // helpers for recursive methods.
   size_t RecursiveSize();
   void RecursivePrintTree(OutStream &out, size_t pad_spaces);
-  void RecursiveVisit(ExpVisitor *visitor, bool revisit);
+
+  // visitor templates use the m_base_extra scratch field.
+  template <class V>
+  friend void VisitBit(Bit *bit, V *visitor, bool revisit);
+  template <class V>
+  friend void VisitBitRecurse(Bit *bit, V *visitor, bool revisit);
 
  private:
   static Bit* SimplifyBit(Bit &bit,
@@ -173,6 +187,7 @@ class Bit : public HashObject
 
   // helpers for SimplifyImplied
   static Bit* ReplaceImplied(Bit *bit, const Vector<Bit*> &operands,
+                             BitImpliedIndex *index,
                              size_t cur_operand, bool operands_true,
                              size_t depth);
   static bool IsBitImplied(Bit *bit, Bit *xbit,
@@ -200,7 +215,7 @@ class Bit : public HashObject
   // scratch field reserved for Bit::ReplaceImplied.
   Bit *m_replace_extra;
 
-  // scratch field reserved for Size, DoVisit and PrintTree.
+  // scratch field reserved for Size, VisitBit and PrintTree.
   bool m_base_extra;
 
   // clear replace/extra information on this bit.
@@ -246,4 +261,6 @@ inline bool IsSortedBitList(const Vector<Bit*> &data)
 bool BitHasDirective(Bit *bit, DirectiveKind kind);
 bool BitHasAnyDirective(Bit *bit);
 
+#include "visitor_impl.h"
+
 NAMESPACE_XGILL_END
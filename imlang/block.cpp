@@ -454,7 +454,7 @@ BlockCFG::BlockCFG(BlockId *id)
     m_points(NULL), m_entry_point(0), m_exit_point(0), m_edges(NULL),
     m_point_annotations(NULL), m_annotation_kind(AK_Invalid),
     m_annotation_computed(false), m_annotation_bit(NULL),
-    m_outgoing_edges(NULL), m_incoming_edges(NULL)
+    m_edge_index(NULL)
 {
   Assert(m_id);
   m_hash = m_id->Hash();
@@ -499,6 +499,22 @@ bool BlockCFG::IsEquivalent(BlockCFG *cfg) const
   return true;
 }
 
+uint64_t BlockCFG::GetContentHash() const
+{
+  // always use the same encoding, so the hash does not depend on whether
+  // buffer_v2 was specified when writing the CFG out.
+  Buffer hash_buf;
+  hash_buf.version = 1;
+
+  WriteTagUInt32(&hash_buf, TAG_Index, GetEntryPoint());
+  WriteTagUInt32(&hash_buf, TAG_Index, GetExitPoint());
+
+  for (size_t ind = 0; ind < GetEdgeCount(); ind++)
+    PEdge::Write(&hash_buf, GetEdge(ind));
+
+  return HashBlock64(hash_buf.base, hash_buf.pos - hash_buf.base);
+}
+
 void BlockCFG::SetVersion(VersionId version)
 {
   Assert(m_version == version || !m_version);
@@ -732,25 +748,37 @@ void BlockCFG::AddPointAnnotation(PPoint point, BlockId *annot)
   m_point_annotations->PushBack(PointAnnotation(point, annot));
 }
 
-const Vector<PEdge*>& BlockCFG::GetOutgoingEdges(PPoint point)
+PEdgeList BlockCFG::GetOutgoingEdges(PPoint point)
 {
   ComputeEdgeInfo();
 
-  Vector<PEdge*> *edges = m_outgoing_edges->Lookup(point, true);
-  return *edges;
+  const Vector<size_t> &start = m_edge_index->out_start;
+  if (point + 1 >= start.Size())
+    return PEdgeList();
+
+  size_t base = start[point];
+  return PEdgeList(m_edge_index->out_edges.Data() + base,
+                   m_edge_index->out_kinds.Data() + base,
+                   start[point + 1] - base);
 }
 
-const Vector<PEdge*>& BlockCFG::GetIncomingEdges(PPoint point)
+PEdgeList BlockCFG::GetIncomingEdges(PPoint point)
 {
   ComputeEdgeInfo();
 
-  Vector<PEdge*> *edges = m_incoming_edges->Lookup(point, true);
-  return *edges;
+  const Vector<size_t> &start = m_edge_index->in_start;
+  if (point + 1 >= start.Size())
+    return PEdgeList();
+
+  size_t base = start[point];
+  return PEdgeList(m_edge_index->in_edges.Data() + base,
+                   m_edge_index->in_kinds.Data() + base,
+                   start[point + 1] - base);
 }
 
 PEdge* BlockCFG::GetSingleOutgoingEdge(PPoint point, bool required)
 {
-  const Vector<PEdge*> &edges = GetOutgoingEdges(point);
+  PEdgeList edges = GetOutgoingEdges(point);
 
   if (edges.Size() == 1)
     return edges[0];
@@ -776,31 +804,60 @@ bool BlockCFG::PointEdgeIsCall(PPoint point)
 
 void BlockCFG::ComputeEdgeInfo()
 {
-  if (m_incoming_edges != NULL && m_outgoing_edges != NULL)
+  if (m_edge_index != NULL)
     return;
-  Assert(m_incoming_edges == NULL && m_outgoing_edges == NULL);
 
-  m_outgoing_edges = new EdgeTable(GetPointCount());
-  m_incoming_edges = new EdgeTable(GetPointCount());
+  m_edge_index = new EdgeIndex();
+  EdgeIndex &index = *m_edge_index;
+
+  // count the outgoing and incoming edges of each point, then convert
+  // these counts into the start offset for each point.
+  size_t point_count = GetPointCount();
+  index.out_start.Resize(point_count + 2);
+  index.in_start.Resize(point_count + 2);
 
   for (size_t ind = 0; ind < GetEdgeCount(); ind++) {
     PEdge *edge = GetEdge(ind);
-    m_outgoing_edges->Insert(edge->GetSource(), edge);
+    index.out_start[edge->GetSource() + 1]++;
     if (edge->GetTarget() != 0)
-      m_incoming_edges->Insert(edge->GetTarget(), edge);
+      index.in_start[edge->GetTarget() + 1]++;
+  }
+
+  for (size_t point = 1; point < point_count + 2; point++) {
+    index.out_start[point] += index.out_start[point - 1];
+    index.in_start[point] += index.in_start[point - 1];
+  }
+
+  index.out_edges.Resize(index.out_start.Back());
+  index.out_kinds.Resize(index.out_start.Back());
+  index.in_edges.Resize(index.in_start.Back());
+  index.in_kinds.Resize(index.in_start.Back());
+
+  // fill in the edges for each point, preserving the order in which they
+  // appear in the CFG.
+  Vector<size_t> out_pos(index.out_start);
+  Vector<size_t> in_pos(index.in_start);
+
+  for (size_t ind = 0; ind < GetEdgeCount(); ind++) {
+    PEdge *edge = GetEdge(ind);
+
+    size_t opos = out_pos[edge->GetSource()]++;
+    index.out_edges[opos] = edge;
+    index.out_kinds[opos] = edge->Kind();
+
+    if (edge->GetTarget() != 0) {
+      size_t ipos = in_pos[edge->GetTarget()]++;
+      index.in_edges[ipos] = edge;
+      index.in_kinds[ipos] = edge->Kind();
+    }
   }
 }
 
 void BlockCFG::ClearEdgeInfo()
 {
-  if (m_outgoing_edges != NULL) {
-    delete m_outgoing_edges;
-    m_outgoing_edges = NULL;
-  }
-
-  if (m_incoming_edges != NULL) {
-    delete m_incoming_edges;
-    m_incoming_edges = NULL;
+  if (m_edge_index != NULL) {
+    delete m_edge_index;
+    m_edge_index = NULL;
   }
 }
 
@@ -1036,6 +1093,12 @@ PEdge* PEdge::Copy(const PEdge *e)
 void PEdge::Write(Buffer *buf, const PEdge *e)
 {
   WriteOpenTag(buf, TAG_PEdge);
+
+  if (WriteShared(buf, e)) {
+    WriteCloseTag(buf, TAG_PEdge);
+    return;
+  }
+
   WriteTagUInt32(buf, TAG_Kind, e->Kind());
   WriteTagUInt32(buf, TAG_Index, e->GetSource());
   WriteTagUInt32(buf, TAG_Index, e->GetTarget());
@@ -1113,6 +1176,15 @@ PEdge* PEdge::Read(Buffer *buf)
   Exp *call_instance = NULL;
 
   Try(ReadOpenTag(buf, TAG_PEdge));
+
+  void *shared = NULL;
+  uint32_t shared_id = 0;
+  if (ReadShared(buf, &shared, &shared_id)) {
+    Try(shared);
+    Try(ReadCloseTag(buf, TAG_PEdge));
+    return (PEdge*) shared;
+  }
+
   while (!ReadCloseTag(buf, TAG_PEdge)) {
     switch (PeekOpenTag(buf)) {
     case TAG_Kind: {
@@ -1179,32 +1251,45 @@ PEdge* PEdge::Read(Buffer *buf)
   }
 
   Try(source);
+
+  PEdge *res = NULL;
+
   switch (kind) {
   case EGK_Skip:
-    return MakeSkip(source, target);
+    res = MakeSkip(source, target);
+    break;
   case EGK_Assume:
     Try(exp0);
-    return MakeAssume(source, target, exp0, assume_nonzero);
+    res = MakeAssume(source, target, exp0, assume_nonzero);
+    break;
   case EGK_Assign:
     Try(type && exp0 && exp1);
-    return MakeAssign(source, target, type, exp0, exp1);
+    res = MakeAssign(source, target, type, exp0, exp1);
+    break;
   case EGK_Call: {
     Try(type);
     TypeFunction *fn_type = type->AsFunction();
-    return MakeCall(source, target, fn_type,
-                    exp1, call_instance, exp0, call_arguments);
+    res = MakeCall(source, target, fn_type,
+                   exp1, call_instance, exp0, call_arguments);
+    break;
   }
   case EGK_Loop:
     Try(block);
-    return MakeLoop(source, target, block);
+    res = MakeLoop(source, target, block);
+    break;
   case EGK_Assembly:
-    return MakeAssembly(source, target);
+    res = MakeAssembly(source, target);
+    break;
   case EGK_Annotation:
     Try(block);
-    return MakeAnnotation(source, target, block);
+    res = MakeAnnotation(source, target, block);
+    break;
   default:
     Try(false);
   }
+
+  ReadSharedDone(buf, shared_id, (void*) res);
+  return res;
 }
 
 PEdge* PEdge::MakeSkip(PPoint source, PPoint target)
@@ -202,6 +202,17 @@ inline const char* AnnotationKindString(AnnotationKind kind)
 
 class PEdge;
 
+enum PEdgeKind {
+  EGK_Invalid = 0,
+  EGK_Skip = 1,
+  EGK_Assume = 2,
+  EGK_Assign = 3,
+  EGK_Call = 4,
+  EGK_Loop = 5,
+  EGK_Assembly = 6,
+  EGK_Annotation = 7
+};
+
 // information about a variable defined by a CFG.
 struct DefineVariable
 {
@@ -246,6 +257,42 @@ struct PointAnnotation
     : point(_point), annot(_annot) {}
 };
 
+// list of the outgoing or incoming edges of a point in a BlockCFG. this is
+// a range within the CFG's flat edge index, and is invalidated along with
+// that index whenever the CFG is modified.
+class PEdgeList
+{
+ public:
+  PEdgeList()
+    : m_edges(NULL), m_kinds(NULL), m_count(0)
+  {}
+
+  PEdgeList(PEdge *const *edges, const PEdgeKind *kinds, size_t count)
+    : m_edges(edges), m_kinds(kinds), m_count(count)
+  {}
+
+  size_t Size() const { return m_count; }
+  bool Empty() const { return m_count == 0; }
+
+  PEdge* operator [](size_t n) const
+  {
+    Assert(n < m_count);
+    return m_edges[n];
+  }
+
+  // get the kind of an edge without loading the edge itself.
+  PEdgeKind Kind(size_t n) const
+  {
+    Assert(n < m_count);
+    return m_kinds[n];
+  }
+
+ private:
+  PEdge *const *m_edges;
+  const PEdgeKind *m_kinds;
+  size_t m_count;
+};
+
 // a control flow graph - points and edges with distinguished entry/exit
 // points. depending on the ID for the CFG this graph may or may not
 // contain loops.
@@ -377,6 +424,11 @@ class BlockCFG : public HashObject
   // two CFGs are equivalent if they are identical except for location info.
   bool IsEquivalent(BlockCFG *cfg) const;
 
+  // get a hash of the contents of this CFG compared by IsEquivalent. this is
+  // computed from the serialized edges rather than object addresses, and is
+  // stable across runs. equivalent CFGs will have the same content hash.
+  uint64_t GetContentHash() const;
+
   // annotation CFG methods.
 
   // if this is an annotation CFG, get/set the kind of annotation.
@@ -446,10 +498,10 @@ class BlockCFG : public HashObject
 
   // helper methods.
 
-  // get a list of the outgoing/incoming edges for a point. if these are
-  // called the CFG cannot be modified with new edges later.
-  const Vector<PEdge*>& GetOutgoingEdges(PPoint point);
-  const Vector<PEdge*>& GetIncomingEdges(PPoint point);
+  // get a list of the outgoing/incoming edges for a point. the returned
+  // lists are invalidated if the CFG is later modified with new edges.
+  PEdgeList GetOutgoingEdges(PPoint point);
+  PEdgeList GetIncomingEdges(PPoint point);
 
   // get the single outgoing edge there is for point. if the point has
   // zero or multiple outgoing edges, fail or return NULL per required.
@@ -509,14 +561,23 @@ class BlockCFG : public HashObject
   bool m_annotation_computed;
   Bit *m_annotation_bit;
 
-  typedef HashTable< PPoint, PEdge*, DataHash<PPoint> > EdgeTable;
+  // flat index of the outgoing and incoming edges of each point, in
+  // compressed sparse row form. the outgoing edges of point P are entries
+  // [out_start[P],out_start[P+1]) of out_edges, and likewise for incoming
+  // edges. the kind of each entry is stored alongside the edge itself.
+  struct EdgeIndex
+  {
+    Vector<size_t> out_start;
+    Vector<size_t> in_start;
+    Vector<PEdge*> out_edges;
+    Vector<PEdge*> in_edges;
+    Vector<PEdgeKind> out_kinds;
+    Vector<PEdgeKind> in_kinds;
+  };
 
-  // tables of the outgoing and incoming edges for each point.
-  EdgeTable *m_outgoing_edges;
-  EdgeTable *m_incoming_edges;
+  EdgeIndex *m_edge_index;
 
-  // compute the outgoing/incoming edges and fill in m_computed_edges,
-  // if we have not already done so.
+  // compute m_edge_index, if we have not already done so.
   void ComputeEdgeInfo();
   void ClearEdgeInfo();
 
@@ -529,17 +590,6 @@ class BlockCFG : public HashObject
 
 // HashCons tables
 
-enum PEdgeKind {
-  EGK_Invalid = 0,
-  EGK_Skip = 1,
-  EGK_Assume = 2,
-  EGK_Assign = 3,
-  EGK_Call = 4,
-  EGK_Loop = 5,
-  EGK_Assembly = 6,
-  EGK_Annotation = 7
-};
-
 class PEdgeSkip;
 class PEdgeAssume;
 class PEdgeAssign;
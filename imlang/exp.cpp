@@ -238,6 +238,12 @@ void Exp::Write(Buffer *buf, const Exp *exp)
 {
   WriteOpenTag(buf, TAG_Exp);
 
+  // only write the identifier if we've written this expression before.
+  if (WriteShared(buf, exp)) {
+    WriteCloseTag(buf, TAG_Exp);
+    return;
+  }
+
   WriteTagUInt32(buf, TAG_Kind, exp->Kind());
 
   if (exp->Bits())
@@ -422,6 +428,15 @@ Exp* Exp::Read(Buffer *buf)
   size_t str_len = 0;
 
   Try(ReadOpenTag(buf, TAG_Exp));
+
+  void *shared = NULL;
+  uint32_t shared_id = 0;
+  if (ReadShared(buf, &shared, &shared_id)) {
+    Try(shared);
+    Try(ReadCloseTag(buf, TAG_Exp));
+    return (Exp*) shared;
+  }
+
   while (!ReadCloseTag(buf, TAG_Exp)) {
     switch (PeekOpenTag(buf)) {
     case TAG_Kind: {
@@ -581,6 +596,8 @@ Exp* Exp::Read(Buffer *buf)
   }
 
   Assert(res);
+
+  ReadSharedDone(buf, shared_id, (void*) res);
   return res;
 }
 
@@ -2283,13 +2300,12 @@ void Exp::PrintUIRval(OutStream &out, bool parens) const
 
 void Exp::DoVisit(ExpVisitor *visitor)
 {
-  if (visitor->IsVisiting())
-    visitor->Visit(this);
+  VisitExp(this, visitor);
 }
 
 Exp* Exp::DoMap(ExpMapper *mapper)
 {
-  return BaseMap(this, mapper);
+  return MapExp(this, mapper);
 }
 
 void Exp::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
@@ -2298,7 +2314,7 @@ void Exp::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 }
 
 // visitor for checking a variety of subexpression properties of an exp.
-class ExpVisitor_AnySub : public ExpVisitor
+class ExpVisitor_AnySub : public BaseExpVisitor
 {
  public:
   Variable *root;
@@ -2311,7 +2327,7 @@ class ExpVisitor_AnySub : public ExpVisitor
   size_t num_rfld;
 
   ExpVisitor_AnySub()
-    : ExpVisitor(VISK_SubExprs),
+    : BaseExpVisitor(VISK_SubExprs),
       root(NULL), clobber_root(NULL), relative(false), index(false),
       base_field(NULL), num_drf(0), num_fld(0), num_rfld(0)
   {}
@@ -2347,7 +2363,7 @@ class ExpVisitor_AnySub : public ExpVisitor
 Variable* Exp::Root()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.root;
 }
@@ -2355,7 +2371,7 @@ Variable* Exp::Root()
 ExpClobber* Exp::ClobberRoot()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   // the clobber root only works for fld/drf offsets from a clobber,
   // not indexes, as if the index contains caller terms we won't be
@@ -2367,7 +2383,7 @@ ExpClobber* Exp::ClobberRoot()
 bool Exp::IsRelative()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.relative;
 }
@@ -2375,7 +2391,7 @@ bool Exp::IsRelative()
 Field* Exp::BaseField()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.base_field;
 }
@@ -2383,7 +2399,7 @@ Field* Exp::BaseField()
 size_t Exp::DrfCount()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.num_drf;
 }
@@ -2391,7 +2407,7 @@ size_t Exp::DrfCount()
 size_t Exp::FldCount()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.num_fld;
 }
@@ -2399,18 +2415,18 @@ size_t Exp::FldCount()
 size_t Exp::RfldCount()
 {
   ExpVisitor_AnySub visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.num_rfld;
 }
 
-class ExpVisitor_TermCount : public ExpVisitor
+class ExpVisitor_TermCount : public BaseExpVisitor
 {
 public:
   size_t term_count;
 
   ExpVisitor_TermCount()
-    : ExpVisitor(VISK_All), term_count(0)
+    : BaseExpVisitor(VISK_All), term_count(0)
   {}
 
   void Visit(Exp *exp)
@@ -2423,12 +2439,12 @@ public:
 size_t Exp::TermCount()
 {
   ExpVisitor_TermCount visitor;
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.term_count;
 }
 
-class ExpVisitor_TermCountExceeds : public ExpVisitor
+class ExpVisitor_TermCountExceeds : public BaseExpVisitor
 {
  public:
   size_t max_count;
@@ -2439,7 +2455,8 @@ class ExpVisitor_TermCountExceeds : public ExpVisitor
   size_t all_count;
 
   ExpVisitor_TermCountExceeds(size_t _max_count)
-    : ExpVisitor(VISK_All), max_count(_max_count), cur_count(0), all_count(0)
+    : BaseExpVisitor(VISK_All),
+      max_count(_max_count), cur_count(0), all_count(0)
   {}
 
   void Visit(Exp *exp)
@@ -2459,7 +2476,7 @@ class ExpVisitor_TermCountExceeds : public ExpVisitor
 bool Exp::TermCountExceeds(size_t count)
 {
   ExpVisitor_TermCountExceeds visitor(count);
-  DoVisit(&visitor);
+  VisitExp(this, &visitor);
 
   return visitor.IsFinished();
 }
@@ -2530,39 +2547,6 @@ Exp* ExpDrf::ReplaceLvalTarget(Exp *new_target)
   return MakeDrf(new_target);
 }
 
-void ExpDrf::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->Kind() == VISK_Lval) {
-    // visit the expression whose value is being accessed.
-    visitor->Visit(m_target);
-  }
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_lval = visitor->SetFoundLval(true);
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundLval(old_found_lval);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpDrf::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeDrf(new_target);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpDrf::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -2626,32 +2610,6 @@ Exp* ExpFld::ReplaceLvalTarget(Exp *new_target)
   return MakeFld(new_target, m_field);
 }
 
-void ExpFld::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpFld::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeFld(new_target, m_field);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpFld::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -2723,33 +2681,6 @@ Exp* ExpRfld::ReplaceLvalTarget(Exp *new_target)
   return MakeRfld(new_target, m_field);
 }
 
-void ExpRfld::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpRfld::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeRfld(new_target, m_field);
-
-  return BaseMap(new_this, mapper);
-}
-
 void ExpRfld::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -2827,46 +2758,6 @@ bool ExpIndex::IsCompatibleStrideType(Type *type) const
   return IsCompatibleNormalizedType(type, m_element_type);
 }
 
-void ExpIndex::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-
-  if (visitor->LvalRecurse() && visitor->RvalRecurse()) {
-    bool old_found_lval = visitor->SetFoundLval(false);
-    m_index->DoVisit(visitor);
-    visitor->SetFoundLval(old_found_lval);
-  }
-}
-
-Exp* ExpIndex::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_target = m_target->DoMap(mapper);
-
-  Exp *new_index;
-  if (mapper->RvalRecurse())
-    new_index = m_index->DoMap(mapper);
-  else
-    new_index = m_index;
-
-  Exp *new_this = NULL;
-  if (new_target && new_index)
-    new_this = MakeIndex(new_target, m_element_type, new_index);
-
-  return BaseMap(new_this, mapper);
-}
-
 void ExpIndex::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -3145,29 +3036,6 @@ ExpUnop::ExpUnop(UnopKind unop_kind, Exp *op,
   m_hash = Hash32(m_hash, m_op->Hash());
 }
 
-void ExpUnop::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->RvalRecurse())
-    m_op->DoVisit(visitor);
-}
-
-Exp* ExpUnop::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->RvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_op = m_op->DoMap(mapper);
-  if (new_op)
-    new_this = MakeUnop(m_unop_kind, new_op, m_bits, m_sign);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpUnop::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->RvalRecurse())
@@ -3255,34 +3123,6 @@ bool ExpBinop::IsCompatibleStrideType(Type *type) const
   return false;
 }
 
-void ExpBinop::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->RvalRecurse()) {
-    m_left_op->DoVisit(visitor);
-    m_right_op->DoVisit(visitor);
-  }
-}
-
-Exp* ExpBinop::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->RvalRecurse())
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_left_op = m_left_op->DoMap(mapper);
-  Exp *new_right_op = m_right_op->DoMap(mapper);
-  if (new_left_op && new_right_op) {
-    new_this = MakeBinop(m_binop_kind, new_left_op, new_right_op,
-                         m_stride_type, m_bits, m_sign);
-  }
-  return BaseMap(new_this, mapper);
-}
-
 void ExpBinop::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->RvalRecurse())
@@ -3560,34 +3400,6 @@ Exp* ExpNullTest::ReplaceLvalTarget(Exp *new_target)
   return MakeNullTest(new_target);
 }
 
-void ExpNullTest::DoVisit(ExpVisitor *visitor)
-{
-  Assert(m_target);
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpNullTest::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-  Assert(m_target);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeNullTest(new_target);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpNullTest::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -3656,34 +3468,6 @@ bool ExpBound::IsCompatibleStrideType(Type *type) const
   return IsCompatibleNormalizedType(type, m_stride_type);
 }
 
-void ExpBound::DoVisit(ExpVisitor *visitor)
-{
-  Assert(m_target);
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpBound::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-  Assert(m_target);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeBound(m_bound_kind, new_target, m_stride_type);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpBound::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -3791,36 +3575,6 @@ bool ExpTerminate::IsCompatibleStrideType(Type *type) const
   return IsCompatibleNormalizedType(type, m_stride_type);
 }
 
-void ExpTerminate::DoVisit(ExpVisitor *visitor)
-{
-  Assert(m_target);
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse()) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpTerminate::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse())
-    return Exp::DoMap(mapper);
-  Assert(m_target);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target) {
-    new_this = MakeTerminate(new_target, m_stride_type,
-                             m_terminate_test, m_terminate_int);
-  }
-  return BaseMap(new_this, mapper);
-}
-
 void ExpTerminate::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse())
@@ -3908,32 +3662,6 @@ Exp* ExpGCSafe::ReplaceLvalTarget(Exp *new_target)
   return MakeGCSafe(new_target, m_needs_root);
 }
 
-void ExpGCSafe::DoVisit(ExpVisitor *visitor)
-{
-  Exp::DoVisit(visitor);
-
-  if (visitor->IsFinished())
-    return;
-
-  if (visitor->LvalRecurse() && m_target) {
-    bool old_found_term = visitor->SetFoundTerm(true);
-    m_target->DoVisit(visitor);
-    visitor->SetFoundTerm(old_found_term);
-  }
-}
-
-Exp* ExpGCSafe::DoMap(ExpMapper *mapper)
-{
-  if (!mapper->LvalRecurse() || !m_target)
-    return Exp::DoMap(mapper);
-
-  Exp *new_this = NULL;
-  Exp *new_target = m_target->DoMap(mapper);
-  if (new_target)
-    new_this = MakeGCSafe(new_target, m_needs_root);
-  return BaseMap(new_this, mapper);
-}
-
 void ExpGCSafe::DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
 {
   if (!mapper->LvalRecurse() || !m_target)
@@ -3981,14 +3709,15 @@ void ExpGCSafe::MarkChildren() const
 // Exp utility
 /////////////////////////////////////////////////////////////////////
 
-class ReplaceExpMapper : public ExpMapper
+class ReplaceExpMapper : public BaseExpMapper
 {
  public:
   Exp *old_exp;
   Exp *new_exp;
 
   ReplaceExpMapper(Exp *_old_exp, Exp *_new_exp)
-    : ExpMapper(VISK_All, WIDK_Drop), old_exp(_old_exp), new_exp(_new_exp)
+    : BaseExpMapper(VISK_All, WIDK_Drop, true),
+      old_exp(_old_exp), new_exp(_new_exp)
   {}
 
   Exp* Map(Exp *exp, Exp *old)
@@ -4004,22 +3733,22 @@ class ReplaceExpMapper : public ExpMapper
 Exp* ExpReplaceExp(Exp *exp, Exp *old_exp, Exp *new_exp)
 {
   ReplaceExpMapper mapper(old_exp, new_exp);
-  return exp->DoMap(&mapper);
+  return MapExp(exp, &mapper);
 }
 
 Bit* BitReplaceExp(Bit *bit, Exp *old_exp, Exp *new_exp)
 {
   ReplaceExpMapper mapper(old_exp, new_exp);
-  return bit->DoMap(&mapper);
+  return MapBit(bit, &mapper);
 }
 
 // mapper to replace all exit and clobber expressions with
 // the corresponding Drf or other expression.
-class ConvertExitClobberMapper : public ExpMapper
+class ConvertExitClobberMapper : public BaseExpMapper
 {
 public:
   ConvertExitClobberMapper()
-    : ExpMapper(VISK_All, WIDK_Drop)
+    : BaseExpMapper(VISK_All, WIDK_Drop)
   {}
 
   Exp* Map(Exp *value, Exp *old)
@@ -4042,7 +3771,7 @@ public:
 
     // feed the targeted expression back into the mapper,
     // as this outer exp was treated as a leaf.
-    Exp *new_target = target->DoMap(this);
+    Exp *new_target = MapExp(target, this);
 
     if (value_kind)
       return value_kind->ReplaceLvalTarget(new_target);
@@ -4054,13 +3783,13 @@ public:
 Exp* ExpConvertExitClobber(Exp *exp)
 {
   ConvertExitClobberMapper mapper;
-  return exp->DoMap(&mapper);
+  return MapExp(exp, &mapper);
 }
 
 Bit* BitConvertExitClobber(Bit *bit)
 {
   ConvertExitClobberMapper mapper;
-  return bit->DoMap(&mapper);
+  return MapBit(bit, &mapper);
 }
 
 NAMESPACE_XGILL_END
@@ -305,8 +305,11 @@ class Exp : public HashObject
 
   // invoke the visitor or mapper on all or a portion of the component values
   // used to compute this value, according to the kind of visitor/mapper.
-  virtual void DoVisit(ExpVisitor *visitor);
-  virtual Exp* DoMap(ExpMapper *mapper);
+  // visiting and mapping are implemented by the VisitExp and MapExp
+  // templates, which can also be used directly with visitor or mapper
+  // classes that do not need virtual dispatch.
+  void DoVisit(ExpVisitor *visitor);
+  Exp* DoMap(ExpMapper *mapper);
   virtual void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
 
   // for an lvalue, get the variable it is derived from, NULL if none exists.
@@ -357,11 +360,6 @@ class Exp : public HashObject
   size_t m_bits;
   bool m_sign;
 
-  Exp* BaseMap(Exp *value, ExpMapper *mapper)
-  {
-    return mapper->Map(value, this);
-  }
-
   void BaseMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res)
   {
     mapper->MultiMap(this, res);
@@ -411,8 +409,6 @@ class ExpDrf : public Exp
   Type* GetType() const;
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -438,8 +434,6 @@ class ExpFld : public Exp
   Type* GetType() const;
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -466,8 +460,6 @@ class ExpRfld : public Exp
   Type* GetType() const;
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -498,8 +490,6 @@ class ExpIndex : public Exp
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
   bool IsCompatibleStrideType(Type *type) const;
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -640,8 +630,6 @@ class ExpUnop : public Exp
   Exp *GetOperand() const { return m_op; }
 
   // inherited methods
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -684,8 +672,6 @@ class ExpBinop : public Exp
 
   // inherited methods
   bool IsCompatibleStrideType(Type *type) const;
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -818,8 +804,6 @@ class ExpNullTest : public Exp
   // inherited methods.
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -851,8 +835,6 @@ class ExpBound : public Exp
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
   bool IsCompatibleStrideType(Type *type) const;
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -913,8 +895,6 @@ class ExpTerminate : public Exp
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
   bool IsCompatibleStrideType(Type *type) const;
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -950,8 +930,6 @@ class ExpGCSafe : public Exp
   // inherited methods
   Exp* GetLvalTarget() const;
   Exp* ReplaceLvalTarget(Exp *new_target);
-  void DoVisit(ExpVisitor *visitor);
-  Exp* DoMap(ExpMapper *mapper);
   void DoMultiMap(ExpMultiMapper *mapper, Vector<Exp*> *res);
   void Print(OutStream &out) const;
   void PrintUI(OutStream &out, bool parens) const;
@@ -21,8 +21,8 @@
 
 NAMESPACE_XGILL_BEGIN
 
-// topsort the graph, marking backedges
-// loop heads are those at the target of a backedge
+// compute the dominator tree of the graph, marking backedges.
+// loop heads are those at the target of a backedge, whose source they dominate
 
 // loop graph is reachability graph between loop heads over non back edges.
 // this is a DAG even if there are irreducible loops. visit leaf loops in
@@ -39,18 +39,29 @@ NAMESPACE_XGILL_BEGIN
 // computed by GetEntryReachable()
 PPointHash* entry_reach_table = NULL;
 
-// table for the 'loophead dominates p' relation.
-// computed by GetLoopBackEdges()
-PPointPairHash *dominate_table = NULL;
+// immediate dominator of each point reachable from CFG entry, and the
+// preorder and postorder indexes of each point in the dominator tree.
+// indexed by point, with zero for points not reachable from the entry.
+// the tree indexes start at one, and 'p dominates q' iff the preorder
+// index of p is <= that of q and the postorder index of p is >= that of q.
+// computed by GetDominators()
+Vector<PPoint> *idom_table = NULL;
+Vector<size_t> *dom_pre_table = NULL;
+Vector<size_t> *dom_post_table = NULL;
 
 // table for the loop backedges.
 // computed by GetLoopBackEdges()
 PEdgeHash *backedge_table = NULL;
 
 // table for the 'loophead reaches p over non-backedges' relation.
-// computed by GetLoopReachable()
+// computed by GetLoopReachable(), only if the CFG is irreducible.
 PPointPairHash *reach_table = NULL;
 
+// whether the CFG is acyclic once all loop backedges are removed.
+// in this case loop bodies are computed from the dominator tree, without
+// needing the reach_table. computed by GetReducible()
+bool reducible_cfg = false;
+
 // table for the 'loophead contains p in its body' relation.
 // computed by GetLoopBody()
 PPointPairHash *body_table = NULL;
@@ -62,14 +73,18 @@ PPointListHash *body_list_table = NULL;
 void SetupTables()
 {
   Assert(entry_reach_table == NULL);
-  Assert(dominate_table == NULL);
+  Assert(idom_table == NULL);
+  Assert(dom_pre_table == NULL);
+  Assert(dom_post_table == NULL);
   Assert(backedge_table == NULL);
   Assert(reach_table == NULL);
   Assert(body_table == NULL);
   Assert(body_list_table == NULL);
 
   entry_reach_table = new PPointHash();
-  dominate_table = new PPointPairHash();
+  idom_table = new Vector<PPoint>();
+  dom_pre_table = new Vector<size_t>();
+  dom_post_table = new Vector<size_t>();
   backedge_table = new PEdgeHash();
   reach_table = new PPointPairHash();
   body_table = new PPointPairHash();
@@ -79,7 +94,9 @@ void SetupTables()
 void CleanupTables()
 {
   Assert(entry_reach_table != NULL);
-  Assert(dominate_table != NULL);
+  Assert(idom_table != NULL);
+  Assert(dom_pre_table != NULL);
+  Assert(dom_post_table != NULL);
   Assert(backedge_table != NULL);
   Assert(reach_table != NULL);
   Assert(body_table != NULL);
@@ -88,8 +105,14 @@ void CleanupTables()
   delete entry_reach_table;
   entry_reach_table = NULL;
 
-  delete dominate_table;
-  dominate_table = NULL;
+  delete idom_table;
+  idom_table = NULL;
+
+  delete dom_pre_table;
+  dom_pre_table = NULL;
+
+  delete dom_post_table;
+  dom_post_table = NULL;
 
   delete backedge_table;
   backedge_table = NULL;
@@ -102,6 +125,8 @@ void CleanupTables()
 
   delete body_list_table;
   body_list_table = NULL;
+
+  reducible_cfg = false;
 }
 
 // compute the points in the CFG reachable from the entry point.
@@ -119,7 +144,7 @@ void GetEntryReachable(BlockCFG *cfg)
     PPoint back = worklist.Back();
     worklist.PopBack();
 
-    const Vector<PEdge*>& outgoing = cfg->GetOutgoingEdges(back);
+    PEdgeList outgoing = cfg->GetOutgoingEdges(back);
     for (size_t oind = 0; oind < outgoing.Size(); oind++) {
       PEdge *edge = outgoing[oind];
       PPoint next = edge->GetTarget();
@@ -134,65 +159,174 @@ void GetEntryReachable(BlockCFG *cfg)
   }
 }
 
-// determine whether loophead is a reducible loop with backedges in cfg.
-// fill in dominate_table with the points dominated by loophead,
-// and add as backedges any edge going to loophead which is itself
-// dominated by loophead. return true if any backedges were found.
-bool GetLoopBackedges(BlockCFG *cfg, PPoint loophead)
+// entry in a depth first search over the CFG or dominator tree: a point
+// and the index of its next outgoing edge or child to examine.
+struct SearchEntry
 {
-  // compute the nodes reachable from the entry point other than
-  // through start. the dominated points are the dual of this set.
+  PPoint point;
+  size_t index;
 
-  // points reachable from the start according to the above criteria
-  PPointHash reachable;
+  SearchEntry() : point(0), index(0) {}
+  SearchEntry(PPoint _point) : point(_point), index(0) {}
+};
 
-  // worklist items are points in reachable whose outgoing edges have
-  // not been examined
-  Vector<PPoint> worklist;
-
-  if (!entry_reach_table->Lookup(loophead))
-    return false;
+// find the nearest common dominator of two points, according to the
+// reverse postorder indexes of the points and the dominators computed so far.
+static PPoint IntersectDominators(const Vector<size_t> &order,
+                                  PPoint point0, PPoint point1)
+{
+  while (point0 != point1) {
+    while (order[point0] > order[point1])
+      point0 = idom_table->At(point0);
+    while (order[point1] > order[point0])
+      point1 = idom_table->At(point1);
+  }
+  return point0;
+}
 
+// compute the dominator tree for the points reachable from the CFG entry,
+// filling in idom_table, dom_pre_table and dom_post_table. this uses the
+// iterative algorithm of Cooper, Harvey and Kennedy, which only requires a
+// few passes over the points in reverse postorder for structured code.
+void GetDominators(BlockCFG *cfg)
+{
+  size_t count = cfg->GetPointCount();
   PPoint entry = cfg->GetEntryPoint();
-  reachable.Insert(entry);
-  worklist.PushBack(entry);
+
+  idom_table->Resize(count + 1);
+  dom_pre_table->Resize(count + 1);
+  dom_post_table->Resize(count + 1);
+
+  // get the reachable points in postorder, without using recursion so that
+  // deeply nested code does not exhaust the stack. worklist items are
+  // points with the index of the next outgoing edge to examine.
+  Vector<PPoint> postorder;
+  Vector<bool> visited(count + 1);
+  Vector<SearchEntry> worklist;
+
+  visited[entry] = true;
+  worklist.PushBack(SearchEntry(entry));
 
   while (!worklist.Empty()) {
-    PPoint back = worklist.Back();
-    worklist.PopBack();
+    PPoint point = worklist.Back().point;
+    size_t oind = worklist.Back().index;
 
-    const Vector<PEdge*>& outgoing = cfg->GetOutgoingEdges(back);
-    for (size_t oind = 0; oind < outgoing.Size(); oind++) {
-      PEdge *edge = outgoing[oind];
-      PPoint next = edge->GetTarget();
+    PEdgeList outgoing = cfg->GetOutgoingEdges(point);
+    if (oind == outgoing.Size()) {
+      postorder.PushBack(point);
+      worklist.PopBack();
+      continue;
+    }
 
-      if (next == loophead)
-        continue;
+    worklist.Back().index++;
 
-      // already did this target
-      if (reachable.Lookup(next))
-        continue;
+    PPoint next = outgoing[oind]->GetTarget();
+    if (next && !visited[next]) {
+      visited[next] = true;
+      worklist.PushBack(SearchEntry(next));
+    }
+  }
 
-      reachable.Insert(next);
-      worklist.PushBack(next);
+  // reverse postorder index of each point, starting at one.
+  Vector<size_t> order(count + 1);
+  for (size_t ind = 0; ind < postorder.Size(); ind++)
+    order[postorder[ind]] = postorder.Size() - ind;
+
+  idom_table->At(entry) = entry;
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    // visit the points other than the entry in reverse postorder.
+    for (size_t ind = postorder.Size() - 1; ind > 0; ind--) {
+      PPoint point = postorder[ind - 1];
+      PPoint new_idom = 0;
+
+      PEdgeList incoming = cfg->GetIncomingEdges(point);
+      for (size_t iind = 0; iind < incoming.Size(); iind++) {
+        PPoint source = incoming[iind]->GetSource();
+        if (!idom_table->At(source))
+          continue;
+
+        if (new_idom)
+          new_idom = IntersectDominators(order, source, new_idom);
+        else
+          new_idom = source;
+      }
+
+      if (new_idom != idom_table->At(point)) {
+        idom_table->At(point) = new_idom;
+        changed = true;
+      }
     }
   }
 
-  // compute the set of dominated points. this is the difference
-  // between the points reachable from the CFG entry, and the points
-  // in the reach table we just computed.
-  for (PPoint point = 1; point <= cfg->GetPointCount(); point++) {
-    if (!reachable.Lookup(point) && entry_reach_table->Lookup(point))
-      dominate_table->Insert(PPointPair(loophead, point));
+  // the entry has no immediate dominator.
+  idom_table->At(entry) = 0;
+
+  // number the points in the dominator tree. since each point's dominator
+  // precedes it in reverse postorder, get the children of each point by
+  // walking the points in that order.
+  PPointListHash children;
+  for (size_t ind = postorder.Size() - 1; ind > 0; ind--) {
+    PPoint point = postorder[ind - 1];
+    children.Insert(idom_table->At(point), point);
   }
 
+  size_t pre_index = 0;
+  size_t post_index = 0;
+
+  worklist.Clear();
+  worklist.PushBack(SearchEntry(entry));
+  dom_pre_table->At(entry) = ++pre_index;
+
+  while (!worklist.Empty()) {
+    PPoint point = worklist.Back().point;
+    size_t cind = worklist.Back().index;
+
+    Vector<PPoint> *child_list = children.Lookup(point, false);
+    if (!child_list || cind == child_list->Size()) {
+      dom_post_table->At(point) = ++post_index;
+      worklist.PopBack();
+      continue;
+    }
+
+    worklist.Back().index++;
+
+    PPoint child = child_list->At(cind);
+    dom_pre_table->At(child) = ++pre_index;
+    worklist.PushBack(SearchEntry(child));
+  }
+}
+
+// whether dominator dominates point, per the tables from GetDominators().
+// points added to the CFG after the dominators were computed are not
+// dominated by anything.
+bool Dominates(PPoint dominator, PPoint point)
+{
+  if (point >= dom_pre_table->Size() || !dom_pre_table->At(point))
+    return false;
+
+  return dom_pre_table->At(dominator) <= dom_pre_table->At(point)
+      && dom_post_table->At(dominator) >= dom_post_table->At(point);
+}
+
+// determine whether loophead is a reducible loop with backedges in cfg.
+// add as backedges any edge going to loophead which is dominated by
+// loophead. return true if any backedges were found.
+bool GetLoopBackedges(BlockCFG *cfg, PPoint loophead)
+{
+  if (!entry_reach_table->Lookup(loophead))
+    return false;
+
   // backedges on the loophead are incoming edges whose source is
   // dominated by the loophead
   bool found_backedge = false;
-  const Vector<PEdge*> &incoming = cfg->GetIncomingEdges(loophead);
+  PEdgeList incoming = cfg->GetIncomingEdges(loophead);
   for (size_t eind = 0; eind < incoming.Size(); eind++) {
     PEdge *edge = incoming[eind];
-    if (dominate_table->Lookup(PPointPair(loophead, edge->GetSource()))) {
+    if (Dominates(loophead, edge->GetSource())) {
       backedge_table->Insert(edge);
       found_backedge = true;
     }
@@ -201,6 +335,66 @@ bool GetLoopBackedges(BlockCFG *cfg, PPoint loophead)
   return found_backedge;
 }
 
+// determine whether the CFG is acyclic after removing all backedges found
+// by GetLoopBackedges(). if it is not, then one of the loops is irreducible.
+bool GetReducible(BlockCFG *cfg)
+{
+  size_t count = cfg->GetPointCount();
+
+  // state of each point in the depth first search: zero if unvisited,
+  // one if the point is on the search stack, two if it is finished.
+  Vector<size_t> state(count + 1);
+
+  // worklist items are points with the index of the next outgoing edge.
+  Vector<SearchEntry> worklist;
+
+  PPoint entry = cfg->GetEntryPoint();
+  state[entry] = 1;
+  worklist.PushBack(SearchEntry(entry));
+
+  while (!worklist.Empty()) {
+    PPoint point = worklist.Back().point;
+    size_t oind = worklist.Back().index;
+
+    PEdgeList outgoing = cfg->GetOutgoingEdges(point);
+    if (oind == outgoing.Size()) {
+      state[point] = 2;
+      worklist.PopBack();
+      continue;
+    }
+
+    worklist.Back().index++;
+
+    PEdge *edge = outgoing[oind];
+    PPoint next = edge->GetTarget();
+
+    if (!next || backedge_table->Lookup(edge))
+      continue;
+
+    if (state[next] == 1)
+      return false;
+
+    if (state[next] == 0) {
+      state[next] = 1;
+      worklist.PushBack(SearchEntry(next));
+    }
+  }
+
+  return true;
+}
+
+// whether point is reachable from loophead over non-backedges. if the CFG
+// is reducible then this is only valid for points which are predecessors
+// of the body of loophead: a point reached from loophead which is not in
+// its body need not be dominated by it, but any predecessor of a point in
+// the body other than loophead itself must be.
+bool GetLoopReaches(PPoint loophead, PPoint point)
+{
+  if (reducible_cfg)
+    return Dominates(loophead, point);
+  return reach_table->Lookup(PPointPair(loophead, point));
+}
+
 // get the set of points reachable from loophead over paths
 // that do not go through a backedge. if loophead itself is
 // reachable, it is irreducible and those new edges to it are added
@@ -223,7 +417,7 @@ bool GetLoopReachable(BlockCFG *cfg, PPoint loophead)
     PPoint back = worklist.Back();
     worklist.PopBack();
 
-    const Vector<PEdge*>& outgoing = cfg->GetOutgoingEdges(back);
+    PEdgeList outgoing = cfg->GetOutgoingEdges(back);
     for (size_t oind = 0; oind < outgoing.Size(); oind++) {
       PEdge *edge = outgoing[oind];
       PPoint next = edge->GetTarget();
@@ -263,13 +457,13 @@ void GetLoopBody(BlockCFG *cfg, PPoint loophead,
   // incoming edges have not yet been examined.
   Vector<PPoint> worklist;
 
-  const Vector<PEdge*> &head_incoming = cfg->GetIncomingEdges(loophead);
+  PEdgeList head_incoming = cfg->GetIncomingEdges(loophead);
   for (size_t iind = 0; iind < head_incoming.Size(); iind++) {
     PEdge *edge = head_incoming[iind];
     PPoint source = edge->GetSource();
 
     if (backedge_table->Lookup(edge)) {
-      Assert(reach_table->Lookup(PPointPair(loophead, source)));
+      Assert(GetLoopReaches(loophead, source));
 
       if (!body_table->Insert(PPointPair(loophead, source))) {
         body_list->PushBack(source);
@@ -288,12 +482,12 @@ void GetLoopBody(BlockCFG *cfg, PPoint loophead,
     if (back == loophead)
       continue;
 
-    const Vector<PEdge*> &incoming = cfg->GetIncomingEdges(back);
+    PEdgeList incoming = cfg->GetIncomingEdges(back);
     for (size_t iind = 0; iind < incoming.Size(); iind++) {
       PEdge *edge = incoming[iind];
       PPoint source = edge->GetSource();
 
-      if (reach_table->Lookup(PPointPair(loophead, source))) {
+      if (GetLoopReaches(loophead, source)) {
         if (!body_table->Insert(PPointPair(loophead, source))) {
           body_list->PushBack(source);
           worklist.PushBack(source);
@@ -331,6 +525,9 @@ void CloneLoopBody(BlockCFG *base_cfg, PPoint loophead,
   size_t init_points_size = base_cfg->GetPointCount();
   size_t init_edges_size = base_cfg->GetEdgeCount();
 
+  // mark the points in the loop body, for quick lookup during the edge scan.
+  Vector<bool> body_points(init_points_size + 1);
+
   // copy all points in the loop body to the new CFG.
   for (size_t bind = 0; bind < body_list->Size(); bind++) {
     PPoint body_point = body_list->At(bind);
@@ -341,6 +538,7 @@ void CloneLoopBody(BlockCFG *base_cfg, PPoint loophead,
 
     PPoint new_point = receive_cfg->AddPoint(loc);
     remapping->Insert(body_point, new_point);
+    body_points[body_point] = true;
   }
 
   // copy all edges between points in the body to the new CFG.
@@ -349,21 +547,23 @@ void CloneLoopBody(BlockCFG *base_cfg, PPoint loophead,
     PPoint source = edge->GetSource();
     PPoint target = edge->GetTarget();
 
+    if (!body_points[source] && !body_points[target]) {
+      // edge is not involved with this loop. leave it alone
+      continue;
+    }
+
     if (!entry_reach_table->Lookup(source))
       continue;
 
     PPoint new_source = 0;
-    if (body_table->Lookup(PPointPair(loophead, source)))
+    if (body_points[source])
       new_source = remapping->LookupSingle(source);
 
     PPoint new_target = 0;
-    if (body_table->Lookup(PPointPair(loophead, target)))
+    if (body_points[target])
       new_target = remapping->LookupSingle(target);
 
-    if (!new_source && !new_target) {
-      // edge is not involved with this loop. leave it alone
-    }
-    else if (!new_source && new_target) {
+    if (!new_source && new_target) {
       // entry edge. leave it alone
       old_entry_indexes->PushBack(eind);
     }
@@ -397,7 +597,7 @@ PPoint FollowSkipEdges(BlockCFG *cfg, PPoint point)
   while (changed) {
     changed = false;
 
-    const Vector<PEdge*> &outgoing = cfg->GetOutgoingEdges(cur);
+    PEdgeList outgoing = cfg->GetOutgoingEdges(cur);
     if (outgoing.Size() == 1) {
       PEdge *edge = outgoing[0];
       if (edge->IsSkip()) {
@@ -487,7 +687,7 @@ void TrimUnreachable(BlockCFG *cfg, bool flatten_skips)
     PPoint back = worklist.Back();
     worklist.PopBack();
 
-    const Vector<PEdge*> &outgoing = cfg->GetOutgoingEdges(back);
+    PEdgeList outgoing = cfg->GetOutgoingEdges(back);
     for (size_t oind = 0; oind < outgoing.Size(); oind++) {
       PEdge *edge = outgoing[oind];
       PPoint next = edge->GetTarget();
@@ -512,7 +712,7 @@ void TrimUnreachable(BlockCFG *cfg, bool flatten_skips)
     PPoint back = worklist.Back();
     worklist.PopBack();
 
-    const Vector<PEdge*> &incoming = cfg->GetIncomingEdges(back);
+    PEdgeList incoming = cfg->GetIncomingEdges(back);
     for (size_t iind = 0; iind < incoming.Size(); iind++) {
       PEdge *edge = incoming[iind];
       PPoint prev = edge->GetSource();
@@ -704,7 +904,7 @@ void TopoSortCFG(BlockCFG *cfg)
 
     remapping.Insert(point, new_points.Size());
 
-    const Vector<PEdge*> &outgoing = cfg->GetOutgoingEdges(point);
+    PEdgeList outgoing = cfg->GetOutgoingEdges(point);
     for (size_t oind = 0; oind < outgoing.Size(); oind++) {
       PEdge *edge = outgoing[oind];
       PPoint target = edge->GetTarget();
@@ -720,7 +920,7 @@ void TopoSortCFG(BlockCFG *cfg)
       // from points not in the remapping.
       bool missing_incoming = false;
 
-      const Vector<PEdge*> &incoming = cfg->GetIncomingEdges(target);
+      PEdgeList incoming = cfg->GetIncomingEdges(target);
       for (size_t iind = 0; iind < incoming.Size(); iind++) {
         PEdge *edge = incoming[iind];
         PPoint source = edge->GetSource();
@@ -746,7 +946,7 @@ void TopoSortCFG(BlockCFG *cfg)
   Vector<PEdge*> new_edges;
 
   for (size_t pind = 0; pind < old_points.Size(); pind++) {
-    const Vector<PEdge*> &edges = cfg->GetOutgoingEdges(old_points[pind]);
+    PEdgeList edges = cfg->GetOutgoingEdges(old_points[pind]);
 
     for (size_t eind = 0; eind < edges.Size(); eind++) {
       PEdge *edge = edges[eind];
@@ -1028,10 +1228,8 @@ void GetLoopIsomorphicPoints(BlockCFG *cfg, PEdge *loop_edge,
 
     PPoint loop_point = remapping.LookupSingle(cfg_point);
 
-    const Vector<PEdge*> &cfg_outgoing =
-      cfg->GetOutgoingEdges(cfg_point);
-    const Vector<PEdge*> &loop_outgoing =
-      loop_cfg->GetOutgoingEdges(loop_point);
+    PEdgeList cfg_outgoing = cfg->GetOutgoingEdges(cfg_point);
+    PEdgeList loop_outgoing = loop_cfg->GetOutgoingEdges(loop_point);
 
     for (size_t eind = 0; eind < cfg_outgoing.Size(); eind++) {
       PEdge *edge = cfg_outgoing[eind];
@@ -1145,8 +1343,9 @@ void SplitLoops(BlockCFG *base_cfg, Vector<BlockCFG*> *result_cfg_list)
   // setup the tables we need to do loop splitting.
   SetupTables();
 
-  // compute the points reachable from the entry point.
+  // compute the points reachable from the entry point and their dominators.
   GetEntryReachable(func_cfg);
+  GetDominators(func_cfg);
 
   // the real loops in the program with back edges.
   Vector<PPoint> loops;
@@ -1157,8 +1356,13 @@ void SplitLoops(BlockCFG *base_cfg, Vector<BlockCFG*> *result_cfg_list)
       loops.PushBack(head);
   }
 
+  // if there are no cycles besides those through the backedges then none
+  // of the loops are irreducible, and we can skip computing reachability.
+  reducible_cfg = GetReducible(func_cfg);
+
   // compute reachability and check for irreducible loops.
-  for (size_t lind = 0; lind < func_cfg->GetLoopHeadCount(); lind++) {
+  for (size_t lind = 0;
+       !reducible_cfg && lind < func_cfg->GetLoopHeadCount(); lind++) {
     const LoopHead &head = func_cfg->GetLoopHead(lind);
 
     if (GetLoopReachable(func_cfg, head.point)) {
@@ -1191,9 +1395,31 @@ void SplitLoops(BlockCFG *base_cfg, Vector<BlockCFG*> *result_cfg_list)
   }
 
   // construct a tree of all the loops. loop A contains loop B
-  // if A != B and the head of B is in the body of A.
+  // if A != B and the head of B is in the body of A. this maps each
+  // loop to the other loops containing it.
   PPointListHash loop_tree;
 
+  // number of loops contained in each loop which have not been split off.
+  FlatHashTable<PPoint,size_t,hash_PPoint> inner_counts;
+
+  PPointHash loop_heads;
+  for (size_t lind = 0; lind < loops.Size(); lind++)
+    loop_heads.Insert(loops[lind]);
+
+  for (size_t lind = 0; lind < loops.Size(); lind++) {
+    PPoint head = loops[lind];
+    size_t *pcount = inner_counts.Lookup(head, true);
+
+    Vector<PPoint> *body_list = body_list_table->Lookup(head, true);
+    for (size_t bind = 0; bind < body_list->Size(); bind++) {
+      PPoint point = body_list->At(bind);
+      if (point != head && loop_heads.Lookup(point)) {
+        loop_tree.Insert(point, head);
+        (*pcount)++;
+      }
+    }
+  }
+
   // split off all the loops in the CFG. make sure we split inner loops
   // before outer, so that the Loop edges on inner loops will appear in
   // the split body for outer loops.
@@ -1203,20 +1429,7 @@ void SplitLoops(BlockCFG *base_cfg, Vector<BlockCFG*> *result_cfg_list)
     // have already been split off and are no longer in the loops list.
     PPoint loophead = 0;
     for (size_t lind = 0; lind < loops.Size(); lind++) {
-
-      bool is_viable = true;
-      for (size_t xlind = 0; xlind < loops.Size(); xlind++) {
-        if (xlind == lind)
-          continue;
-        Assert(loops[lind] != loops[xlind]);
-
-        if (body_table->Lookup(PPointPair(loops[lind], loops[xlind]))) {
-          is_viable = false;
-          break;
-        }
-      }
-
-      if (is_viable) {
+      if (inner_counts.LookupSingle(loops[lind]) == 0) {
         loophead = loops[lind];
         loops[lind] = loops.Back();
         loops.PopBack();
@@ -1225,6 +1438,12 @@ void SplitLoops(BlockCFG *base_cfg, Vector<BlockCFG*> *result_cfg_list)
     }
 
     Assert(loophead);
+
+    // the loops containing this one have one fewer loop left to split.
+    Vector<PPoint> *outer_list = loop_tree.Lookup(loophead, false);
+    for (size_t oind = 0; outer_list && oind < outer_list->Size(); oind++)
+      inner_counts.LookupSingle(outer_list->At(oind))--;
+
     BlockCFG *loop_cfg = SplitSingleLoop(loophead, loops, func_cfg);
     result_cfg_list->PushBack(loop_cfg);
   }
@@ -26,6 +26,11 @@
 // all children are given in the order they should be appear in
 // the stream. children are required unless otherwise specified
 
+// shared objects (TAG_Type, TAG_Exp, TAG_Trace, TAG_PEdge) which were
+// previously written to the same buffer have a TAG_UInt32 identifier as
+// their only child, see WriteShared. otherwise they have the children
+// listed below.
+
 ///////////////////////////////
 // Type
 ///////////////////////////////
@@ -76,7 +76,7 @@ class ExternalLookup_BlockCFG : public Cache_BlockCFG::ExternalLookup
 };
 
 ExternalLookup_BlockCFG lookup_BlockCFG;
-Cache_BlockCFG BlockCFGCache(&lookup_BlockCFG, CAP_BLOCK_CFG);
+Cache_BlockCFG BlockCFGCache("BlockCFG", &lookup_BlockCFG, CAP_BLOCK_CFG);
 
 BlockCFG* GetBlockCFG(BlockId *id)
 {
@@ -185,7 +185,8 @@ class ExternalLookup_Initializer : public Cache_Initializer::ExternalLookup
 };
 
 ExternalLookup_Initializer lookup_Initializer;
-Cache_Initializer InitializerCache(&lookup_Initializer, CAP_INITIALIZER);
+Cache_Initializer InitializerCache("Initializer",
+                                   &lookup_Initializer, CAP_INITIALIZER);
 
 /////////////////////////////////////////////////////////////////////
 // CompositeCSU lookup
@@ -209,7 +210,8 @@ class ExternalLookup_CompositeCSU : public Cache_CompositeCSU::ExternalLookup
 };
 
 ExternalLookup_CompositeCSU lookup_CompositeCSU;
-Cache_CompositeCSU CompositeCSUCache(&lookup_CompositeCSU, CAP_CSU);
+Cache_CompositeCSU CompositeCSUCache("CompositeCSU",
+                                     &lookup_CompositeCSU, CAP_CSU);
 
 /////////////////////////////////////////////////////////////////////
 // Annotation lookup
@@ -254,8 +256,8 @@ ExternalLookup_Annotation lookup_BodyAnnot(BODY_ANNOT_DATABASE);
 ExternalLookup_Annotation lookup_InitAnnot(INIT_ANNOT_DATABASE);
 ExternalLookup_Annotation lookup_CompAnnot(COMP_ANNOT_DATABASE);
 
-Cache_Annotation BodyAnnotCache(&lookup_BodyAnnot, CAP_ANNOTATION);
-Cache_Annotation InitAnnotCache(&lookup_InitAnnot, CAP_ANNOTATION);
-Cache_Annotation CompAnnotCache(&lookup_CompAnnot, CAP_ANNOTATION);
+Cache_Annotation BodyAnnotCache("BodyAnnot", &lookup_BodyAnnot, CAP_ANNOTATION);
+Cache_Annotation InitAnnotCache("InitAnnot", &lookup_InitAnnot, CAP_ANNOTATION);
+Cache_Annotation CompAnnotCache("CompAnnot", &lookup_CompAnnot, CAP_ANNOTATION);
 
 NAMESPACE_XGILL_END
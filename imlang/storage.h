@@ -30,6 +30,10 @@ NAMESPACE_XGILL_BEGIN
 #define BODY_DATABASE "src_body.xdb"
 #define INIT_DATABASE "src_init.xdb"
 
+// database name containing the version and content hashes of the CFGs for
+// each function in the body database, for incremental builds.
+#define BODY_HASH_DATABASE "src_body_hash.xdb"
+
 // database name containing CSU type definitions.
 #define COMP_DATABASE "src_comp.xdb"
 
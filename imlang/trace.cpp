@@ -52,6 +52,12 @@ Trace* Trace::Copy(const Trace *trace)
 void Trace::Write(Buffer *buf, const Trace *trace)
 {
   WriteOpenTag(buf, TAG_Trace);
+
+  if (WriteShared(buf, trace)) {
+    WriteCloseTag(buf, TAG_Trace);
+    return;
+  }
+
   WriteTagUInt32(buf, TAG_Kind, trace->Kind());
   Exp::Write(buf, trace->GetValue());
 
@@ -82,6 +88,15 @@ Trace* Trace::Read(Buffer *buf)
   Vector<BlockPPoint> context;
 
   Try(ReadOpenTag(buf, TAG_Trace));
+
+  void *shared = NULL;
+  uint32_t shared_id = 0;
+  if (ReadShared(buf, &shared, &shared_id)) {
+    Try(shared);
+    Try(ReadCloseTag(buf, TAG_Trace));
+    return (Trace*) shared;
+  }
+
   while (!ReadCloseTag(buf, TAG_Trace)) {
     switch (PeekOpenTag(buf)) {
     case TAG_Kind: {
@@ -117,7 +132,10 @@ Trace* Trace::Read(Buffer *buf)
 
   Try(kind);
   Trace xtrace((TraceKind) kind, exp, func, csu, context);
-  return g_table.Lookup(xtrace);
+  Trace *res = g_table.Lookup(xtrace);
+
+  ReadSharedDone(buf, shared_id, (void*) res);
+  return res;
 }
 
 Trace* Trace::MakeFunc(Exp *value, Variable *function,
@@ -106,6 +106,12 @@ Type* Type::Copy(const Type *y)
 void Type::Write(Buffer *buf, const Type *y)
 {
   WriteOpenTag(buf, TAG_Type);
+
+  if (WriteShared(buf, y)) {
+    WriteCloseTag(buf, TAG_Type);
+    return;
+  }
+
   WriteTagUInt32(buf, TAG_Kind, y->Kind());
 
   switch (y->Kind()) {
@@ -174,6 +180,15 @@ Type* Type::Read(Buffer *buf)
   Vector<Type*> argument_types;
 
   Try(ReadOpenTag(buf, TAG_Type));
+
+  void *shared = NULL;
+  uint32_t shared_id = 0;
+  if (ReadShared(buf, &shared, &shared_id)) {
+    Try(shared);
+    Try(ReadCloseTag(buf, TAG_Type));
+    return (Type*) shared;
+  }
+
   while (!ReadCloseTag(buf, TAG_Type)) {
     switch (PeekOpenTag(buf)) {
     case TAG_Kind: {
@@ -235,30 +250,43 @@ Type* Type::Read(Buffer *buf)
     }
   }
 
+  Type *res = NULL;
+
   switch ((TypeKind)kind) {
   case YK_Error:
-    return MakeError();
+    res = MakeError();
+    break;
   case YK_Void:
-    return MakeVoid();
+    res = MakeVoid();
+    break;
   case YK_Int:
-    return MakeInt(width, sign);
+    res = MakeInt(width, sign);
+    break;
   case YK_Float:
-    return MakeFloat(width);
+    res = MakeFloat(width);
+    break;
   case YK_Pointer:
     Try(target_type);
-    return MakePointer(target_type, width);
+    res = MakePointer(target_type, width);
+    break;
   case YK_Array:
     Try(target_type);
-    return MakeArray(target_type, count);
+    res = MakeArray(target_type, count);
+    break;
   case YK_CSU:
     Try(name);
-    return MakeCSU(name);
+    res = MakeCSU(name);
+    break;
   case YK_Function:
     Try(target_type);
-    return MakeFunction(target_type, csu_type, varargs, argument_types);
+    res = MakeFunction(target_type, csu_type, varargs, argument_types);
+    break;
   default:
     Try(false);
   }
+
+  ReadSharedDone(buf, shared_id, (void*) res);
+  return res;
 }
 
 TypeError* Type::MakeError() {
@@ -706,7 +734,7 @@ CompositeCSU* CompositeCSU::Read(Buffer *buf)
 CompositeCSU::CompositeCSU(String *name)
   : m_kind(CSU_Invalid), m_name(name), m_width(0), m_command(NULL),
     m_begin_location(NULL), m_end_location(NULL),
-    m_data_fields(NULL), m_function_fields(NULL)
+    m_data_fields(NULL), m_function_fields(NULL), m_layout(NULL)
 {
   Assert(m_name);
   m_hash = m_name->Hash();
@@ -745,6 +773,8 @@ void CompositeCSU::SetEndLocation(Location *loc)
 
 void CompositeCSU::AddField(Field *field, size_t offset)
 {
+  ClearLayout();
+
   if (m_data_fields == NULL)
     m_data_fields = new Vector<DataField>();
   m_data_fields->PushBack(DataField(field, offset));
@@ -753,11 +783,86 @@ void CompositeCSU::AddField(Field *field, size_t offset)
 void CompositeCSU::AddFunctionField(Field *field, Field *base,
                                     Variable *function)
 {
+  ClearLayout();
+
   if (m_function_fields == NULL)
     m_function_fields = new Vector<FunctionField>();
   m_function_fields->PushBack(FunctionField(field, base, function));
 }
 
+// tables mapping each field to its index in the CSU's data or function
+// fields. where a field appears multiple times (i.e. unnamed padding),
+// only its first index is stored.
+struct CompositeCSU::Layout
+{
+  FlatHashTable<Field*,size_t,Field> data_index;
+  FlatHashTable<Field*,size_t,Field> function_index;
+  Vector<Field*> base_classes;
+};
+
+const DataField* CompositeCSU::FindField(Field *field)
+{
+  ComputeLayout();
+
+  size_t *pindex = m_layout->data_index.Lookup(field);
+  if (pindex)
+    return &m_data_fields->At(*pindex);
+  return NULL;
+}
+
+const FunctionField* CompositeCSU::FindFunctionField(Field *field)
+{
+  ComputeLayout();
+
+  size_t *pindex = m_layout->function_index.Lookup(field);
+  if (pindex)
+    return &m_function_fields->At(*pindex);
+  return NULL;
+}
+
+size_t CompositeCSU::GetBaseClassCount()
+{
+  ComputeLayout();
+  return m_layout->base_classes.Size();
+}
+
+Field* CompositeCSU::GetBaseClass(size_t ind)
+{
+  ComputeLayout();
+  return m_layout->base_classes[ind];
+}
+
+void CompositeCSU::ComputeLayout()
+{
+  if (m_layout)
+    return;
+
+  m_layout = new Layout();
+
+  for (size_t ind = 0; ind < GetFieldCount(); ind++) {
+    Field *field = GetField(ind).field;
+    if (!m_layout->data_index.Lookup(field))
+      m_layout->data_index.Insert(field, ind);
+  }
+
+  for (size_t ind = 0; ind < GetFunctionFieldCount(); ind++) {
+    const FunctionField &ff = GetFunctionField(ind);
+    if (!m_layout->function_index.Lookup(ff.field))
+      m_layout->function_index.Insert(ff.field, ind);
+
+    if (ff.base && !m_layout->base_classes.Contains(ff.base))
+      m_layout->base_classes.PushBack(ff.base);
+  }
+}
+
+void CompositeCSU::ClearLayout()
+{
+  if (m_layout) {
+    delete m_layout;
+    m_layout = NULL;
+  }
+}
+
 void CompositeCSU::Print(OutStream &out) const
 {
   switch (m_kind) {
@@ -831,6 +936,8 @@ void CompositeCSU::Persist()
 
 void CompositeCSU::UnPersist()
 {
+  ClearLayout();
+
   if (m_data_fields) {
     delete m_data_fields;
     m_data_fields = NULL;
@@ -368,6 +368,21 @@ class CompositeCSU : public HashObject
     return m_function_fields->At(ind);
   }
 
+  // layout lookups. these use tables indexing the data and function fields
+  // of this CSU, which are computed on first use and discarded if any
+  // fields are added later.
+
+  // get the data field entry for field in this CSU, NULL if there is none.
+  const DataField* FindField(Field *field);
+
+  // get the function field entry for field in this CSU, NULL if none.
+  const FunctionField* FindFunctionField(Field *field);
+
+  // get the distinct fields for base classes which this CSU inherits
+  // virtual functions from, in the order they are first used.
+  size_t GetBaseClassCount();
+  Field* GetBaseClass(size_t ind);
+
   // modification methods.
 
   // set the kind/width of this CSU.
@@ -409,6 +424,13 @@ class CompositeCSU : public HashObject
   Vector<DataField> *m_data_fields;
   Vector<FunctionField> *m_function_fields;
 
+  // layout tables for this CSU, NULL if not computed.
+  struct Layout;
+  Layout *m_layout;
+
+  void ComputeLayout();
+  void ClearLayout();
+
   CompositeCSU(String *name);
   static HashCons<CompositeCSU> g_table;
 };
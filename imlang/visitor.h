@@ -74,11 +74,14 @@ inline bool TryRvalRecurse(ExpVisitorKind kind) {
   }
 }
 
-// interface structure for crawling the expressions in a structure.
-class ExpVisitor
+// state and recursion queries for crawling the expressions in a structure.
+// classes deriving directly from this with a non-virtual Visit method can
+// be passed to the VisitExp/VisitBit templates, avoiding a virtual call
+// on every visited expression.
+class BaseExpVisitor
 {
  public:
-  ExpVisitor(ExpVisitorKind kind)
+  BaseExpVisitor(ExpVisitorKind kind)
     : m_kind(kind), m_found_lval(false), m_found_term(false),
       m_negative_phase(false), m_ignore_disjunction(false),
       m_finished(false)
@@ -135,9 +138,6 @@ class ExpVisitor
   bool LvalRecurse() { return TryLvalRecurse(m_kind); }
   bool RvalRecurse() { return TryRvalRecurse(m_kind); }
 
-  // operation to perform when invoked on an expression.
-  virtual void Visit(Exp *value) = 0;
-
  protected:
   ExpVisitorKind m_kind;
   bool m_found_lval;
@@ -147,6 +147,18 @@ class ExpVisitor
   bool m_finished;
 };
 
+// interface structure for crawling the expressions in a structure.
+class ExpVisitor : public BaseExpVisitor
+{
+ public:
+  ExpVisitor(ExpVisitorKind kind)
+    : BaseExpVisitor(kind)
+  {}
+
+  // operation to perform when invoked on an expression.
+  virtual void Visit(Exp *value) = 0;
+};
+
 // kinds of ways to handle mapping bits when only a portion of that bit
 // is has a target in the mapping.
 enum ExpWidenKind
@@ -161,17 +173,26 @@ enum ExpWidenKind
   WIDK_Narrow
 };
 
-// interface structure for mapping the expressions in a structure.
-class ExpMapper
+// state and recursion queries for mapping the expressions in a structure.
+// as with BaseExpVisitor, classes deriving directly from this with a
+// non-virtual Map method can be passed to the MapExp/MapBit templates.
+class BaseExpMapper
 {
  public:
-  ExpMapper(ExpVisitorKind kind, ExpWidenKind widen)
-    : m_kind(kind), m_widen(widen)
+  BaseExpMapper(ExpVisitorKind kind, ExpWidenKind widen,
+                bool memoize = false)
+    : m_kind(kind), m_widen(widen), m_memoize(memoize)
   {}
 
   // get the kind of this mapper.
   ExpVisitorKind Kind() { return m_kind; }
 
+  // whether results should be memoized during each mapping pass, so that
+  // subterms shared within a large exp or bit are only mapped once. this
+  // can only be used by mappers whose Map method has no side effects and
+  // depends only on its arguments and not on Widen().
+  bool Memoize() const { return m_memoize; }
+
   // get the way in which NULL operands in a bit should be handled.
   ExpWidenKind Widen() { return m_widen; }
 
@@ -188,16 +209,26 @@ class ExpMapper
   bool LvalRecurse() { return TryLvalRecurse(m_kind); }
   bool RvalRecurse() { return TryRvalRecurse(m_kind); }
 
+ private:
+  ExpVisitorKind m_kind;
+  ExpWidenKind m_widen;
+  bool m_memoize;
+};
+
+// interface structure for mapping the expressions in a structure.
+class ExpMapper : public BaseExpMapper
+{
+ public:
+  ExpMapper(ExpVisitorKind kind, ExpWidenKind widen, bool memoize = false)
+    : BaseExpMapper(kind, widen, memoize)
+  {}
+
   // get the result of mapping an exp either to NULL or to another exp.
   // value indicates the exp after its children were mapped, old indicates
   // the exp beforehand. if mapping any children of the exp returned NULL
   // then value itself will be NULL (old is never NULL). consumes a reference
   // on value if non-NULL, gets a reference on the result if non-NULL.
   virtual Exp* Map(Exp *value, Exp *old) = 0;
-
- private:
-  ExpVisitorKind m_kind;
-  ExpWidenKind m_widen;
 };
 
 // interface structure for mapping expressions to possibly multiple exps.
@@ -0,0 +1,400 @@
+
+// Sixgill: Static assertion checker for C/C++ programs.
+// Copyright (C) 2009-2010  Stanford University
+// Author: Brian Hackett
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+// template traversals for visiting and mapping exps and bits. the visitor
+// or mapper type V/M can be ExpVisitor/ExpMapper, in which case each Visit
+// or Map is a virtual call (this is how Exp::DoVisit etc. are implemented),
+// or any class derived from BaseExpVisitor/BaseExpMapper with a non-virtual
+// Visit or Map method, in which case there is no virtual dispatch at all.
+
+/////////////////////////////////////////////////////////////////////
+// Mapping memo
+/////////////////////////////////////////////////////////////////////
+
+// results of mapping exps and bits during a single pass of a mapper whose
+// Memoize() is set. the result of mapping a bit depends on how the mapper
+// is widening at that bit, so these are stored separately for each kind.
+struct ExpMapMemo
+{
+  FlatHashTable<Exp*,Exp*,Exp> exps;
+  FlatHashTable<Bit*,Bit*,Bit> bits[WIDK_Narrow + 1];
+};
+
+/////////////////////////////////////////////////////////////////////
+// Exp traversal
+/////////////////////////////////////////////////////////////////////
+
+template <class V>
+void VisitExp(Exp *exp, V *visitor);
+
+// visit target as a term contained in an lvalue.
+template <class V>
+inline void VisitExpTarget(Exp *target, V *visitor)
+{
+  bool old_found_term = visitor->SetFoundTerm(true);
+  VisitExp(target, visitor);
+  visitor->SetFoundTerm(old_found_term);
+}
+
+template <class V>
+void VisitExp(Exp *exp, V *visitor)
+{
+  if (visitor->IsVisiting())
+    visitor->Visit(exp);
+
+  if (visitor->IsFinished())
+    return;
+
+  switch (exp->Kind()) {
+
+  case EK_Drf: {
+    Exp *target = exp->AsDrf()->GetTarget();
+
+    if (visitor->Kind() == VISK_Lval) {
+      // visit the expression whose value is being accessed.
+      visitor->Visit(target);
+    }
+
+    if (visitor->LvalRecurse()) {
+      bool old_found_lval = visitor->SetFoundLval(true);
+      bool old_found_term = visitor->SetFoundTerm(true);
+      VisitExp(target, visitor);
+      visitor->SetFoundLval(old_found_lval);
+      visitor->SetFoundTerm(old_found_term);
+    }
+    break;
+  }
+
+  case EK_Fld:
+  case EK_Rfld:
+  case EK_NullTest:
+  case EK_Bound:
+  case EK_Terminate:
+    if (visitor->LvalRecurse())
+      VisitExpTarget(exp->GetLvalTarget(), visitor);
+    break;
+
+  case EK_GCSafe: {
+    Exp *target = exp->AsGCSafe()->GetTarget();
+    if (visitor->LvalRecurse() && target)
+      VisitExpTarget(target, visitor);
+    break;
+  }
+
+  case EK_Index: {
+    ExpIndex *nexp = exp->AsIndex();
+
+    if (visitor->LvalRecurse())
+      VisitExpTarget(nexp->GetTarget(), visitor);
+
+    if (visitor->LvalRecurse() && visitor->RvalRecurse()) {
+      bool old_found_lval = visitor->SetFoundLval(false);
+      VisitExp(nexp->GetIndex(), visitor);
+      visitor->SetFoundLval(old_found_lval);
+    }
+    break;
+  }
+
+  case EK_Unop:
+    if (visitor->RvalRecurse())
+      VisitExp(exp->AsUnop()->GetOperand(), visitor);
+    break;
+
+  case EK_Binop:
+    if (visitor->RvalRecurse()) {
+      VisitExp(exp->AsBinop()->GetLeftOperand(), visitor);
+      VisitExp(exp->AsBinop()->GetRightOperand(), visitor);
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+template <class M>
+Exp* MapExpRecurse(Exp *exp, M *mapper, ExpMapMemo *memo)
+{
+  if (memo) {
+    if (Exp **pres = memo->exps.Lookup(exp))
+      return *pres;
+  }
+
+  // exp after mapping its children. this is NULL if mapping any of the
+  // children failed.
+  Exp *value = exp;
+
+  switch (exp->Kind()) {
+
+  case EK_Drf:
+  case EK_Fld:
+  case EK_Rfld:
+  case EK_NullTest:
+  case EK_Bound:
+  case EK_Terminate:
+  case EK_GCSafe: {
+    Exp *target = exp->GetLvalTarget();
+    if (!mapper->LvalRecurse() || !target)
+      break;
+
+    Exp *new_target = MapExpRecurse(target, mapper, memo);
+    value = new_target ? exp->ReplaceLvalTarget(new_target) : NULL;
+    break;
+  }
+
+  case EK_Index: {
+    if (!mapper->LvalRecurse())
+      break;
+
+    ExpIndex *nexp = exp->AsIndex();
+    Exp *new_target = MapExpRecurse(nexp->GetTarget(), mapper, memo);
+
+    Exp *new_index;
+    if (mapper->RvalRecurse())
+      new_index = MapExpRecurse(nexp->GetIndex(), mapper, memo);
+    else
+      new_index = nexp->GetIndex();
+
+    value = NULL;
+    if (new_target && new_index) {
+      value = Exp::MakeIndex(new_target, nexp->GetElementType(), new_index);
+    }
+    break;
+  }
+
+  case EK_Unop: {
+    if (!mapper->RvalRecurse())
+      break;
+
+    ExpUnop *nexp = exp->AsUnop();
+    Exp *new_op = MapExpRecurse(nexp->GetOperand(), mapper, memo);
+
+    value = NULL;
+    if (new_op) {
+      value = Exp::MakeUnop(nexp->GetUnopKind(), new_op,
+                            nexp->Bits(), nexp->Sign());
+    }
+    break;
+  }
+
+  case EK_Binop: {
+    if (!mapper->RvalRecurse())
+      break;
+
+    ExpBinop *nexp = exp->AsBinop();
+    Exp *new_left_op = MapExpRecurse(nexp->GetLeftOperand(), mapper, memo);
+    Exp *new_right_op = MapExpRecurse(nexp->GetRightOperand(), mapper, memo);
+
+    value = NULL;
+    if (new_left_op && new_right_op) {
+      value = Exp::MakeBinop(nexp->GetBinopKind(), new_left_op, new_right_op,
+                             nexp->GetStrideType(),
+                             nexp->Bits(), nexp->Sign());
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  Exp *res = mapper->Map(value, exp);
+
+  if (memo)
+    memo->exps.Insert(exp, res);
+  return res;
+}
+
+template <class M>
+Exp* MapExp(Exp *exp, M *mapper)
+{
+  if (mapper->Memoize()) {
+    ExpMapMemo memo;
+    return MapExpRecurse(exp, mapper, &memo);
+  }
+
+  return MapExpRecurse(exp, mapper, (ExpMapMemo*) NULL);
+}
+
+/////////////////////////////////////////////////////////////////////
+// Bit traversal
+/////////////////////////////////////////////////////////////////////
+
+template <class V>
+void VisitBitRecurse(Bit *bit, V *visitor, bool revisit)
+{
+  if (visitor->IsFinished())
+    return;
+
+  if (!revisit) {
+    Assert(Bit::g_base_used);
+    if (bit->m_base_extra) {
+      // we already visited this bit. don't revisit.
+      return;
+    }
+
+    // make sure we only visit this once during the crawl.
+    // TODO: the visitor might care about the phase of the bit. we need to
+    // visit the bit twice in situations where it appears in both phases.
+    bit->m_base_extra = true;
+  }
+
+  switch (bit->Kind()) {
+  case BIT_True:
+  case BIT_False:
+    return;
+  case BIT_Var:
+    VisitExp(bit->GetVar(), visitor);
+    return;
+  case BIT_Not:
+    visitor->FlipPhase();
+    VisitBitRecurse(bit->GetOperand(0), visitor, revisit);
+    visitor->FlipPhase();
+    return;
+  case BIT_Or:
+    if (visitor->IgnoreDisjunction())
+      return;
+    // fall through.
+  case BIT_And:
+    for (size_t oind = 0; oind < bit->GetOperandCount(); oind++)
+      VisitBitRecurse(bit->GetOperand(oind), visitor, revisit);
+    break;
+  default:
+    Assert(false);
+  }
+}
+
+template <class V>
+void VisitBit(Bit *bit, V *visitor, bool revisit)
+{
+  if (!revisit) {
+    Assert(!Bit::g_base_used);
+    Bit::g_base_used = true;
+  }
+
+  VisitBitRecurse(bit, visitor, revisit);
+
+  if (!revisit) {
+    Bit::g_base_used = false;
+    bit->ClearBaseExtra();
+  }
+}
+
+template <class M>
+Bit* MapBitRecurse(Bit *bit, M *mapper, ExpMapMemo *memo)
+{
+  // unless the mapper is memoizing, bits encountered multiple times during
+  // mapping will be mapped each time. mapping with such mappers should only
+  // be used for relatively compact bits.
+  if (memo) {
+    if (Bit **pres = memo->bits[mapper->Widen()].Lookup(bit))
+      return *pres;
+  }
+
+  Bit *use_bit = NULL;
+
+  switch (bit->Kind()) {
+
+  case BIT_True:
+  case BIT_False:
+    use_bit = bit;
+    break;
+
+  case BIT_Var: {
+    Exp *new_var = MapExpRecurse(bit->GetVar(), mapper, memo);
+    if (new_var) {
+      use_bit = Exp::MakeNonZeroBit(new_var);
+    }
+    else {
+      switch (mapper->Widen()) {
+      case WIDK_Drop:   use_bit = NULL; break;
+      case WIDK_Widen:  use_bit = Bit::MakeConstant(true);  break;
+      case WIDK_Narrow: use_bit = Bit::MakeConstant(false); break;
+      }
+    }
+    break;
+  }
+
+  case BIT_Not: {
+    mapper->FlipWiden();
+    Bit *new_op = MapBitRecurse(bit->GetOperand(0), mapper, memo);
+    mapper->FlipWiden();
+
+    if (new_op) {
+      use_bit = Bit::MakeNot(new_op);
+    }
+    else {
+      Assert(mapper->Widen() == WIDK_Drop);
+      use_bit = NULL;
+    }
+    break;
+  }
+
+  case BIT_And:
+  case BIT_Or: {
+    Vector<Bit*> op_list;
+    bool drop_op_list = false;
+
+    for (size_t oind = 0; oind < bit->GetOperandCount(); oind++) {
+      Bit *new_op = MapBitRecurse(bit->GetOperand(oind), mapper, memo);
+
+      if (new_op) {
+        op_list.PushBack(new_op);
+      }
+      else {
+        Assert(mapper->Widen() == WIDK_Drop);
+        drop_op_list = true;
+        break;
+      }
+    }
+
+    if (drop_op_list) {
+      use_bit = NULL;
+    }
+    else {
+      SortBitList(&op_list);
+
+      if (bit->Kind() == BIT_And) {
+        use_bit = Bit::MakeAnd(op_list);
+      }
+      else {
+        use_bit = Bit::MakeOr(op_list);
+      }
+    }
+    break;
+  }
+
+  default:
+    Assert(false);
+  }
+
+  if (memo)
+    memo->bits[mapper->Widen()].Insert(bit, use_bit);
+  return use_bit;
+}
+
+template <class M>
+Bit* MapBit(Bit *bit, M *mapper)
+{
+  if (mapper->Memoize()) {
+    ExpMapMemo memo;
+    return MapBitRecurse(bit, mapper, &memo);
+  }
+
+  return MapBitRecurse(bit, mapper, (ExpMapMemo*) NULL);
+}
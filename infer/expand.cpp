@@ -141,8 +141,9 @@ class CalleeMapper : public ExpMapper
   // when we can't do the conversion.
   FrameId caller_frame_id;
 
+  // results can only be memoized if the point is known up front.
   CalleeMapper(BlockMemory *_mcfg, PPoint _point, FrameId _caller_frame_id)
-    : ExpMapper(VISK_All, WIDK_Drop),
+    : ExpMapper(VISK_All, WIDK_Drop, _point != 0),
       mcfg(_mcfg), point(_point), caller_frame_id(_caller_frame_id)
   {}
 
@@ -303,7 +304,7 @@ class HeapMapper : public ExpMapper
   bool use_exit;
 
   HeapMapper(Exp *_old_lval, Exp *_new_lval, bool _use_exit)
-    : ExpMapper(VISK_All, WIDK_Drop),
+    : ExpMapper(VISK_All, WIDK_Drop, true),
       old_lval(_old_lval), new_lval(_new_lval), use_exit(_use_exit)
   {}
 
@@ -68,7 +68,7 @@ public:
   bool unrolling;
 
   ConvertCallsiteMapper(BlockCFG *_cfg, PPoint _point, bool _unrolling)
-    : ExpMapper(VISK_All, WIDK_Drop),
+    : ExpMapper(VISK_All, WIDK_Drop, true),
       cfg(_cfg), point(_point), unrolling(_unrolling)
   {}
 
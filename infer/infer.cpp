@@ -725,7 +725,10 @@ void InferSummaries(const Vector<BlockSummary*> &summary_list)
       }
     }
 
-    MarkRedundantAssertions(mcfg, asserts);
+    // skip the solver queries for finding redundant assertions if we are
+    // over budget. all the assertions will then be checked.
+    if (!TimerAlarm::ActiveExpired())
+      MarkRedundantAssertions(mcfg, asserts);
 
     // move the finished assertion list into the summary.
     for (size_t ind = 0; ind < asserts.Size(); ind++) {
@@ -734,9 +737,13 @@ void InferSummaries(const Vector<BlockSummary*> &summary_list)
     }
   }
 
-  // infer delta and termination invariants for all summaries.
-  for (size_t ind = 0; ind < summary_list.Size(); ind++)
+  // infer delta and termination invariants for all summaries. these are
+  // not needed for soundness, and are dropped once we are over budget.
+  for (size_t ind = 0; ind < summary_list.Size(); ind++) {
+    if (TimerAlarm::ActiveExpired())
+      break;
     InferInvariants(summary_list[ind], arithmetic_list);
+  }
 
   BodyAnnotCache.Release(function->GetName());
 }
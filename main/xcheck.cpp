@@ -195,6 +195,9 @@ class CheckTypeVisitor : public ExpVisitor
   }
 };
 
+// how often to print allocation/timer/cache information.
+#define PRINT_FREQUENCY 50
+
 void RunAnalysis(const Vector<const char*> &checks)
 {
   static BaseTimer analysis_timer("xcheck_main");
@@ -204,15 +207,40 @@ void RunAnalysis(const Vector<const char*> &checks)
   DoInitTransaction(t, checks);
   t->Clear();
 
-  size_t current_stage = 0;
+  // state of the worklist loop. this is plain data, with a fork server
+  // it is carried from each child process to the next.
+  struct {
+    // current stage being processed.
+    size_t current_stage;
+
+    // number of items fetched, for periodically printing information.
+    size_t print_counter;
+  } loop = { 0, 0 };
+
+  size_t &current_stage = loop.current_stage;
 
   while (true) {
+    // with a fork server, the work items are processed in child processes.
+    if (!ForkWorker(&loop, sizeof(loop)))
+      break;
+
 #ifndef DEBUG
     ResetTimeout(40);
 #endif
 
     Timer _timer(&analysis_timer);
 
+    loop.print_counter++;
+
+    if (loop.print_counter % PRINT_FREQUENCY == 0) {
+      PrintTimers();
+      PrintAllocs();
+      PrintCaches();
+    }
+
+    // drop cached data if we are using too much memory.
+    ShedCaches();
+
     // construct and submit a worklist fetch transaction.
     size_t stage_result = t->MakeVariable(true);
     size_t body_data_result = t->MakeVariable(true);
@@ -270,6 +298,7 @@ void RunAnalysis(const Vector<const char*> &checks)
     t->Clear();
 
     const char *function = function_cfgs.Back()->GetId()->Function()->Value();
+    _timer.SetDetail(function);
 
     logout << "Checking: '" << function << "'" << endl << endl << flush;
 
@@ -354,12 +383,12 @@ void RunAnalysis(const Vector<const char*> &checks)
         ResetTimeout(40);
 #endif
 
-        // set a soft timeout for the checker/solver.
-        if (uint32_t timeout = GetTimeout())
-          TimerAlarm::StartActive(timeout);
+        // set a soft budget for the checker/solver.
+        PhaseBudget budget(PHASE_Check, GetTimeout());
 
-        logout << "ASSERTION '" << name << "'" << endl;
-        logout << "Point " << info.point << ": " << info.bit << endl;
+        logout_at(LOG_Info) << "ASSERTION '" << name << "'" << endl;
+        logout_at(LOG_Verbose)
+          << "Point " << info.point << ": " << info.bit << endl;
 
         CheckerState *state = CheckAssertion(mcfg->GetId(), info);
 
@@ -388,8 +417,6 @@ void RunAnalysis(const Vector<const char*> &checks)
 
         delete state;
 
-        TimerAlarm::ClearActive();
-
         logout << endl << flush;
       }
 
@@ -413,20 +440,49 @@ void RunAnalysis(const Vector<const char*> &checks)
     PrintTime(_timer.Elapsed());
     logout << endl << endl << flush;
 
+    UpdateCacheSnapshot(true);
+
     // we should analyze the single check our first time through the loop
     // if we're generating an XML file.
     if (xml_file.IsSpecified())
       break;
   }
 
+  ForkWorkerFinish();
   delete t;
 }
 
+// with a fork server, each child saves the cache snapshot when it exits and
+// the server loads it again, so that later children inherit warm caches.
+static void SaveSnapshotCallback()
+{
+  SaveCacheSnapshot(true);
+}
+
+static void LoadSnapshotCallback()
+{
+  LoadCacheSnapshot(true);
+}
+
 int main(int argc, const char **argv)
 {
   timeout.Enable();
   trans_remote.Enable();
   trans_initial.Enable();
+  cache_frequency.Enable();
+  timer_trace.Enable();
+  memory_limit.Enable();
+  buffer_v2.Enable();
+  log_buffer.Enable();
+  log_verbosity.Enable();
+  phase_time.Enable();
+  phase_memory.Enable();
+  fork_batch.Enable();
+  cache_snapshot.Enable();
+
+#ifdef USE_COUNT_ALLOCATOR
+  alloc_sample.Enable();
+#endif
 
   checker_verbose.Enable();
   checker_sufficient.Enable();
@@ -489,11 +545,19 @@ int main(int argc, const char **argv)
   for (size_t ind = 0; ind < checks.Size(); ind++)
     new_checks.PushBack(HtmlUnescape(checks[ind]));
 
+  if (cache_frequency.IsSpecified())
+    SetCachePolicy(HCP_Frequency);
+
   // Solver::CheckSimplifications();
 
   ResetAllocs();
   AnalysisPrepare();
 
+  // warm up the caches from any snapshot saved by an earlier worker.
+  LoadCacheSnapshot(true);
+  g_callback_ForkChildExit = SaveSnapshotCallback;
+  g_callback_ForkServerWarm = LoadSnapshotCallback;
+
   if (new_checks.Empty()) {
     if (trans_initial.IsSpecified())
       SubmitInitialTransaction();
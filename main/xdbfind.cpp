@@ -111,11 +111,14 @@ int main(int argc, const char **argv)
     }
     else if (raw_tags.IsSpecified()) {
       size_t consumed = 0;
+      uint8_t version = 0;
       while (consumed != len) {
         Buffer parse_data(bdata.base + consumed, len - consumed);
         parse_data.pos += len - consumed;
+        parse_data.version = version;
 
         size_t read_len = PrintPartialBuffer(&parse_data);
+        version = parse_data.version;
 
         if (read_len == 0)
           break;
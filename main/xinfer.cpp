@@ -102,7 +102,6 @@ ConfigOption print_memory(CK_Flag, "print-memory", NULL,
 
 // how often to print allocation/timer information.
 #define PRINT_FREQUENCY 50
-size_t g_print_counter = 0;
 
 void RunAnalysis(const Vector<const char*> &functions)
 {
@@ -115,20 +114,37 @@ void RunAnalysis(const Vector<const char*> &functions)
   DoInitTransaction(t, functions);
   t->Clear();
 
-  // current stage being processed.
-  size_t current_stage = 0;
+  // state of the worklist loop. this is plain data, with a fork server
+  // it is carried from each child process to the next.
+  struct {
+    // current stage being processed.
+    size_t current_stage;
+
+    // number of items fetched, for periodically printing information.
+    size_t print_counter;
+  } loop = { 0, 0 };
+
+  size_t &current_stage = loop.current_stage;
 
   while (true) {
+    // with a fork server, the work items are processed in child processes.
+    if (!ForkWorker(&loop, sizeof(loop)))
+      break;
+
     Timer _timer(&analysis_timer);
     ResetTimeout();
 
-    g_print_counter++;
+    loop.print_counter++;
 
-    if (g_print_counter % PRINT_FREQUENCY == 0) {
+    if (loop.print_counter % PRINT_FREQUENCY == 0) {
       PrintTimers();
       PrintAllocs();
+      PrintCaches();
     }
 
+    // drop cached data if we are using too much memory.
+    ShedCaches();
+
     size_t stage_result = t->MakeVariable(true);
     size_t body_data_result = t->MakeVariable(true);
     size_t memory_data_result = t->MakeVariable(true);
@@ -172,6 +188,8 @@ void RunAnalysis(const Vector<const char*> &functions)
     // generate summaries.
 
     String *function = block_cfgs[0]->GetId()->Function();
+    _timer.SetDetail(function->Value());
+
     logout << "Generating summaries for "
            << "\'" << function->Value() << "\'" << endl << flush;
 
@@ -204,12 +222,20 @@ void RunAnalysis(const Vector<const char*> &functions)
     // make sure the cache knows about these summaries.
     BlockSummaryCacheAddList(block_sums);
 
-    InferSummaries(block_sums);
+    // infer the summaries within a soft budget. if the budget is exceeded
+    // the summaries will be missing invariants and redundancy information.
+    {
+      PhaseBudget budget(PHASE_Summary);
+      InferSummaries(block_sums);
+
+      if (budget.Exceeded())
+        logout << "WARNING: Budget exceeded while generating summaries" << endl;
+    }
 
     // print the summaries to screen.
     for (size_t find = 0; find < block_sums.Size(); find++) {
       BlockSummary *sum = block_sums[find];
-        logout << "Computed summary:" << endl << sum << endl;
+        logout_at(LOG_Verbose) << "Computed summary:" << endl << sum << endl;
     }
 
     logout << "Elapsed: ";
@@ -222,16 +248,46 @@ void RunAnalysis(const Vector<const char*> &functions)
                                       body_key, summary_data_arg));
     SubmitTransaction(t);
     t->Clear();
+
+    // summaries are still being generated, so leave them out of snapshots.
+    UpdateCacheSnapshot(false);
   }
 
+  ForkWorkerFinish();
   delete t;
 }
 
+// with a fork server, each child saves the cache snapshot when it exits and
+// the server loads it again, so that later children inherit warm caches.
+static void SaveSnapshotCallback()
+{
+  SaveCacheSnapshot(false);
+}
+
+static void LoadSnapshotCallback()
+{
+  LoadCacheSnapshot(false);
+}
+
 int main(int argc, const char **argv)
 {
   timeout.Enable();
   trans_remote.Enable();
   trans_initial.Enable();
+  cache_frequency.Enable();
+  timer_trace.Enable();
+  memory_limit.Enable();
+  buffer_v2.Enable();
+  log_buffer.Enable();
+  log_verbosity.Enable();
+  phase_time.Enable();
+  phase_memory.Enable();
+  fork_batch.Enable();
+  cache_snapshot.Enable();
+
+#ifdef USE_COUNT_ALLOCATOR
+  alloc_sample.Enable();
+#endif
 
   solver_use.Enable();
   solver_verbose.Enable();
@@ -248,11 +304,19 @@ int main(int argc, const char **argv)
     return 1;
   }
 
+  if (cache_frequency.IsSpecified())
+    SetCachePolicy(HCP_Frequency);
+
   // Solver::CheckSimplifications();
 
   ResetAllocs();
   AnalysisPrepare();
 
+  // warm up the caches from any snapshot saved by an earlier worker.
+  LoadCacheSnapshot(false);
+  g_callback_ForkChildExit = SaveSnapshotCallback;
+  g_callback_ForkServerWarm = LoadSnapshotCallback;
+
   if (trans_initial.IsSpecified())
     SubmitInitialTransaction();
   RunAnalysis(functions);
@@ -89,15 +89,17 @@ struct ConnectData {
   // whether this is a live connection.
   bool live;
 
-  // buffer containing partially/fully read packet
+  // buffer containing partially/fully read packet. string operands in
+  // the transaction read from the packet refer directly to this data.
   Buffer read_buf;
 
-  // buffer containing partially/fully written packet.
-  // this does not have its own allocation but refers to
-  // data in read_buf; there will not be simultaneous
-  // reading and writing.
+  // buffer containing the result of the last transaction, if it has
+  // not been fully written yet.
   Buffer write_buf;
 
+  // number of bytes of the result packet which have been written.
+  size_t write_count;
+
   // event associated with this connection
   struct event ev;
 
@@ -105,7 +107,7 @@ struct ConnectData {
   int fd;
 
   ConnectData()
-    : live(false), read_buf(), write_buf(NULL, 0), fd(-1)
+    : live(false), read_buf(), write_buf(), write_count(0), fd(-1)
   {}
 };
 
@@ -122,12 +124,13 @@ void handle_event(int fd, short, void *v)
   ConnectData *cdata = connections[index];
   Assert(cdata->live);
 
-  if (cdata->write_buf.size != 0) {
-    success = WritePacket(fd, &cdata->write_buf);
+  if (cdata->write_buf.pos != cdata->write_buf.base) {
+    success = WritePacket(fd, cdata->write_buf.base,
+                          cdata->write_buf.pos - cdata->write_buf.base,
+                          &cdata->write_count);
     if (success) {
-      cdata->write_buf.base = NULL;
-      cdata->write_buf.pos = NULL;
-      cdata->write_buf.size = 0;
+      cdata->write_buf.Reset();
+      cdata->write_count = 0;
     }
   }
   else {
@@ -150,22 +153,16 @@ void handle_event(int fd, short, void *v)
       handling_transaction = true;
       t->Execute();
 
-      cdata->read_buf.pos = cdata->read_buf.base;
-      cdata->read_buf.Ensure(UINT32_LENGTH);
-      cdata->read_buf.pos += UINT32_LENGTH;
-      t->WriteResult(&cdata->read_buf);
-
-      cdata->write_buf.base = cdata->read_buf.base;
-      cdata->write_buf.pos = cdata->write_buf.base;
-      cdata->write_buf.size = cdata->read_buf.pos - cdata->read_buf.base;
+      // the result goes in a separate buffer, as the transaction still
+      // refers to the packet data in read_buf.
+      t->WriteResult(&cdata->write_buf);
 
-      cdata->read_buf.pos = cdata->read_buf.base;
-
-      success = WritePacket(fd, &cdata->write_buf);
+      success = WritePacket(fd, cdata->write_buf.base,
+                            cdata->write_buf.pos - cdata->write_buf.base,
+                            &cdata->write_count);
       if (success) {
-        cdata->write_buf.base = NULL;
-        cdata->write_buf.pos = NULL;
-        cdata->write_buf.size = 0;
+        cdata->write_buf.Reset();
+        cdata->write_count = 0;
       }
 
       // watch for initial and final transactions.
@@ -192,6 +189,8 @@ void handle_event(int fd, short, void *v)
 
       delete t;
       handling_transaction = false;
+
+      cdata->read_buf.pos = cdata->read_buf.base;
     }
     else if ((ssize_t) length == cdata->read_buf.pos - cdata->read_buf.base) {
       // connection is closed. there is nothing to read so remove the event.
@@ -291,9 +290,8 @@ int main(int argc, const char **argv)
   spawn_command.Enable();
   spawn_count.Enable();
 
-#ifdef USE_COUNT_ALLOCATOR
   memory_limit.Enable();
-#endif
+  buffer_v2.Enable();
 
   modset_wait.Enable();
 
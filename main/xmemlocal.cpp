@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <sys/resource.h>
 
+#include <imlang/aig.h>
 #include <imlang/block.h>
 #include <imlang/storage.h>
 #include <memory/mblock.h>
@@ -228,10 +229,9 @@ bool GenerateMemory(const Vector<BlockCFG*> &block_cfgs, size_t stage,
 
   // generate memory information and (possibly) modsets for each CFG.
   for (size_t cind = 0; cind < block_cfgs.Size(); cind++) {
-    // set a soft timeout for memory/modset computation.
+    // set a soft budget for memory/modset computation.
     // we don't set a hard timeout as these break the indirect callgraph.
-    if (uint32_t timeout = GetTimeout())
-      TimerAlarm::StartActive(timeout);
+    PhaseBudget budget(PHASE_Memory, GetTimeout());
 
     BlockCFG *cfg = block_cfgs[cind];
     BlockId *id = cfg->GetId();
@@ -259,10 +259,10 @@ bool GenerateMemory(const Vector<BlockCFG*> &block_cfgs, size_t stage,
     BlockId *mod_id = BlockId::Make(id->Kind(), function, loop, true);
     BlockModset *mod = BlockModset::Make(mod_id);
 
-    if (!TimerAlarm::ActiveExpired())
+    if (!budget.Exceeded())
       mod->ComputeModset(mem, indirect);
 
-    logout << "Computed modset:" << endl << mod << endl;
+    logout_at(LOG_Verbose) << "Computed modset:" << endl << mod << endl;
     block_mods->PushBack(mod);
 
     // add an entry to the modset cache. we process the function CFGs from
@@ -279,15 +279,16 @@ bool GenerateMemory(const Vector<BlockCFG*> &block_cfgs, size_t stage,
     block_mems->PushBack(mem);
     logout << endl;
 
-    if (TimerAlarm::ActiveExpired()) {
-      logout << "ERROR: Timeout while generating memory: ";
+    if (budget.Exceeded()) {
+      if (budget.HeapExceeded())
+        logout << "ERROR: Memory budget exceeded while generating memory: ";
+      else
+        logout << "ERROR: Timeout while generating memory: ";
       PrintTime(TimerAlarm::ActiveElapsed());
       logout << endl;
 
       had_timeout = true;
     }
-
-    TimerAlarm::ClearActive();
   }
 
   return !had_timeout;
@@ -295,7 +296,6 @@ bool GenerateMemory(const Vector<BlockCFG*> &block_cfgs, size_t stage,
 
 // how often to print allocation/timer information.
 #define PRINT_FREQUENCY 50
-size_t g_print_counter = 0;
 
 void RunAnalysis(const Vector<const char*> &functions)
 {
@@ -309,29 +309,50 @@ void RunAnalysis(const Vector<const char*> &functions)
   DoInitTransaction(t, functions);
   t->Clear();
 
-  // current stage being processed.
-  size_t current_stage = 0;
+  // state of the worklist loop. this is plain data, with a fork server
+  // it is carried from each child process to the next.
+  struct {
+    // current stage being processed.
+    size_t current_stage;
+
+    // whether we've processed any functions in the current stage.
+    bool current_stage_processed;
+
+    // whether we've had an empty function in the current stage.
+    bool current_stage_waited;
 
-  // whether we've processed any functions in the current stage.
-  bool current_stage_processed = false;
+    // number of items fetched, for periodically printing information.
+    size_t print_counter;
+  } loop = { 0, false, false, 0 };
 
-  // whether we've had an empty function in the current stage.
-  bool current_stage_waited = false;
+  size_t &current_stage = loop.current_stage;
+  bool &current_stage_processed = loop.current_stage_processed;
+  bool &current_stage_waited = loop.current_stage_waited;
 
   while (true) {
+    // with a fork server, the work items are processed in child processes.
+    if (!ForkWorker(&loop, sizeof(loop)))
+      break;
+
     Timer _timer(&analysis_timer);
 
-    g_print_counter++;
+    loop.print_counter++;
 
-    if (g_print_counter % PRINT_FREQUENCY == 0) {
+    if (loop.print_counter % PRINT_FREQUENCY == 0) {
       PrintTimers();
       PrintAllocs();
+      PrintCaches();
     }
 
+    // drop cached data if we are using too much memory.
+    ShedCaches();
+
     // currently memory usage for xmemlocal can balloon (not sure what's
     // causing this). There's no real way to get memory usage on Linux
     // (getrusage is broken) so just die every so often. TODO: fix this.
-    if (IsAnalysisRemote() && g_print_counter == 5000) {
+    // this isn't needed with a fork server, where children are short lived.
+    if (IsAnalysisRemote() && !fork_batch.UIntValue() &&
+        loop.print_counter == 5000) {
       logout << "Restarting process, function threshold reached." << endl;
       ClearBlockCaches();
       ClearMemoryCaches();
@@ -397,6 +418,7 @@ void RunAnalysis(const Vector<const char*> &functions)
 
     Assert(!block_cfgs.Empty());
     String *function = block_cfgs[0]->GetId()->Function();
+    _timer.SetDetail(function->Value());
 
     Vector<BlockModset*> old_mods;
     TOperandString *modset_data = t->LookupString(modset_data_result);
@@ -427,7 +449,15 @@ void RunAnalysis(const Vector<const char*> &functions)
                                         body_key, memory_arg));
 
       TOperandString *modset_arg = BlockModsetCompress(t, block_mods);
-      t->PushAction(Backend::BlockWriteModset(t, body_key, modset_arg));
+
+      TOperandList *callee_list = new TOperandList(t);
+      for (size_t ind = 0; ind < callees.Size(); ind++) {
+        const char *callee = callees[ind]->GetName()->Value();
+        callee_list->PushOperand(new TOperandString(t, callee));
+      }
+
+      t->PushAction(Backend::BlockWriteModset(t, body_key, modset_arg,
+                                              callee_list));
 
       if (current_stage > g_stage_count) {
         // if the computed modset for the outer function has changed then
@@ -488,6 +518,8 @@ void RunAnalysis(const Vector<const char*> &functions)
     }
   }
 
+  // globals are processed by the fork server itself, if there is one.
+  ForkWorkerFinish();
   t->Clear();
 
   if (!functions.Empty()) {
@@ -534,8 +566,7 @@ void RunAnalysis(const Vector<const char*> &functions)
     Vector<BlockMemory*> block_mems;
 
     for (size_t ind = 0; ind < block_cfgs.Size(); ind++) {
-      if (uint32_t timeout = GetTimeout())
-        TimerAlarm::StartActive(timeout);
+      PhaseBudget budget(PHASE_Memory, GetTimeout());
 
       BlockCFG *cfg = block_cfgs[ind];
       BlockId *id = cfg->GetId();
@@ -550,7 +581,6 @@ void RunAnalysis(const Vector<const char*> &functions)
       mem->ComputeTables();
 
       block_mems.PushBack(mem);
-      TimerAlarm::ClearActive();
     }
 
     init_key = new TOperandString(t, global->Value());
@@ -570,11 +600,26 @@ int main(int argc, const char **argv)
   timeout.Enable();
   trans_remote.Enable();
   trans_initial.Enable();
+  cache_frequency.Enable();
+  timer_trace.Enable();
+  memory_limit.Enable();
+  buffer_v2.Enable();
+  log_buffer.Enable();
+  log_verbosity.Enable();
+  phase_time.Enable();
+  phase_memory.Enable();
+  fork_batch.Enable();
+
+#ifdef USE_COUNT_ALLOCATOR
+  alloc_sample.Enable();
+#endif
 
   print_cfgs.Enable();
   print_memory.Enable();
   print_indirect_calls.Enable();
   pass_limit.Enable();
+  guard_sweep.Enable();
+  solver_use.Enable();
 
   Vector<const char*> functions;
   bool parsed = Config::Parse(argc, argv, &functions);
@@ -583,8 +628,15 @@ int main(int argc, const char **argv)
     return 1;
   }
 
+  if (cache_frequency.IsSpecified())
+    SetCachePolicy(HCP_Frequency);
+
   // Solver::CheckSimplifications();
 
+  // check candidate equivalences found while compacting guards.
+  if (guard_sweep.IsSpecified())
+    g_callback_AigEquivalent = Solver::BitEquivalent;
+
   ResetAllocs();
   AnalysisPrepare();
 
@@ -426,14 +426,9 @@ static void ProcessVirtualCallees(BlockCFG *cfg, PEdgeCall *edge,
   // if the same callee was added by a superclass: the callee was not
   // overridden and the implementation expects a value of the superclass type.
   Variable *function = NULL;
-  for (size_t ind = 0; csu && ind < csu->GetFunctionFieldCount(); ind++) {
-    const FunctionField &ff = csu->GetFunctionField(ind);
-    if (ff.field == field) {
-      if (ff.function && !super_callees->Contains(ff.function))
-        function = ff.function;
-      break;
-    }
-  }
+  const FunctionField *ff = csu ? csu->FindFunctionField(field) : NULL;
+  if (ff && ff->function && !super_callees->Contains(ff->function))
+    function = ff->function;
 
   if (function) {
     if (print_indirect_calls.IsSpecified())
@@ -723,30 +723,25 @@ static void ProcessBaseClasses(TypeCSU *type)
   CompositeCSU *csu = LookupCSU(csu_name);
   if (!csu) return;
 
-  Vector<Field*> processed;
+  for (size_t ind = 0; ind < csu->GetBaseClassCount(); ind++) {
+    Field *base = csu->GetBaseClass(ind);
+    String *base_name = base->GetType()->AsCSU()->GetCSUName();
 
-  for (size_t ind = 0; ind < csu->GetFunctionFieldCount(); ind++) {
-    const FunctionField &ff = csu->GetFunctionField(ind);
-    if (ff.base && !processed.Contains(ff.base)) {
-      processed.PushBack(ff.base);
-      String *base_name = ff.base->GetType()->AsCSU()->GetCSUName();
+    // use a special ID for the base class edges, as this may be called
+    // repeatedly for the same subclass.
+    String *id_name = String::Make("__class_hierarchy__");
+    Variable *id_var = Variable::Make(NULL, VK_Func, id_name, 0, NULL);
+    BlockId *id = BlockId::Make(B_Initializer, id_var);
+    BlockPPoint where(id, 0);
 
-      // use a special ID for the base class edges, as this may be called
-      // repeatedly for the same subclass.
-      String *id_name = String::Make("__class_hierarchy__");
-      Variable *id_var = Variable::Make(NULL, VK_Func, id_name, 0, NULL);
-      BlockId *id = BlockId::Make(B_Initializer, id_var);
-      BlockPPoint where(id, 0);
+    Exp *empty = Exp::MakeEmpty();
+    Exp *base_fld = Exp::MakeFld(empty, base);
 
-      Exp *empty = Exp::MakeEmpty();
-      Exp *base_fld = Exp::MakeFld(empty, ff.base);
+    Trace *sub_loc = Trace::MakeComp(base_fld, csu_name);
+    Trace *super_loc = Trace::MakeComp(empty, base_name);
 
-      Trace *sub_loc = Trace::MakeComp(base_fld, csu_name);
-      Trace *super_loc = Trace::MakeComp(empty, base_name);
-
-      ProcessEdge(where, true, sub_loc, super_loc, NULL, false, false);
-      ProcessEdge(where, false, super_loc, sub_loc, NULL, false, false);
-    }
+    ProcessEdge(where, true, sub_loc, super_loc, NULL, false, false);
+    ProcessEdge(where, false, super_loc, sub_loc, NULL, false, false);
   }
 
   ReleaseCSU(csu_name, csu);
@@ -959,7 +954,8 @@ void EscapeProcessCall(BlockCFG *cfg, PEdgeCall *edge, Variable *callee)
 /////////////////////////////////////////////////////////////////////
 
 EscapeStatus::EscapeStatus(bool forward, size_t cutoff)
-  : m_forward(forward), m_cutoff(cutoff), m_cutoff_reached(false)
+  : m_forward(forward), m_cutoff(cutoff), m_cutoff_reached(false),
+    m_budget(NULL)
 {}
 
 // remove any context from the specified trace location. no escape edges
@@ -1026,9 +1022,13 @@ bool EscapeStatus::FollowEscape(Trace *source)
   if (m_cutoff_reached)
     return false;
 
+  PhaseBudget budget(PHASE_Escape);
+  m_budget = &budget;
+
   EscapeStackEdge edge;
   RecursiveEscape(source, edge);
 
+  m_budget = NULL;
   return !m_cutoff_reached;
 }
 
@@ -1045,13 +1045,11 @@ void EscapeStatus::RecursiveEscape(Trace *source, const EscapeStackEdge &prev)
   if (new_source == NULL)
     return;
 
-  Vector<EscapeStackEdge> *entries = m_visited.Lookup(new_source, true);
-
   // check if our initial trace simplified to another we have seen before.
-  if (!entries->Empty())
+  if (m_visited.Lookup(new_source))
     return;
 
-  entries->PushBack(prev);
+  m_visited.Insert(new_source, prev);
 
   if (m_cutoff && !skip_cutoff) {
     m_cutoff--;
@@ -1061,6 +1059,12 @@ void EscapeStatus::RecursiveEscape(Trace *source, const EscapeStackEdge &prev)
     }
   }
 
+  // running out of budget is handled the same as reaching the cutoff.
+  if (m_budget->Exceeded()) {
+    m_cutoff_reached = true;
+    return;
+  }
+
   Cache_EscapeEdgeSet &cache =
     m_forward ? EscapeForwardCache : EscapeBackwardCache;
 
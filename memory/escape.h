@@ -289,7 +289,8 @@ class EscapeStatus
   // visit all traces reachable from source via escape edges in a depth first
   // search. the result indicates whether the search was exhaustive;
   // the search is non-exhaustive if the cutoff is reached in terms of numbers
-  // of different traces returned by Visit.
+  // of different traces returned by Visit, or if the escape phase budget
+  // or the active alarm expires.
   bool FollowEscape(Trace *source);
 
   // if called within FollowEscape (e.g. by Visit), prints the exploration
@@ -313,12 +314,15 @@ class EscapeStatus
   // whether the cutoff has been reached by some FollowEscape.
   bool m_cutoff_reached;
 
+  // budget for the active FollowEscape, if there is one.
+  PhaseBudget *m_budget;
+
   // active exploration statck.
   Vector<EscapeStackEdge> m_stack;
 
   // keys are traces we have visited during this propagation, entries are the
   // top of the exploration stack when the key was first encountered.
-  HashTable<Trace*,EscapeStackEdge,HashObject> m_visited;
+  FlatHashTable<Trace*,EscapeStackEdge,HashObject> m_visited;
 
   // recursive exploration function for FollowEscape.
   void RecursiveEscape(Trace *trace, const EscapeStackEdge &prev);
@@ -24,6 +24,7 @@
 #include "mstorage.h"
 #include "baked.h"
 
+#include <imlang/aig.h>
 #include <imlang/storage.h>
 #include <util/config.h>
 #include <solve/solver.h>
@@ -37,6 +38,19 @@ NAMESPACE_XGILL_BEGIN
 // to expand using TRK_TryRemoveVal.
 #define TRY_REMOVE_CUTOFF 20
 
+// approximate size of each separately encoded group of table entries.
+// larger groups allow more sharing of data between the entries for
+// different points, but require more decoding when accessing a single point.
+#define ENTRY_GROUP_BYTES 16384
+
+// minimum size of a guard before trying to compact it by converting it
+// to an and-inverter graph and back, with -guard-sweep.
+#define GUARD_COMPACT_CUTOFF 40
+
+ConfigOption guard_sweep(CK_Flag, "guard-sweep", NULL,
+                         "use the solver to merge equivalent subformulas "
+                         "when compacting large guards");
+
 /////////////////////////////////////////////////////////////////////
 // BlockMemory static
 /////////////////////////////////////////////////////////////////////
@@ -123,6 +137,16 @@ static void WriteGuardAssign(Buffer *buf, tag_t tag, PPoint point,
   }
 }
 
+static void WriteEntryGroup(Buffer *buf, const Vector<PPoint> &points,
+                            Buffer *group_buf)
+{
+  WriteOpenTag(buf, TAG_MemoryEntryGroup);
+  for (size_t ind = 0; ind < points.Size(); ind++)
+    WriteTagUInt32(buf, TAG_Index, points[ind]);
+  WriteString(buf, group_buf->base, group_buf->pos - group_buf->base);
+  WriteCloseTag(buf, TAG_MemoryEntryGroup);
+}
+
 void BlockMemory::Write(Buffer *buf, const BlockMemory *mcfg)
 {
   Assert(mcfg->m_cfg && mcfg->m_computed);
@@ -142,30 +166,50 @@ void BlockMemory::Write(Buffer *buf, const BlockMemory *mcfg)
     WriteAssume(buf, mcfg->m_assume_table->ItKey(),
                 mcfg->m_assume_table->ItValueSingle());
 
-  HashIteratePtr(mcfg->m_return_table)
-    WriteGuardExp(buf, TAG_MemoryReturnEntry,
-                  mcfg->m_return_table->ItKey(),
-                  mcfg->m_return_table->ItValues());
+  // write the remaining entries for runs of consecutive points to separate
+  // buffers, so that readers only need to decode the groups containing
+  // the points they access.
+  static Buffer group_buf;
+  Vector<PPoint> group_points;
+
+  PPoint point_count = mcfg->m_cfg->GetPointCount();
+  for (PPoint point = 1; point <= point_count; point++) {
+    mcfg->DecodePoint(point);
+    uint8_t *start_pos = group_buf.pos;
 
-  HashIteratePtr(mcfg->m_target_table)
-    WriteGuardExp(buf, TAG_MemoryTargetEntry,
-                  mcfg->m_target_table->ItKey(),
-                  mcfg->m_target_table->ItValues());
+    if (Vector<GuardExp> *returns =
+        mcfg->m_return_table->Lookup(point, false))
+      WriteGuardExp(&group_buf, TAG_MemoryReturnEntry, point, *returns);
 
-  HashIteratePtr(mcfg->m_assign_table)
-    WriteGuardAssign(buf, TAG_MemoryAssignEntry,
-                     mcfg->m_assign_table->ItKey(),
-                     mcfg->m_assign_table->ItValues());
+    if (Vector<GuardExp> *targets =
+        mcfg->m_target_table->Lookup(point, false))
+      WriteGuardExp(&group_buf, TAG_MemoryTargetEntry, point, *targets);
 
-  HashIteratePtr(mcfg->m_argument_table)
-    WriteGuardAssign(buf, TAG_MemoryArgumentEntry,
-                     mcfg->m_argument_table->ItKey(),
-                     mcfg->m_argument_table->ItValues());
+    if (Vector<GuardAssign> *assigns =
+        mcfg->m_assign_table->Lookup(point, false))
+      WriteGuardAssign(&group_buf, TAG_MemoryAssignEntry, point, *assigns);
 
-  HashIteratePtr(mcfg->m_clobber_table)
-    WriteGuardAssign(buf, TAG_MemoryClobberEntry,
-                     mcfg->m_clobber_table->ItKey(),
-                     mcfg->m_clobber_table->ItValues());
+    if (Vector<GuardAssign> *arguments =
+        mcfg->m_argument_table->Lookup(point, false))
+      WriteGuardAssign(&group_buf, TAG_MemoryArgumentEntry,
+                       point, *arguments);
+
+    if (Vector<GuardAssign> *clobbers =
+        mcfg->m_clobber_table->Lookup(point, false))
+      WriteGuardAssign(&group_buf, TAG_MemoryClobberEntry,
+                       point, *clobbers);
+
+    if (group_buf.pos != start_pos)
+      group_points.PushBack(point);
+
+    size_t group_length = group_buf.pos - group_buf.base;
+    if (group_length >= ENTRY_GROUP_BYTES ||
+        (point == point_count && group_length)) {
+      WriteEntryGroup(buf, group_points, &group_buf);
+      group_buf.Reset();
+      group_points.Clear();
+    }
+  }
 
   if (mcfg->m_gc_table) {
     for (size_t ind = 0; ind < mcfg->m_gc_table->Size(); ind++)
@@ -176,6 +220,65 @@ void BlockMemory::Write(Buffer *buf, const BlockMemory *mcfg)
   WriteCloseTag(buf, TAG_BlockMemory);
 }
 
+bool BlockMemory::ReadValueEntry(Buffer *buf) const
+{
+  PPoint point;
+
+  switch (PeekOpenTag(buf)) {
+  case TAG_MemoryReturnEntry:
+  case TAG_MemoryTargetEntry: {
+    tag_t tag = PeekOpenTag(buf);
+
+    Try(ReadOpenTag(buf, tag));
+    Try(ReadTagUInt32(buf, TAG_Index, &point));
+    Exp *exp = Exp::Read(buf);
+    Bit *guard = Bit::Read(buf);
+    Try(ReadCloseTag(buf, tag));
+
+    GuardExpTable *table;
+    if (tag == TAG_MemoryReturnEntry)
+      table = m_return_table;
+    else if (tag == TAG_MemoryTargetEntry)
+      table = m_target_table;
+    else Assert(false);
+
+    Vector<GuardExp> *entries = table->Lookup(point, true);
+    entries->PushBack(GuardExp(exp, guard));
+    return true;
+  }
+  case TAG_MemoryAssignEntry:
+  case TAG_MemoryArgumentEntry:
+  case TAG_MemoryClobberEntry: {
+    tag_t tag = PeekOpenTag(buf);
+
+    Try(ReadOpenTag(buf, tag));
+    Try(ReadTagUInt32(buf, TAG_Index, &point));
+    Exp *left = Exp::Read(buf);
+    Exp *right = Exp::Read(buf);
+    Exp *kind = NULL;
+    if (PeekOpenTag(buf) == TAG_Exp)
+      kind = Exp::Read(buf);
+    Bit *guard = Bit::Read(buf);
+    Try(ReadCloseTag(buf, tag));
+
+    GuardAssignTable *table;
+    if (tag == TAG_MemoryAssignEntry)
+      table = m_assign_table;
+    else if (tag == TAG_MemoryArgumentEntry)
+      table = m_argument_table;
+    else if (tag == TAG_MemoryClobberEntry)
+      table = m_clobber_table;
+    else Assert(false);
+
+    Vector<GuardAssign> *entries = table->Lookup(point, true);
+    entries->PushBack(GuardAssign(left, right, guard, kind));
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
 BlockMemory* BlockMemory::Read(Buffer *buf)
 {
   BlockMemory *res = NULL;
@@ -242,55 +345,30 @@ BlockMemory* BlockMemory::Read(Buffer *buf)
       entries->PushBack(GuardTrueFalse(true_guard, false_guard));
       break;
     }
-    case TAG_MemoryReturnEntry:
-    case TAG_MemoryTargetEntry: {
+    case TAG_MemoryEntryGroup: {
       Try(res);
-      tag_t tag = PeekOpenTag(buf);
-
-      Try(ReadOpenTag(buf, tag));
-      Try(ReadTagUInt32(buf, TAG_Index, &point));
-      Exp *exp = Exp::Read(buf);
-      Bit *guard = Bit::Read(buf);
-      Try(ReadCloseTag(buf, tag));
-
-      GuardExpTable *table;
-      if (tag == TAG_MemoryReturnEntry)
-        table = res->m_return_table;
-      else if (tag == TAG_MemoryTargetEntry)
-        table = res->m_target_table;
-      else Assert(false);
+      Vector<PPoint> points;
+      const uint8_t *data = NULL;
+      size_t length = 0;
+
+      Try(ReadOpenTag(buf, TAG_MemoryEntryGroup));
+      while (PeekOpenTag(buf) == TAG_Index) {
+        Try(ReadTagUInt32(buf, TAG_Index, &point));
+        points.PushBack(point);
+      }
+      Try(ReadString(buf, &data, &length));
+      Try(ReadCloseTag(buf, TAG_MemoryEntryGroup));
 
-      Vector<GuardExp> *entries = table->Lookup(point, true);
-      entries->PushBack(GuardExp(exp, guard));
+      res->AddLazyGroup(points, data, length);
       break;
     }
+    case TAG_MemoryReturnEntry:
+    case TAG_MemoryTargetEntry:
     case TAG_MemoryAssignEntry:
     case TAG_MemoryArgumentEntry:
     case TAG_MemoryClobberEntry: {
       Try(res);
-      tag_t tag = PeekOpenTag(buf);
-
-      Try(ReadOpenTag(buf, tag));
-      Try(ReadTagUInt32(buf, TAG_Index, &point));
-      Exp *left = Exp::Read(buf);
-      Exp *right = Exp::Read(buf);
-      Exp *kind = NULL;
-      if (PeekOpenTag(buf) == TAG_Exp)
-        kind = Exp::Read(buf);
-      Bit *guard = Bit::Read(buf);
-      Try(ReadCloseTag(buf, tag));
-
-      GuardAssignTable *table;
-      if (tag == TAG_MemoryAssignEntry)
-        table = res->m_assign_table;
-      else if (tag == TAG_MemoryArgumentEntry)
-        table = res->m_argument_table;
-      else if (tag == TAG_MemoryClobberEntry)
-        table = res->m_clobber_table;
-      else Assert(false);
-
-      Vector<GuardAssign> *entries = table->Lookup(point, true);
-      entries->PushBack(GuardAssign(left, right, guard, kind));
+      Try(res->ReadValueEntry(buf));
       break;
     }
     case TAG_MemoryGCEntry: {
@@ -490,6 +568,7 @@ BlockMemory::BlockMemory(BlockId *id,
     m_return_table(NULL), m_target_table(NULL),
     m_assign_table(NULL), m_argument_table(NULL),
     m_clobber_table(NULL), m_gc_table(NULL),
+    m_lazy_data(NULL), m_lazy_groups(NULL), m_lazy_table(NULL),
     m_val_table(NULL), m_translate_table(NULL)
 {
   Assert(m_id);
@@ -542,14 +621,14 @@ void BlockMemory::ComputeTables()
     // - call retval/target/argument values
     // - assignment lval/rvals
 
-    const Vector<PEdge*> &outgoing = m_cfg->GetOutgoingEdges(point);
+    PEdgeList outgoing = m_cfg->GetOutgoingEdges(point);
 
     // sanity check the outgoing edges
     CheckOutgoingEdges(outgoing);
 
     for (size_t oind = 0; oind < outgoing.Size(); oind++) {
       PEdge *edge = outgoing[oind];
-      switch (edge->Kind()) {
+      switch (outgoing.Kind(oind)) {
       case EGK_Assume:
         ComputeEdgeAssume(edge->AsAssume());
         break;
@@ -642,6 +721,7 @@ const Vector<GuardExp>* BlockMemory::GetReturns(PPoint point) const
 {
   Assert(m_computed);
   Assert(point);
+  DecodePoint(point);
   return m_return_table->Lookup(point, false);
 }
 
@@ -649,6 +729,7 @@ const Vector<GuardExp>* BlockMemory::GetTargets(PPoint point) const
 {
   Assert(m_computed);
   Assert(point);
+  DecodePoint(point);
   return m_target_table->Lookup(point, false);
 }
 
@@ -656,6 +737,7 @@ const Vector<GuardAssign>* BlockMemory::GetAssigns(PPoint point) const
 {
   Assert(m_computed);
   Assert(point);
+  DecodePoint(point);
   return m_assign_table->Lookup(point, false);
 }
 
@@ -663,6 +745,7 @@ const Vector<GuardAssign>* BlockMemory::GetArguments(PPoint point) const
 {
   Assert(m_computed);
   Assert(point);
+  DecodePoint(point);
   return m_argument_table->Lookup(point, false);
 }
 
@@ -718,7 +801,7 @@ BlockMemory::GetVal(Exp *lval, Exp *kind, PPoint point)
 
   // otherwise accumulate the values over each incoming edge.
 
-  const Vector<PEdge*> &incoming = m_cfg->GetIncomingEdges(point);
+  PEdgeList incoming = m_cfg->GetIncomingEdges(point);
   size_t incoming_count = incoming.Size();
   Assert(incoming_count);
 
@@ -941,8 +1024,7 @@ void BlockMemory::TranslateExp(TranslateKind kind, PPoint point, Exp *exp,
     if (translating_call && var->Kind() == VK_Return) {
       // return value is translated to the caller's return value.
 
-      const Vector<GuardExp> *returns =
-        m_return_table->Lookup(point, false);
+      const Vector<GuardExp> *returns = GetReturns(point);
 
       if (returns) {
         for (size_t rind = 0; rind < returns->Size(); rind++) {
@@ -1016,8 +1098,7 @@ void BlockMemory::TranslateExp(TranslateKind kind, PPoint point, Exp *exp,
       }
 
       // scan the arguments to look for a matching expression.
-      const Vector<GuardAssign> *arguments
-        = m_argument_table->Lookup(point, false);
+      const Vector<GuardAssign> *arguments = GetArguments(point);
 
       if (arguments) {
         for (size_t aind = 0; aind < arguments->Size(); aind++) {
@@ -1029,7 +1110,7 @@ void BlockMemory::TranslateExp(TranslateKind kind, PPoint point, Exp *exp,
     }
     else if (call_this) {
       // use the value of the instance object at the call site.
-      Vector<GuardExp> *targets = m_target_table->Lookup(point, false);
+      const Vector<GuardExp> *targets = GetTargets(point);
 
       if (targets) {
         for (size_t tind = 0; tind < targets->Size(); tind++)
@@ -1243,7 +1324,7 @@ void BlockMemory::TranslateExp(TranslateKind kind, PPoint point, Exp *exp,
         // point, thus we only need to follow a single path backwards.
         PPoint loop_point = point;
         while (true) {
-          const Vector<PEdge*> &incoming = m_cfg->GetIncomingEdges(loop_point);
+          PEdgeList incoming = m_cfg->GetIncomingEdges(loop_point);
           Assert(!incoming.Empty());
           loop_point = incoming[0]->GetSource();
           if (incoming[0]->IsLoop()) break;
@@ -1730,6 +1811,7 @@ bool BlockMemory::IsLvalClobbered(Exp *lval, Exp *kind, PEdge *edge,
   if (!edge->IsCall() && !edge->IsLoop())
     return false;
 
+  DecodePoint(edge->GetSource());
   Vector<GuardAssign> *clobbered =
     m_clobber_table->Lookup(edge->GetSource(), false);
 
@@ -1918,6 +2000,7 @@ void BlockMemory::Print(OutStream &out) const
 
   for (PPoint point = 1; point <= m_cfg->GetPointCount(); point++) {
     Bit *guard = GetGuard(point);
+    DecodePoint(point);
 
     out << "point " << point << ": guard " << guard << endl;
 
@@ -2065,6 +2148,12 @@ void BlockMemory::UnPersist()
   delete m_val_table;
   delete m_translate_table;
 
+  if (m_lazy_data) {
+    delete m_lazy_data;
+    delete m_lazy_groups;
+    delete m_lazy_table;
+  }
+
   m_guard_table = NULL;
   m_assume_table = NULL;
   m_return_table = NULL;
@@ -2075,6 +2164,9 @@ void BlockMemory::UnPersist()
   m_gc_table = NULL;
   m_val_table = NULL;
   m_translate_table = NULL;
+  m_lazy_data = NULL;
+  m_lazy_groups = NULL;
+  m_lazy_table = NULL;
 
   m_computed = false;
 }
@@ -2093,16 +2185,57 @@ void BlockMemory::MakeTables()
   m_translate_table = new TranslateTable();
 }
 
-void BlockMemory::CheckOutgoingEdges(const Vector<PEdge*> &outgoing)
+void BlockMemory::AddLazyGroup(const Vector<PPoint> &points,
+                               const uint8_t *data, size_t length)
+{
+  if (!m_lazy_data) {
+    m_lazy_data = new Buffer("BlockMemory");
+    m_lazy_groups = new Vector<LazyGroup>();
+    m_lazy_table = new LazyTable();
+  }
+
+  LazyGroup group;
+  group.offset = m_lazy_data->pos - m_lazy_data->base;
+  group.length = length;
+  group.decoded = false;
+
+  for (size_t ind = 0; ind < points.Size(); ind++) {
+    Vector<size_t> *entries = m_lazy_table->Lookup(points[ind], true);
+    Assert(entries->Empty());
+    entries->PushBack(m_lazy_groups->Size());
+  }
+
+  m_lazy_groups->PushBack(group);
+  m_lazy_data->Append(data, length);
+}
+
+void BlockMemory::DecodePoint(PPoint point) const
+{
+  if (!m_lazy_table)
+    return;
+
+  Vector<size_t> *entries = m_lazy_table->Lookup(point, false);
+  if (!entries)
+    return;
+
+  LazyGroup &group = m_lazy_groups->At(entries->At(0));
+  if (group.decoded)
+    return;
+  group.decoded = true;
+
+  Buffer read_buf(m_lazy_data->base + group.offset, group.length);
+  while (read_buf.pos != read_buf.base + read_buf.size)
+    Try(ReadValueEntry(&read_buf));
+}
+
+void BlockMemory::CheckOutgoingEdges(PEdgeList outgoing)
 {
   // can't have more than two outgoing edges.
   Assert(outgoing.Size() <= 2);
 
   // except for skips, it's always fine to have one outgoing edge.
-  if (outgoing.Size() == 1) {
-    PEdge *edge = outgoing[0];
-    Assert(!edge->IsSkip());
-  }
+  if (outgoing.Size() == 1)
+    Assert(outgoing.Kind(0) != EGK_Skip);
 
   // can only have two outgoing edges if they are negated assumes.
   if (outgoing.Size() == 2) {
@@ -2133,7 +2266,7 @@ void BlockMemory::ComputeGuard(PPoint point)
     // the guard is the disjunction of the transfer condition over each
     // incoming edge.
 
-    const Vector<PEdge*> &incoming = m_cfg->GetIncomingEdges(point);
+    PEdgeList incoming = m_cfg->GetIncomingEdges(point);
     Assert(!incoming.Empty());
 
     for (size_t iind = 0; iind < incoming.Size(); iind++) {
@@ -2142,6 +2275,15 @@ void BlockMemory::ComputeGuard(PPoint point)
 
       if (guard_bit != NULL) {
         guard_bit = Bit::MakeOr(guard_bit, source_transfer);
+
+        // distributing the disjunctions and conjunctions from different
+        // paths can duplicate subformulas, so try to shrink large guards
+        // before adding more disjuncts. Bits are already hash consed so
+        // structural hashing alone does not shrink them, this is only worth
+        // its cost when the solver is used to merge equivalent subformulas.
+        if (guard_sweep.IsSpecified() &&
+            guard_bit->Size() >= GUARD_COMPACT_CUTOFF)
+          guard_bit = BitAig::Compact(guard_bit);
       }
       else {
         guard_bit = source_transfer;
@@ -2425,7 +2567,7 @@ void BlockMemory::TransferEntryDrf(Exp *lval, GuardExpVector *res)
 void BlockMemory::TransferEdgeDrf(Exp *lval, PEdge *edge, GuardExpVector *res)
 {
   PPoint source = edge->GetSource();
-  Vector<GuardAssign> *assigns = m_assign_table->Lookup(source, false);
+  const Vector<GuardAssign> *assigns = GetAssigns(source);
 
   if (!assigns)
     return;
@@ -2473,7 +2615,7 @@ void BlockMemory::TransferEdgeTerminate(Exp *lval, ExpTerminate *kind,
   // be max(old_position, i).
 
   PPoint point = edge->GetSource();
-  Vector<GuardAssign> *assigns = m_assign_table->Lookup(point, false);
+  const Vector<GuardAssign> *assigns = GetAssigns(point);
 
   size_t assign_count = assigns ? assigns->Size() : 0;
 
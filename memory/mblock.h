@@ -28,6 +28,9 @@
 
 NAMESPACE_XGILL_BEGIN
 
+// whether to use the solver when compacting large guards.
+extern ConfigOption guard_sweep;
+
 // ways in which an exp/bit can be translated.
 enum TranslateKind {
   // convert value relative to point.
@@ -263,6 +266,7 @@ class GuardVector
   // add all entries from vector to this guarded vector.
   void FillFromVector(const Vector<T> &ovec)
   {
+    m_vector.Reserve(Size() + ovec.Size());
     for (size_t ind = 0; ind < ovec.Size(); ind++)
       PushBack(ovec[ind]);
   }
@@ -270,6 +274,7 @@ class GuardVector
   // add all entries from this guarded vector to the specified vector.
   void FillVector(Vector<T> *ovec)
   {
+    ovec->Reserve(ovec->Size() + Size());
     for (size_t ind = 0; ind < Size(); ind++)
       ovec->PushBack(m_vector[ind]);
   }
@@ -560,6 +565,22 @@ class BlockMemory : public HashObject
   // table of points for calls and loops which may GC.
   Vector<PPoint> *m_gc_table;
 
+  // encoded return/target/assign/argument/clobber entries which have been
+  // read in but are only decoded into the tables above when first accessed.
+  // the entries for runs of consecutive points are encoded together in
+  // groups. m_lazy_data holds the encoded groups, m_lazy_groups has the range
+  // of data for each group, and m_lazy_table maps each point with entries
+  // to the index of its group. these are NULL if no groups were read in.
+  struct LazyGroup {
+    size_t offset;
+    size_t length;
+    bool decoded;
+  };
+  typedef HashTable<PPoint,size_t,hash_PPoint> LazyTable;
+  Buffer *m_lazy_data;
+  Vector<LazyGroup> *m_lazy_groups;
+  LazyTable *m_lazy_table;
+
   // derived tables. these are memoization results computed on demand and
   // are thrown away when we are finished with the BlockMemory.
 
@@ -577,8 +598,21 @@ class BlockMemory : public HashObject
   // create and initialize all the persistent and derived tables.
   void MakeTables();
 
+  // remember an encoded group of entries for points which has been read in.
+  void AddLazyGroup(const Vector<PPoint> &points,
+                    const uint8_t *data, size_t length);
+
+  // decode the group of entries containing the specified point, if it has
+  // not been decoded already. this must be done before accessing the
+  // return/target/assign/argument/clobber tables for the point.
+  void DecodePoint(PPoint point) const;
+
+  // read a single return/target/assign/argument/clobber table entry
+  // from buf and add it to the persistent tables.
+  bool ReadValueEntry(Buffer *buf) const;
+
   // sanity check a list of outgoing edges
-  void CheckOutgoingEdges(const Vector<PEdge*> &outgoing);
+  void CheckOutgoingEdges(PEdgeList outgoing);
 
   // compute guard and edge persistent information
   void ComputeGuard(PPoint point);
@@ -18,8 +18,12 @@
 
 #include "baked.h"
 #include "mstorage.h"
+#include "serial.h"
 #include <imlang/storage.h>
+#include <imlang/serial.h>
 #include <backend/backend_block.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 NAMESPACE_XGILL_BEGIN
 
@@ -145,7 +149,8 @@ class ExternalLookup_BlockMemory : public Cache_BlockMemory::ExternalLookup
 };
 
 ExternalLookup_BlockMemory lookup_BlockMemory;
-Cache_BlockMemory BlockMemoryCache(&lookup_BlockMemory, CAP_BLOCK_MEMORY);
+Cache_BlockMemory BlockMemoryCache("BlockMemory",
+                                   &lookup_BlockMemory, CAP_BLOCK_MEMORY);
 
 void BlockMemoryCacheAddList(const Vector<BlockMemory*> &mcfgs)
 {
@@ -226,7 +231,8 @@ class ExternalLookup_BlockModset : public Cache_BlockModset::ExternalLookup
 };
 
 ExternalLookup_BlockModset lookup_BlockModset;
-Cache_BlockModset BlockModsetCache(&lookup_BlockModset, CAP_BLOCK_MODSET);
+Cache_BlockModset BlockModsetCache("BlockModset",
+                                   &lookup_BlockModset, CAP_BLOCK_MODSET);
 
 void BlockModsetCacheAddList(const Vector<BlockModset*> &mods)
 {
@@ -305,7 +311,8 @@ class ExternalLookup_BlockSummary : public Cache_BlockSummary::ExternalLookup
 };
 
 ExternalLookup_BlockSummary lookup_BlockSummary;
-Cache_BlockSummary BlockSummaryCache(&lookup_BlockSummary, CAP_BLOCK_SUMMARY);
+Cache_BlockSummary BlockSummaryCache("BlockSummary",
+                                     &lookup_BlockSummary, CAP_BLOCK_SUMMARY);
 
 void BlockSummaryCacheAddList(const Vector<BlockSummary*> &sums)
 {
@@ -325,6 +332,86 @@ BlockSummary* GetBlockSummary(BlockId *id)
   return sum;
 }
 
+void PrefetchBlockData(const Vector<BlockId*> &ids)
+{
+  // lookups are done directly when there is no backend to batch them.
+  if (TransactionBackend::HasFinishedBackends())
+    return;
+
+  Transaction *t = new Transaction();
+
+  // variables for the lookups in each database, zero if not needed.
+  Vector<size_t> body_results;
+  Vector<size_t> memory_results;
+  Vector<size_t> summary_results;
+  bool any_lookups = false;
+
+  for (size_t ind = 0; ind < ids.Size(); ind++) {
+    BlockId *id = ids[ind];
+    Assert(id->Kind() == B_Function);
+
+    size_t body_res = 0;
+    size_t memory_res = 0;
+    size_t summary_res = 0;
+
+    if (!BlockCFGCache.IsMember(id)) {
+      body_res = t->MakeVariable(true);
+      TOperand *key_arg = new TOperandString(t, id->Function()->Value());
+      t->PushAction(Backend::XdbLookup(t, BODY_DATABASE, key_arg, body_res));
+    }
+
+    if (!BlockMemoryCache.IsMember(id)) {
+      memory_res = t->MakeVariable(true);
+      TOperand *key_arg = new TOperandString(t, id->Function()->Value());
+      t->PushAction(Backend::XdbLookup(t, MEMORY_DATABASE,
+                                       key_arg, memory_res));
+    }
+
+    if (!BlockSummaryCache.IsMember(id)) {
+      summary_res = t->MakeVariable(true);
+      TOperand *key_arg = new TOperandString(t, id->Function()->Value());
+      t->PushAction(Backend::XdbLookup(t, SUMMARY_DATABASE,
+                                       key_arg, summary_res));
+    }
+
+    if (body_res || memory_res || summary_res)
+      any_lookups = true;
+
+    body_results.PushBack(body_res);
+    memory_results.PushBack(memory_res);
+    summary_results.PushBack(summary_res);
+  }
+
+  if (!any_lookups) {
+    delete t;
+    return;
+  }
+
+  SubmitTransaction(t);
+
+  for (size_t ind = 0; ind < ids.Size(); ind++) {
+    if (body_results[ind]) {
+      Vector<BlockCFG*> cfgs;
+      BlockCFGUncompress(t, body_results[ind], &cfgs);
+      BlockCFGCacheAddListWithRefs(cfgs);
+    }
+
+    if (memory_results[ind]) {
+      Vector<BlockMemory*> mcfgs;
+      BlockMemoryUncompress(t, memory_results[ind], &mcfgs);
+      BlockMemoryCacheAddList(mcfgs);
+    }
+
+    if (summary_results[ind]) {
+      Vector<BlockSummary*> sums;
+      BlockSummaryUncompress(t, t->LookupString(summary_results[ind]), &sums);
+      BlockSummaryCacheAddList(sums);
+    }
+  }
+
+  delete t;
+}
+
 /////////////////////////////////////////////////////////////////////
 // EscapeEdge lookup
 /////////////////////////////////////////////////////////////////////
@@ -377,12 +464,12 @@ class ExternalLookup_EscapeEdge
 ExternalLookup_EscapeEdge
   lookup_EscapeForward(ESCAPE_EDGE_FORWARD_DATABASE);
 Cache_EscapeEdgeSet
-EscapeForwardCache(&lookup_EscapeForward, CAP_ESCAPE_EDGE);
+EscapeForwardCache("EscapeForward", &lookup_EscapeForward, CAP_ESCAPE_EDGE);
 
 ExternalLookup_EscapeEdge
   lookup_EscapeBackward(ESCAPE_EDGE_BACKWARD_DATABASE);
 Cache_EscapeEdgeSet
-EscapeBackwardCache(&lookup_EscapeBackward, CAP_ESCAPE_EDGE);
+EscapeBackwardCache("EscapeBackward", &lookup_EscapeBackward, CAP_ESCAPE_EDGE);
 
 HashTable<Trace*,EscapeEdgeSet*,Trace> g_pending_escape_forward;
 HashTable<Trace*,EscapeEdgeSet*,Trace> g_pending_escape_backward;
@@ -433,7 +520,7 @@ class ExternalLookup_EscapeAccess
 
 ExternalLookup_EscapeAccess lookup_EscapeAccess;
 Cache_EscapeAccessSet
-EscapeAccessCache(&lookup_EscapeAccess, CAP_ESCAPE_ACCESS);
+EscapeAccessCache("EscapeAccess", &lookup_EscapeAccess, CAP_ESCAPE_ACCESS);
 
 HashTable<Trace*,EscapeAccessSet*,Trace> g_pending_escape_accesses;
 
@@ -470,14 +557,338 @@ class ExternalLookup_CallEdge : public Cache_CallEdgeSet::ExternalLookup
 };
 
 ExternalLookup_CallEdge lookup_Caller(CALLER_DATABASE);
-Cache_CallEdgeSet CallerCache(&lookup_Caller, CAP_CALLGRAPH);
+Cache_CallEdgeSet CallerCache("Caller", &lookup_Caller, CAP_CALLGRAPH);
 
 ExternalLookup_CallEdge lookup_Callee(CALLEE_DATABASE);
-Cache_CallEdgeSet CalleeCache(&lookup_Callee, CAP_CALLGRAPH);
+Cache_CallEdgeSet CalleeCache("Callee", &lookup_Callee, CAP_CALLGRAPH);
 
 HashTable<Variable*,CallEdgeSet*,Variable> g_pending_callees;
 HashTable<Variable*,CallEdgeSet*,Variable> g_pending_callers;
 
+/////////////////////////////////////////////////////////////////////
+// Cache snapshots
+/////////////////////////////////////////////////////////////////////
+
+ConfigOption cache_snapshot(CK_String, "cache-snapshot", "",
+  "file to preload caches from at startup and periodically save them to");
+
+// number of calls to UpdateCacheSnapshot between saves.
+#define SNAPSHOT_FREQUENCY 100
+
+// databases which the entries in a snapshot are read from. summaries are
+// only included in snapshots for passes which do not write them.
+static const char *snapshot_databases[] = {
+  MODSET_DATABASE, CALLEE_DATABASE, COMP_DATABASE, SUMMARY_DATABASE
+};
+
+#define SNAPSHOT_DATABASE_COUNT \
+  (sizeof(snapshot_databases) / sizeof(const char*))
+
+// whether entries read from a database are included in a snapshot.
+static bool SnapshotUsesDatabase(const char *database, bool summaries)
+{
+  if (!summaries && !strcmp(database, SUMMARY_DATABASE))
+    return false;
+
+  for (size_t ind = 0; ind < SNAPSHOT_DATABASE_COUNT; ind++) {
+    if (!strcmp(database, snapshot_databases[ind]))
+      return true;
+  }
+  return false;
+}
+
+// get the current size and modification time of a database,
+// using zeroes for databases which have not been created yet.
+static void GetDatabaseStamp(const char *database,
+                             uint64_t *psize, uint64_t *pmtime)
+{
+  *psize = 0;
+  *pmtime = 0;
+
+  struct stat info;
+  if (stat(database, &info) == 0) {
+    *psize = info.st_size;
+    *pmtime = info.st_mtime;
+  }
+}
+
+// write the stamp identifying the contents of the databases a snapshot
+// is being taken from. entries in a snapshot may be stale, or hide data
+// which has since been added, if any of these databases has changed.
+static void WriteSnapshotStamp(Buffer *buf, bool summaries)
+{
+  WriteOpenTag(buf, TAG_SnapshotStamp);
+
+  for (size_t ind = 0; ind < SNAPSHOT_DATABASE_COUNT; ind++) {
+    const char *database = snapshot_databases[ind];
+    if (!SnapshotUsesDatabase(database, summaries))
+      continue;
+
+    uint64_t size, mtime;
+    GetDatabaseStamp(database, &size, &mtime);
+
+    WriteTagString(buf, TAG_Name, (const uint8_t*) database,
+                   strlen(database) + 1);
+    WriteUInt64(buf, size);
+    WriteUInt64(buf, mtime);
+  }
+
+  WriteCloseTag(buf, TAG_SnapshotStamp);
+}
+
+// read the stamp at the start of a snapshot, returning whether it matches
+// the current contents of every database the snapshot's entries use.
+static bool ReadSnapshotStamp(Buffer *buf, bool summaries)
+{
+  if (!ReadOpenTag(buf, TAG_SnapshotStamp))
+    return false;
+
+  size_t count = 0;
+  while (!ReadCloseTag(buf, TAG_SnapshotStamp)) {
+    const uint8_t *name;
+    size_t name_length;
+    uint64_t size, mtime;
+
+    if (!ReadTagString(buf, TAG_Name, &name, &name_length) ||
+        !ValidString(name, name_length) ||
+        !ReadUInt64(buf, &size) ||
+        !ReadUInt64(buf, &mtime))
+      return false;
+
+    const char *database = (const char*) name;
+    if (!SnapshotUsesDatabase(database, summaries))
+      return false;
+
+    uint64_t cur_size, cur_mtime;
+    GetDatabaseStamp(database, &cur_size, &cur_mtime);
+    if (size != cur_size || mtime != cur_mtime)
+      return false;
+
+    count++;
+  }
+
+  size_t expected = 0;
+  for (size_t ind = 0; ind < SNAPSHOT_DATABASE_COUNT; ind++) {
+    if (SnapshotUsesDatabase(snapshot_databases[ind], summaries))
+      expected++;
+  }
+
+  return count == expected;
+}
+
+// whether tag is for one of the entries which follow a snapshot's stamp.
+static bool IsSnapshotEntry(tag_t tag)
+{
+  switch (tag) {
+  case TAG_BlockModset:
+  case TAG_BlockSummary:
+  case TAG_CallEdgeSet:
+  case TAG_CompositeCSU:
+  case TAG_SnapshotMissingCallees:
+  case TAG_SnapshotMissingCSU:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void LoadCacheSnapshot(bool summaries)
+{
+  if (!cache_snapshot.IsSpecified())
+    return;
+
+  static BaseTimer load_timer("cache_snapshot_load");
+  Timer _timer(&load_timer);
+
+  Buffer file_buf;
+  {
+    FileInStream file_in(cache_snapshot.StringValue());
+    if (file_in.IsError())
+      return;
+    ReadInStream(file_in, &file_buf);
+  }
+
+  // snapshots only hold cached data, so if anything is wrong with the
+  // snapshot we start out with empty caches instead of failing.
+
+  // ReadInStream may have added a terminator, which is ignored by
+  // TryUncompressBuffer.
+  Buffer compress_buf(file_buf.base, file_buf.pos - file_buf.base);
+  Buffer data_buf;
+  if (!TryUncompressBuffer(&compress_buf, &data_buf)) {
+    logout << "WARNING: Malformed cache snapshot, ignoring" << endl;
+    return;
+  }
+
+  Buffer read_buf(data_buf.base, data_buf.pos - data_buf.base);
+  uint8_t *end = read_buf.base + read_buf.size;
+
+  if (!ReadSnapshotStamp(&read_buf, summaries)) {
+    logout << "WARNING: Cache snapshot does not match databases, ignoring"
+           << endl;
+    return;
+  }
+
+  // make sure every entry is complete and of a known kind before adding
+  // any of them to the caches.
+  uint8_t *entries = read_buf.pos;
+  while (read_buf.pos != end) {
+    if (!IsSnapshotEntry(PeekOpenTag(&read_buf)) || !SkipTag(&read_buf)) {
+      logout << "WARNING: Malformed cache snapshot, ignoring" << endl;
+      return;
+    }
+  }
+  read_buf.pos = entries;
+
+  size_t count = 0;
+
+  while (read_buf.pos != end) {
+    switch (PeekOpenTag(&read_buf)) {
+    case TAG_BlockModset: {
+      BlockModset *bmod;
+      Try(bmod = BlockModset::Read(&read_buf));
+      BlockModsetCache.Insert(bmod->GetId(), bmod);
+      break;
+    }
+    case TAG_BlockSummary: {
+      BlockSummary *sum;
+      Try(sum = BlockSummary::Read(&read_buf));
+      if (summaries)
+        BlockSummaryCache.Insert(sum->GetId(), sum);
+      break;
+    }
+    case TAG_CallEdgeSet: {
+      CallEdgeSet *cset;
+      Try(cset = CallEdgeSet::Read(&read_buf));
+      CalleeCache.Insert(cset->GetFunction(), cset);
+      break;
+    }
+    case TAG_CompositeCSU: {
+      CompositeCSU *csu;
+      Try(csu = CompositeCSU::Read(&read_buf));
+      CompositeCSUCache.Insert(csu->GetName(), csu);
+      break;
+    }
+    case TAG_SnapshotMissingCallees: {
+      Variable *function;
+      Try(ReadOpenTag(&read_buf, TAG_SnapshotMissingCallees));
+      Try(function = Variable::Read(&read_buf));
+      Try(ReadCloseTag(&read_buf, TAG_SnapshotMissingCallees));
+      CalleeCache.Insert(function, NULL);
+      break;
+    }
+    case TAG_SnapshotMissingCSU: {
+      String *name;
+      Try(ReadOpenTag(&read_buf, TAG_SnapshotMissingCSU));
+      Try(name = String::ReadWithTag(&read_buf, TAG_Name));
+      Try(ReadCloseTag(&read_buf, TAG_SnapshotMissingCSU));
+      CompositeCSUCache.Insert(name, NULL);
+      break;
+    }
+    default:
+      Assert(false);
+    }
+
+    count++;
+  }
+
+  logout << "Loaded " << count << " cache entries from snapshot" << endl;
+}
+
+void SaveCacheSnapshot(bool summaries)
+{
+  if (!cache_snapshot.IsSpecified())
+    return;
+
+  static BaseTimer save_timer("cache_snapshot_save");
+  Timer _timer(&save_timer);
+
+  // all entries are written to a single buffer, so that objects shared
+  // between them are only written once.
+  Buffer data_buf;
+  WriteSnapshotStamp(&data_buf, summaries);
+
+  {
+    Vector<BlockId*> ids;
+    Vector<BlockModset*> mods;
+    BlockModsetCache.GetEntries(&ids, &mods);
+    for (size_t ind = 0; ind < mods.Size(); ind++)
+      BlockModset::Write(&data_buf, mods[ind]);
+  }
+
+  if (summaries) {
+    Vector<BlockId*> ids;
+    Vector<BlockSummary*> sums;
+    BlockSummaryCache.GetEntries(&ids, &sums);
+    for (size_t ind = 0; ind < sums.Size(); ind++)
+      BlockSummary::Write(&data_buf, sums[ind]);
+  }
+
+  {
+    Vector<Variable*> functions;
+    Vector<CallEdgeSet*> csets;
+    CalleeCache.GetEntries(&functions, &csets);
+    for (size_t ind = 0; ind < csets.Size(); ind++) {
+      if (csets[ind]) {
+        CallEdgeSet::Write(&data_buf, csets[ind]);
+      }
+      else {
+        WriteOpenTag(&data_buf, TAG_SnapshotMissingCallees);
+        Variable::Write(&data_buf, functions[ind]);
+        WriteCloseTag(&data_buf, TAG_SnapshotMissingCallees);
+      }
+    }
+  }
+
+  {
+    Vector<String*> names;
+    Vector<CompositeCSU*> csus;
+    CompositeCSUCache.GetEntries(&names, &csus);
+    for (size_t ind = 0; ind < csus.Size(); ind++) {
+      if (csus[ind]) {
+        CompositeCSU::Write(&data_buf, csus[ind]);
+      }
+      else {
+        WriteOpenTag(&data_buf, TAG_SnapshotMissingCSU);
+        String::WriteWithTag(&data_buf, names[ind], TAG_Name);
+        WriteCloseTag(&data_buf, TAG_SnapshotMissingCSU);
+      }
+    }
+  }
+
+  Buffer compress_buf;
+  CompressBufferInUse(&data_buf, &compress_buf);
+
+  // write to a file specific to this process and rename it over the
+  // snapshot, so that readers never see a partially written snapshot.
+  const char *file = cache_snapshot.StringValue();
+
+  Buffer name_buf;
+  BufferOutStream name_out(&name_buf);
+  name_out << file << "." << (long) getpid() << '\0';
+  const char *temp_file = (const char*) name_buf.base;
+
+  bool success;
+  {
+    FileOutStream file_out(temp_file);
+    success = !file_out.IsError();
+    if (success)
+      file_out.Put(compress_buf.base, compress_buf.pos - compress_buf.base);
+  }
+
+  if (!success || rename(temp_file, file) != 0) {
+    logout << "WARNING: Could not write cache snapshot: " << file << endl;
+    unlink(temp_file);
+  }
+}
+
+void UpdateCacheSnapshot(bool summaries)
+{
+  static size_t update_count = 0;
+  if (++update_count % SNAPSHOT_FREQUENCY == 0)
+    SaveCacheSnapshot(summaries);
+}
+
 /////////////////////////////////////////////////////////////////////
 // Memory data compression
 /////////////////////////////////////////////////////////////////////
@@ -46,6 +46,10 @@ NAMESPACE_XGILL_BEGIN
 // name of database storing per-function modset information.
 #define MODSET_DATABASE "body_modset.xdb"
 
+// name of database storing, for each function, the content hashes of the
+// callee modsets which were used when computing its memory and modset.
+#define MODSET_DEPENDENCY_DATABASE "body_modset_dep.xdb"
+
 // name of database storing per-function analysis summaries.
 #define SUMMARY_DATABASE "body_summary.xdb"
 
@@ -74,6 +78,11 @@ BlockMemory* GetBlockMemory(BlockId *id);
 BlockModset* GetBlockModset(BlockId *id);
 BlockSummary* GetBlockSummary(BlockId *id);
 
+// fetch the CFGs, memory and summaries for each of the function IDs in ids
+// which are not already cached, using a single transaction. this is a hint;
+// data which is missing from the databases is left for a later lookup.
+void PrefetchBlockData(const Vector<BlockId*> &ids);
+
 // escape information caches.
 
 // get the key in an escape edge or access database which stores data for lt.
@@ -100,6 +109,28 @@ extern HashTable<Variable*,CallEdgeSet*,Variable> g_pending_callers;
 // write out any pending escape/callgraph data.
 void WritePendingEscape();
 
+// warm start cache snapshots. a snapshot holds the current entries of the
+// modset, summary, callee and CSU caches, so that new worker processes can
+// preload the entries they are likely to need rather than fetching them all
+// from the manager. snapshots are only valid while the databases they were
+// taken from are not changing, so summaries should not be included while
+// they are still being generated.
+
+// file to load a snapshot from on startup and periodically save it to.
+extern ConfigOption cache_snapshot;
+
+// load the caches from the snapshot file, if it has been specified and
+// exists. summaries indicates whether to load the summary cache.
+void LoadCacheSnapshot(bool summaries);
+
+// save the contents of the caches to the snapshot file, if it has been
+// specified. the file is replaced atomically, so that workers can load it
+// while other workers are saving it.
+void SaveCacheSnapshot(bool summaries);
+
+// call after each unit of work. saves the snapshot file periodically.
+void UpdateCacheSnapshot(bool summaries);
+
 // memory cache utility.
 
 // read/write lists of compressed memory info in transaction operations.
@@ -82,12 +82,11 @@
 //   TAG_MemoryClobber
 //   list of TAG_MemoryGuardEntry
 //   list of TAG_MemoryEdgeCondEntry
-//   list of TAG_MemoryReturnEntry
-//   list of TAG_MemoryTargetEntry
-//   list of TAG_MemoryAssignEntry
-//   list of TAG_MemoryArgumentEntry
-//   list of TAG_MemoryClobberEntry
+//   list of TAG_MemoryEntryGroup
 //   list of TAG_MemoryGCEntry
+// older data may have lists of TAG_MemoryReturnEntry, TAG_MemoryTargetEntry,
+// TAG_MemoryAssignEntry, TAG_MemoryArgumentEntry and TAG_MemoryClobberEntry
+// in place of the TAG_MemoryEntryGroup list.
 #define TAG_BlockMemory  3100
 
 // children: TAG_UInt32
@@ -126,6 +125,15 @@
 #define TAG_MemoryArgumentEntry  3130
 #define TAG_MemoryClobberEntry  3132
 
+// children:
+//   list of TAG_Index
+//   TAG_String
+// the string holds an independently encoded buffer with all the
+// TAG_MemoryReturnEntry, TAG_MemoryTargetEntry, TAG_MemoryAssignEntry,
+// TAG_MemoryArgumentEntry and TAG_MemoryClobberEntry for the listed points.
+// this is decoded the first time the entries for any of the points are used.
+#define TAG_MemoryEntryGroup  3134
+
 ///////////////////////////////
 // BlockModset
 ///////////////////////////////
@@ -168,3 +176,25 @@
 // children:
 //   TAG_Bit
 #define TAG_SummaryAssume  3516
+
+///////////////////////////////
+// Cache snapshots
+///////////////////////////////
+
+// a cache snapshot is a TAG_SnapshotStamp followed by a sequence of
+// TAG_BlockModset, TAG_BlockSummary, TAG_CallEdgeSet and TAG_CompositeCSU
+// entries, along with the tags below for cache entries which do not have
+// any data.
+
+// children:
+//   TAG_Variable
+#define TAG_SnapshotMissingCallees  3600
+
+// children:
+//   TAG_Name
+#define TAG_SnapshotMissingCSU  3602
+
+// children:
+//   for each database the cached entries were read from:
+//     TAG_Name TAG_UInt64 TAG_UInt64  (name, file size, modification time)
+#define TAG_SnapshotStamp  3604
@@ -486,13 +486,8 @@ class ConstraintListenerLvalue : public ConstraintListener
       String *csu_name = field->GetCSUType()->GetCSUName();
       CompositeCSU *csu = CompositeCSUCache.Lookup(csu_name);
 
-      for (size_t find = 0; find < csu->GetFieldCount(); find++) {
-        const DataField &df = csu->GetField(find);
-        if (df.field == field) {
-          offset += df.offset;
-          break;
-        }
-      }
+      if (const DataField *df = csu->FindField(field))
+        offset += df->offset;
 
       CompositeCSUCache.Release(csu_name);
     }
@@ -286,13 +286,11 @@ void SolverCVC3::GetAssignment(SolverDeclTable &decl_table,
       continue;
     }
 
-    Vector<mpz_value> *values = assign.Lookup(*pinfo, true);
-    Assert(values->Empty());
+    Assert(!assign.Lookup(*pinfo));
+    mpz_value *value = assign.Lookup(*pinfo, true);
+    mpz_init(value->n);
 
-    values->PushBack(mpz_value());
-    mpz_init(values->At(0).n);
-
-    Try(StringToInt(val_str, values->At(0).n));
+    Try(StringToInt(val_str, value->n));
   }
 
   CVC_Pop(m_vc);
@@ -317,13 +317,13 @@ void SolverYices::GetAssignment(SolverDeclTable &decl_table,
       lbool val = wrap_yices_get_value(model, decl);
 
       if (val != l_undef) {
-        Vector<mpz_value> *values = assign.Lookup(FrameExp(frame, exp), true);
-        Assert(values->Empty());
+        FrameExp info(frame, exp);
+        Assert(!assign.Lookup(info));
 
-        values->PushBack(mpz_value());
-        mpz_init(values->At(0).n);
+        mpz_value *value = assign.Lookup(info, true);
+        mpz_init(value->n);
 
-        mpz_set_si(values->At(0).n, (val == l_true) ? 1 : 0);
+        mpz_set_si(value->n, (val == l_true) ? 1 : 0);
       }
     }
     else {
@@ -336,13 +336,13 @@ void SolverYices::GetAssignment(SolverDeclTable &decl_table,
         mpz_clear(res);
       }
       else {
-        Vector<mpz_value> *values = assign.Lookup(FrameExp(frame, exp), true);
-        Assert(values->Empty());
+        FrameExp info(frame, exp);
+        Assert(!assign.Lookup(info));
 
-        values->PushBack(mpz_value());
-        mpz_init(values->At(0).n);
+        mpz_value *value = assign.Lookup(info, true);
+        mpz_init(value->n);
 
-        mpz_set(values->At(0).n, res);
+        mpz_set(value->n, res);
         mpz_clear(res);
       }
     }
@@ -1282,7 +1282,7 @@ PEdge* Solver::AsnEdgeTaken(FrameId frame, PPoint point, bool required)
   BlockCFG *cfg = mcfg->GetCFG();
   Assert(cfg);
 
-  const Vector<PEdge*> &edges = cfg->GetOutgoingEdges(point);
+  PEdgeList edges = cfg->GetOutgoingEdges(point);
   if (edges.Empty()) {
     Assert(!required);
     return NULL;
@@ -1455,11 +1455,10 @@ bool Solver::AsnExpValue(FrameId frame, Exp *exp, mpz_t res)
     Assert(*pdecl);
 
     FrameExp info(frame, exp);
-    Vector<mpz_value> *values = m_assign.Lookup(info);
+    mpz_value *value = m_assign.Lookup(info);
 
-    if (values) {
-      Assert(values->Size() == 1);
-      mpz_set(res, values->At(0).n);
+    if (value) {
+      mpz_set(res, value->n);
       return true;
     }
     return false;
@@ -82,7 +82,7 @@ class Solver;
 
 // type of a solver assignment, mapping Frame/Exp pairs to the value
 // assigned to them.
-typedef HashTable<FrameExp,mpz_value,FrameExp> SolverAssignment;
+typedef FlatHashTable<FrameExp,mpz_value,FrameExp> SolverAssignment;
 
 typedef SolverHashTable<Exp,SlvDecl> SolverDeclTable;
 typedef SolverHashTable<Exp,SlvExpr> SolverExpTable;
@@ -19,15 +19,23 @@
 #include "alloc.h"
 #include "list.h"
 
+#include <signal.h>
+
+#ifdef USE_COUNT_ALLOCATOR
+#include <execinfo.h>
+#endif
+
 size_t g_alloc_total;
+size_t g_alloc_peak;
 TrackAlloc *g_alloc_list;
 
 void ResetAllocs()
 {
   g_alloc_total = 0;
+  g_alloc_peak = 0;
   TrackAlloc *t = g_alloc_list;
   while (t != NULL) {
-    t->alloc_total = 0;
+    t->Reset();
     t = t->next;
   }
 }
@@ -96,6 +104,14 @@ TrackAlloc::TrackAlloc(const char *_name)
   *pprev = this;
 }
 
+void TrackAlloc::Reset()
+{
+  alloc_total = 0;
+  alloc_peak = 0;
+  alloc_count = 0;
+  memset(histogram, 0, sizeof(histogram));
+}
+
 TrackAlloc& LookupAlloc(const char *name)
 {
   InitializeAllocList();
@@ -109,10 +125,351 @@ TrackAlloc& LookupAlloc(const char *name)
   }
 
   // make a new allocator. its constructor will thread it onto g_alloc_list.
+  // unlike the static allocators its counters start out as garbage.
   alloc = new TrackAlloc(name);
+  alloc->Reset();
   return *alloc;
 }
 
 TrackAlloc g_alloc_Vector("Vector");
 TrackAlloc g_alloc_HashCache("HashCache");
 TrackAlloc g_alloc_HashTable("HashTable");
+
+/////////////////////////////////////////////////////////////////////
+// Allocation profiling
+/////////////////////////////////////////////////////////////////////
+
+// set by the SIGUSR1 handler to indicate the profile should be printed.
+static volatile sig_atomic_t alloc_profile_pending = 0;
+
+void CheckAllocProfile()
+{
+  if (alloc_profile_pending) {
+    alloc_profile_pending = 0;
+    PrintAllocProfile();
+  }
+}
+
+#ifdef USE_COUNT_ALLOCATOR
+
+static void alloc_profile_handler(int signal)
+{
+  alloc_profile_pending = 1;
+}
+
+// space reserved before each allocation. this holds the size and allocator
+// of the allocation, and is large enough to preserve the alignment
+// guarantees of malloc.
+#define ALLOC_HEADER_SIZE 16
+
+struct AllocHeader
+{
+  size_t size;
+  TrackAlloc *alloc;
+};
+
+// maximum number of distinct stacks to record, and frames in each stack.
+#define ALLOC_SAMPLE_COUNT 1024
+#define ALLOC_SAMPLE_DEPTH 12
+
+// number of sampled stacks to print in the profile.
+#define ALLOC_SAMPLE_PRINT 25
+
+struct AllocSample
+{
+  TrackAlloc *alloc;
+  void *frames[ALLOC_SAMPLE_DEPTH];
+  int depth;
+
+  // number of times this stack was sampled, and bytes allocated
+  // by those samples.
+  size_t count;
+  size_t bytes;
+};
+
+TrackAlloc *g_alloc_pending;
+
+// allocations performed by the global new which were not charged
+// to any other allocator.
+static TrackAlloc alloc_untracked("<untracked>");
+
+// open-addressed table of sampled stacks.
+static AllocSample alloc_samples[ALLOC_SAMPLE_COUNT];
+static size_t alloc_sample_used = 0;
+
+// samples which were dropped because the table was full.
+static size_t alloc_sample_dropped = 0;
+
+// take a sample every alloc_sample_rate allocations, 0 for no sampling.
+static size_t alloc_sample_rate = 0;
+static size_t alloc_sample_countdown = 0;
+
+// whether we are in the middle of taking a sample. backtrace() may
+// allocate memory the first time it is called.
+static bool alloc_sampling = false;
+
+void PrepareAllocProfile(size_t sample_rate)
+{
+  alloc_sample_rate = sample_rate;
+  alloc_sample_countdown = sample_rate;
+  signal(SIGUSR1, alloc_profile_handler);
+}
+
+static inline size_t HistogramBucket(size_t size)
+{
+  size_t bucket = 0;
+  size_t limit = 8;
+  while (size > limit && bucket < ALLOC_HISTOGRAM_COUNT - 1) {
+    bucket++;
+    limit <<= 1;
+  }
+  return bucket;
+}
+
+static void TakeSample(TrackAlloc *alloc, size_t size)
+{
+  if (alloc_sampling)
+    return;
+  alloc_sampling = true;
+
+  void *frames[ALLOC_SAMPLE_DEPTH];
+  int depth = backtrace(frames, ALLOC_SAMPLE_DEPTH);
+
+  size_t hash = (size_t) alloc;
+  for (int ind = 0; ind < depth; ind++)
+    hash = (hash * 31) ^ (size_t) frames[ind];
+
+  size_t ind = hash % ALLOC_SAMPLE_COUNT;
+  for (size_t probe = 0; probe < ALLOC_SAMPLE_COUNT; probe++) {
+    AllocSample *sample = &alloc_samples[ind];
+
+    if (sample->count == 0) {
+      if (alloc_sample_used >= ALLOC_SAMPLE_COUNT / 2)
+        break;
+      alloc_sample_used++;
+
+      sample->alloc = alloc;
+      sample->depth = depth;
+      memcpy(sample->frames, frames, depth * sizeof(void*));
+    }
+
+    if (sample->alloc == alloc && sample->depth == depth &&
+        memcmp(sample->frames, frames, depth * sizeof(void*)) == 0) {
+      sample->count++;
+      sample->bytes += size;
+      alloc_sampling = false;
+      return;
+    }
+
+    ind = (ind + 1) % ALLOC_SAMPLE_COUNT;
+  }
+
+  alloc_sample_dropped++;
+  alloc_sampling = false;
+}
+
+// update a peak allocation total. totals are reset to zero by ResetAllocs()
+// while memory allocated earlier is still live, so freeing that memory can
+// wrap a total below zero; such totals are treated as negative.
+static inline void UpdatePeak(size_t total, size_t *ppeak)
+{
+  if ((ssize_t) total > (ssize_t) *ppeak)
+    *ppeak = total;
+}
+
+void* TrackAllocate(TrackAlloc *alloc, size_t size)
+{
+  if (alloc == NULL)
+    alloc = &alloc_untracked;
+
+  size_t nsize = size + ALLOC_HEADER_SIZE;
+  void *pbase = malloc(nsize);
+  if (pbase == NULL)
+    throw std::bad_alloc();
+
+  AllocHeader *header = (AllocHeader*) pbase;
+  header->size = nsize;
+  header->alloc = alloc;
+
+  g_alloc_total += nsize;
+  UpdatePeak(g_alloc_total, &g_alloc_peak);
+
+  alloc->alloc_total += nsize;
+  alloc->alloc_count++;
+  UpdatePeak(alloc->alloc_total, &alloc->alloc_peak);
+  alloc->histogram[HistogramBucket(size)]++;
+
+  if (alloc_sample_rate && --alloc_sample_countdown == 0) {
+    alloc_sample_countdown = alloc_sample_rate;
+    TakeSample(alloc, size);
+  }
+
+  return ((uint8_t*)pbase) + ALLOC_HEADER_SIZE;
+}
+
+void TrackFree(void *p)
+{
+  if (p) {
+    void *pbase = ((uint8_t*)p) - ALLOC_HEADER_SIZE;
+    AllocHeader *header = (AllocHeader*) pbase;
+
+    g_alloc_total -= header->size;
+    header->alloc->alloc_total -= header->size;
+    header->alloc->alloc_count--;
+
+    free(pbase);
+  }
+}
+
+// these replace the global operators for the entire program, so that
+// all memory we free was allocated with TrackAllocate. they can't be
+// defined inline in the header.
+
+void* operator new(size_t size)
+{
+  TrackAlloc *alloc = g_alloc_pending;
+  g_alloc_pending = NULL;
+  return TrackAllocate(alloc, size);
+}
+
+void* operator new[](size_t size)
+{
+  TrackAlloc *alloc = g_alloc_pending;
+  g_alloc_pending = NULL;
+  return TrackAllocate(alloc, size);
+}
+
+void operator delete(void *p) throw()
+{
+  TrackFree(p);
+}
+
+void operator delete[](void *p) throw()
+{
+  TrackFree(p);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+  TrackAlloc *alloc = g_alloc_pending;
+  g_alloc_pending = NULL;
+  try {
+    return TrackAllocate(alloc, size);
+  }
+  catch (std::bad_alloc&) {
+    return NULL;
+  }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p, const std::nothrow_t&) throw()
+{
+  TrackFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) throw()
+{
+  TrackFree(p);
+}
+
+static int CompareSamples(const void *v0, const void *v1)
+{
+  const AllocSample *s0 = *(const AllocSample**) v0;
+  const AllocSample *s1 = *(const AllocSample**) v1;
+  if (s0->bytes != s1->bytes)
+    return (s0->bytes > s1->bytes) ? -1 : 1;
+  return 0;
+}
+
+void PrintAllocProfile()
+{
+  logout << "Allocation profile: ";
+  PrintBytes(g_alloc_total);
+  logout << " live, ";
+  PrintBytes(g_alloc_peak);
+  logout << " peak" << endl;
+
+  TrackAlloc *t = g_alloc_list;
+  while (t != NULL) {
+    size_t total_count = 0;
+    for (size_t ind = 0; ind < ALLOC_HISTOGRAM_COUNT; ind++)
+      total_count += t->histogram[ind];
+
+    if (total_count != 0) {
+      logout << "  " << t->name << ": ";
+      PrintBytes(t->alloc_total);
+      logout << " live (" << t->alloc_count << " objects), ";
+      PrintBytes(t->alloc_peak);
+      logout << " peak, " << total_count << " allocations" << endl;
+
+      logout << "   ";
+      for (size_t ind = 0; ind < ALLOC_HISTOGRAM_COUNT; ind++) {
+        if (t->histogram[ind] == 0)
+          continue;
+        logout << " ";
+        if (ind == ALLOC_HISTOGRAM_COUNT - 1) {
+          logout << ">";
+          PrintBytes((size_t) 8 << (ind - 1));
+        }
+        else {
+          logout << "<=";
+          PrintBytes((size_t) 8 << ind);
+        }
+        logout << ": " << t->histogram[ind];
+      }
+      logout << endl;
+    }
+
+    t = t->next;
+  }
+
+  // collect and sort the sampled stacks by the number of bytes allocated.
+  AllocSample *samples[ALLOC_SAMPLE_COUNT];
+  size_t sample_count = 0;
+  for (size_t ind = 0; ind < ALLOC_SAMPLE_COUNT; ind++) {
+    if (alloc_samples[ind].count)
+      samples[sample_count++] = &alloc_samples[ind];
+  }
+
+  if (sample_count) {
+    qsort(samples, sample_count, sizeof(AllocSample*), CompareSamples);
+
+    logout << "Sampled stacks: " << sample_count;
+    if (alloc_sample_dropped)
+      logout << " (" << alloc_sample_dropped << " samples dropped)";
+    logout << endl;
+
+    for (size_t ind = 0; ind < sample_count && ind < ALLOC_SAMPLE_PRINT;
+         ind++) {
+      AllocSample *sample = samples[ind];
+      logout << "  " << sample->alloc->name << ": "
+             << sample->count << " samples, ";
+      PrintBytes(sample->bytes);
+      logout << endl;
+
+      // skip the frames for TakeSample and TrackAllocate.
+      char **symbols = backtrace_symbols(sample->frames, sample->depth);
+      for (int find = 2; find < sample->depth; find++)
+        logout << "    " << (symbols ? symbols[find] : "?") << endl;
+      free(symbols);
+    }
+  }
+
+  logout << endl << flush;
+}
+
+#else // USE_COUNT_ALLOCATOR
+
+void PrepareAllocProfile(size_t sample_rate)
+{
+}
+
+void PrintAllocProfile()
+{
+}
+
+#endif // USE_COUNT_ALLOCATOR
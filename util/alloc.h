@@ -24,18 +24,21 @@
 
 #include "stream.h"
 
-// use the custom allocator for counting allocations for release builds.
-// for debug builds we want valgrind to work without getting confused.
-// this is currently disabled as it does not work in all configurations. fix?
-//#ifndef DEBUG
+// use the custom allocator for counting allocations and profiling where
+// memory is going. this replaces the global new/delete operators and adds
+// a header to each allocation, so it is only turned on for builds made
+// with 'make alloc-profile'. debug builds should leave it off so that
+// valgrind does not get confused.
 //#define USE_COUNT_ALLOCATOR
-//#endif
 
 // total number of heap-allocated bytes. this is a delta from the
 // last time ResetAllocs() was called, so it could be negative
 // (which will be printed as a very large number).
 extern size_t g_alloc_total;
 
+// maximum value of g_alloc_total since the last call to ResetAllocs().
+extern size_t g_alloc_peak;
+
 // reset all allocation data to zero. before this is called, PrintAllocs()
 // will produce garbage. after this is called, PrintAllocs() shows an
 // allocation delta from the most recent call to ResetAllocs(). this is
@@ -47,13 +50,30 @@ void ResetAllocs();
 // print information about heap-allocated memory.
 void PrintAllocs();
 
+// number of buckets in the object size histogram for each allocator.
+// bucket N counts allocations of at most 2^(N+3) bytes, with the last
+// bucket counting everything larger.
+#define ALLOC_HISTOGRAM_COUNT 20
+
 struct TrackAlloc
 {
   const char *name;
+
+  // bytes currently allocated, maximum of this value since the last reset,
+  // and number of objects currently allocated.
   size_t alloc_total;
+  size_t alloc_peak;
+  size_t alloc_count;
+
+  // number of allocations performed in each size bucket.
+  size_t histogram[ALLOC_HISTOGRAM_COUNT];
+
   TrackAlloc *next;
 
   TrackAlloc(const char *_name);
+
+  // clear all the counters for this allocator.
+  void Reset();
 };
 
 // gets the allocator associated with the specified name, creating
@@ -61,51 +81,43 @@ struct TrackAlloc
 // with an allocator that is statically allocated (a global variable).
 TrackAlloc& LookupAlloc(const char *name);
 
-#ifdef USE_COUNT_ALLOCATOR
+// prepare for profiling allocations, if the counting allocator is in use.
+// the stack of every sample_rate'th allocation is recorded (0 for none),
+// and the profile will be printed whenever SIGUSR1 is received.
+void PrepareAllocProfile(size_t sample_rate);
 
-inline void* operator new(size_t size)
-{
-  size_t nsize = size + 4;
-  void *pbase = malloc(nsize);
-  *((uint32_t*)pbase) = nsize;
-  g_alloc_total += nsize;
-  return ((uint8_t*)pbase) + 4;
-}
+// print the profile of live/peak memory, object sizes and any sampled
+// allocation stacks for each allocator. does nothing if the counting
+// allocator is not in use.
+void PrintAllocProfile();
 
-inline void* operator new[](size_t size)
-{
-  size_t nsize = size + 4;
-  void *pbase = malloc(nsize);
-  *((uint32_t*)pbase) = nsize;
-  g_alloc_total += nsize;
-  return ((uint8_t*)pbase) + 4;
-}
+// print the allocation profile if SIGUSR1 has been received since the
+// last time it was printed. the signal handler can't print anything
+// itself, so this should be called periodically.
+void CheckAllocProfile();
 
-inline void operator delete(void *p)
-{
-  if (p) {
-    void *pbase = ((uint8_t*)p) - 4;
-    g_alloc_total -= *((uint32_t*)pbase);
-    free(pbase);
-  }
-}
+#ifdef USE_COUNT_ALLOCATOR
 
-inline void operator delete[](void *p)
-{
-  if (p) {
-    void *pbase = ((uint8_t*)p) - 4;
-    g_alloc_total -= *((uint32_t*)pbase);
-    free(pbase);
-  }
-}
+// allocator to charge the next call to the global operator new/new[].
+// this is consumed (reset to NULL) by that call, and is used to attribute
+// allocations made with new for track_new and track_new_single.
+extern TrackAlloc *g_alloc_pending;
+
+// allocate size bytes charged to alloc, which may be NULL. the allocator
+// is remembered in a header preceding the returned memory so that
+// TrackFree will charge the release to the same allocator.
+void* TrackAllocate(TrackAlloc *alloc, size_t size);
+
+// free memory allocated with TrackAllocate.
+void TrackFree(void *p);
 
 // replacement for new when allocating a single primitive data or
-// other object which should be tracked witha lloc.
+// other object which should be tracked with alloc.
 template <class T>
 inline T* track_new_single(TrackAlloc &alloc) {
+  g_alloc_pending = &alloc;
   T *res = new T();
-  void *pbase = ((uint8_t*)res) - 4;
-  alloc.alloc_total += *((uint32_t*)pbase);
+  g_alloc_pending = NULL;
   return res;
 }
 
@@ -113,68 +125,38 @@ inline T* track_new_single(TrackAlloc &alloc) {
 // with track_new_single.
 template <class T>
 inline void track_delete_single(TrackAlloc &alloc, T *val) {
-  if (val) {
-    void *pbase = ((uint8_t*)val) - 4;
-    alloc.alloc_total -= *((uint32_t*)pbase);
-    delete val;
-  }
+  delete val;
 }
 
 // replacement for new[] when allocating an array of primitive data
 // or other objects which should be tracked with alloc.
 template <class T>
 inline T* track_new(TrackAlloc &alloc, size_t count) {
+  g_alloc_pending = &alloc;
   T *res = new T[count];
-  void *pbase = ((uint8_t*)res) - 4;
-  alloc.alloc_total += *((uint32_t*)pbase);
+  g_alloc_pending = NULL;
   return res;
 }
 
 // replacement for delete[] when deleting an array allocated with track_new.
 template <class T>
 inline void track_delete(TrackAlloc &alloc, T *val) {
-  if (val) {
-    void *pbase = ((uint8_t*)val) - 4;
-    alloc.alloc_total -= *((uint32_t*)pbase);
-    delete[] val;
-  }
+  delete[] val;
 }
 
 // override the new/delete operators for a class to use the specified ALLOC.
 #define ALLOC_OVERRIDE(ALLOC)                           \
   static void* operator new (size_t size) {             \
-    size_t nsize = size + 4;                            \
-    void *pbase = malloc(nsize);                        \
-    *((uint32_t*)pbase) = nsize;                        \
-    g_alloc_total += nsize;                             \
-    (ALLOC).alloc_total += nsize;                       \
-    return ((uint8_t*)pbase) + 4;                       \
+    return TrackAllocate(&(ALLOC), size);               \
   }                                                     \
   static void* operator new[] (size_t size) {           \
-    size_t nsize = size + 4;                            \
-    void *pbase = malloc(nsize);                        \
-    *((uint32_t*)pbase) = nsize;                        \
-    g_alloc_total += nsize;                             \
-    (ALLOC).alloc_total += nsize;                       \
-    return ((uint8_t*)pbase) + 4;                       \
+    return TrackAllocate(&(ALLOC), size);               \
   }                                                     \
   static void operator delete (void *p) {               \
-    if (p) {                                            \
-      void *pbase = ((uint8_t*)p) - 4;                  \
-      size_t osize = *((uint32_t*)pbase);               \
-      g_alloc_total -= osize;                           \
-      (ALLOC).alloc_total -= osize;                     \
-      free(pbase);                                      \
-    }                                                   \
+    TrackFree(p);                                       \
   }                                                     \
   static void operator delete[] (void *p) {             \
-    if (p) {                                            \
-      void *pbase = ((uint8_t*)p) - 4;                  \
-      size_t osize = *((uint32_t*)pbase);               \
-      g_alloc_total -= osize;                           \
-      (ALLOC).alloc_total -= osize;                     \
-      free(pbase);                                      \
-    }                                                   \
+    TrackFree(p);                                       \
   }
 
 #else // USE_COUNT_ALLOCATOR
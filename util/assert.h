@@ -45,7 +45,8 @@ inline void AssertFail(const char *file, int line, const char *func,
                        const char *msg)
 {
   logout << file << ": " << line << ": " << func
-         << ": Assertion '" << msg << "' failed." << endl << flush;
+         << ": Assertion '" << msg << "' failed." << endl;
+  FlushLog();
   if (g_pause_assertions)
     pause();
   abort();
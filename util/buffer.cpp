@@ -17,8 +17,10 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "buffer.h"
+#include "config.h"
 #include <zlib.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #include <errno.h>
 
 NAMESPACE_XGILL_BEGIN
@@ -51,6 +53,13 @@ void Buffer::Reset(size_t initial_size)
 void Buffer::Reset()
 {
   pos = base;
+  version = 0;
+
+  if (tag_stack != NULL)
+    tag_stack->Clear();
+
+  if (length_fixups != NULL)
+    length_fixups->Clear();
 
   if (seen != NULL) {
     delete seen;
@@ -63,6 +72,18 @@ void Buffer::Reset()
   }
 
   seen_next = 0;
+
+  if (shared != NULL) {
+    delete shared;
+    shared = NULL;
+  }
+
+  if (shared_rev != NULL) {
+    delete shared_rev;
+    shared_rev = NULL;
+  }
+
+  shared_next = 0;
 }
 
 void Buffer::Expand(size_t new_size)
@@ -185,7 +206,8 @@ void SplitBufferStrings(Buffer *buf, char tok, Vector<char*> *strings)
 // including this header allows us to include multiple segments
 // of compressed data in the same buffer.
 
-void UncompressBuffer(Buffer *input, Buffer *output)
+// uncompress input into output, returning an error message on failure.
+static const char* DoUncompressBuffer(Buffer *input, Buffer *output)
 {
   Assert(input->base == input->pos);
   Assert(output->base == output->pos);
@@ -193,37 +215,44 @@ void UncompressBuffer(Buffer *input, Buffer *output)
   uint32_t compressed_size = 0;
   uint32_t uncompressed_size = 0;
 
-  if (!input->HasRemaining(8)) {
-    printf("ERROR: UncompressBuffer() input missing header\n");
-    Assert(false);
-  }
+  if (!input->HasRemaining(8))
+    return "input missing header";
 
   // read in the header size data
   Read32(input, &compressed_size);
   Read32(input, &uncompressed_size);
 
   // input does not contain entire compressed buffer
-  if (!input->HasRemaining(compressed_size)) {
-    printf("ERROR: UncompressBuffer() input malformed header\n");
-    Assert(false);
-  }
+  if (!input->HasRemaining(compressed_size))
+    return "input malformed header";
 
   output->Ensure(uncompressed_size);
   unsigned long uncompress_len = output->size;
 
   int ret = uncompress(output->base, &uncompress_len,
                        input->pos, compressed_size);
-  if (ret != Z_OK) {
-    printf("ERROR: UncompressBuffer() failure: %d\n", ret);
-    Assert(false);
-  }
+  if (ret != Z_OK)
+    return "failure";
+
+  if (uncompress_len != uncompressed_size)
+    return "bad uncompressed size";
+
+  output->pos = output->base + uncompress_len;
+  return NULL;
+}
 
-  if (uncompress_len != uncompressed_size) {
-    printf("ERROR: UncompressBuffer() bad uncompressed size\n");
+void UncompressBuffer(Buffer *input, Buffer *output)
+{
+  const char *error = DoUncompressBuffer(input, output);
+  if (error) {
+    printf("ERROR: UncompressBuffer() %s\n", error);
     Assert(false);
   }
+}
 
-  output->pos = output->base + uncompress_len;
+bool TryUncompressBuffer(Buffer *input, Buffer *output)
+{
+  return DoUncompressBuffer(input, output) == NULL;
 }
 
 void CompressBuffer(Buffer *input, Buffer *output)
@@ -729,7 +758,8 @@ bool PrintTag(Buffer *buf, int pad_spaces, uint8_t *extent)
     PrintPadding(pad_spaces);
     logout << "<" << tag << ">" << endl;
 
-    ReadOpenTag(buf, tag);
+    if (!ReadOpenTag(buf, tag))
+      return false;
     while (!ReadCloseTag(buf, tag)) {
       if (buf->pos > extent)
         return true;
@@ -751,30 +781,186 @@ bool PrintTag(Buffer *buf, int pad_spaces, uint8_t *extent)
 size_t PrintPartialBuffer(Buffer *buf)
 {
   Buffer newbuf(buf->base, buf->size);
+  newbuf.version = buf->version;
   uint8_t *extent = buf->pos;
 
   bool parsed = PrintTag(&newbuf, 0, extent);
   if (!parsed)
     logout << "ERROR: Buffer parse failed" << endl;
 
+  // remember the encoding for printing any later data in the buffer.
+  buf->version = newbuf.version;
+
   return newbuf.pos - newbuf.base;
 }
 
+/////////////////////////////////////////////////////////////////////
+// Encoding versions
+/////////////////////////////////////////////////////////////////////
+
+ConfigOption buffer_v2(CK_Flag, "buffer-v2", NULL,
+                       "write binary data using the compact v2 encoding");
+
+// determine the encoding for a buffer which is about to be written to.
+static inline void StartWrite(Buffer *buf)
+{
+  if (buf->version != 0)
+    return;
+
+  if (buf->pos == buf->base && buffer_v2.IsSpecified()) {
+    buf->version = 2;
+    buf->Append(BUFFER_V2_MARKER, BUFFER_V2_MARKER_LENGTH);
+  }
+  else {
+    buf->version = 1;
+  }
+}
+
+// determine the encoding for a buffer which is about to be read from.
+static inline void StartRead(Buffer *buf)
+{
+  if (buf->version != 0)
+    return;
+
+  if (buf->pos == buf->base && buf->HasRemaining(BUFFER_V2_MARKER_LENGTH) &&
+      memcmp(buf->pos, BUFFER_V2_MARKER, BUFFER_V2_MARKER_LENGTH) == 0) {
+    buf->version = 2;
+    buf->pos += BUFFER_V2_MARKER_LENGTH;
+  }
+  else {
+    buf->version = 1;
+  }
+}
+
+static inline Vector<BufferTag>* GetTagStack(Buffer *buf)
+{
+  if (buf->tag_stack == NULL)
+    buf->tag_stack = new Vector<BufferTag>();
+  return buf->tag_stack;
+}
+
+static inline size_t GetTagDepth(Buffer *buf)
+{
+  return buf->tag_stack ? buf->tag_stack->Size() : 0;
+}
+
+// restore the position and open objects of a buffer after a failed read.
+static inline void RestoreRead(Buffer *buf, uint8_t *pos, size_t depth)
+{
+  buf->pos = pos;
+  if (buf->tag_stack)
+    buf->tag_stack->Resize(depth);
+}
+
+// maximum number of bytes in a varint for a 64 bit value.
+#define VARINT_MAX_LENGTH 10
+
+static inline size_t VarintLength(uint64_t val)
+{
+  size_t length = 1;
+  while (val >= 0x80) {
+    val >>= 7;
+    length++;
+  }
+  return length;
+}
+
+// the buffer must have room for VarintLength(val) bytes.
+static inline void WriteVarint(Buffer *buf, uint64_t val)
+{
+  while (val >= 0x80) {
+    *buf->pos++ = (uint8_t) (val | 0x80);
+    val >>= 7;
+  }
+  *buf->pos++ = (uint8_t) val;
+}
+
+// read a varint, leaving the buffer unchanged on failure.
+static inline bool ReadVarint(Buffer *buf, uint64_t *pval)
+{
+  // fast path for single byte values, which are most tags and lengths.
+  if (buf->HasRemaining(1) && buf->pos[0] < 0x80) {
+    *pval = *buf->pos++;
+    return true;
+  }
+
+  uint64_t val = 0;
+  size_t shift = 0;
+  uint8_t *pos = buf->pos;
+
+  while (buf->HasRemaining(1) && shift < 7 * VARINT_MAX_LENGTH) {
+    uint8_t byte = *buf->pos++;
+    val |= ((uint64_t) (byte & 0x7f)) << shift;
+    if ((byte & 0x80) == 0) {
+      *pval = val;
+      return true;
+    }
+    shift += 7;
+  }
+
+  buf->pos = pos;
+  return false;
+}
+
+// read a varint tag and check it matches tag, leaving the buffer
+// unchanged on failure.
+static inline bool ReadVarintTag(Buffer *buf, tag_t tag)
+{
+  uint8_t *pos = buf->pos;
+  uint64_t xtag;
+  if (!ReadVarint(buf, &xtag))
+    return false;
+  if (xtag != tag) {
+    buf->pos = pos;
+    return false;
+  }
+  return true;
+}
+
+static inline uint64_t ZigZagEncode(int64_t val)
+{
+  return ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+}
+
+static inline int64_t ZigZagDecode(uint64_t val)
+{
+  return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
 /////////////////////////////////////////////////////////////////////
 // Write methods
 /////////////////////////////////////////////////////////////////////
 
 void WriteString(Buffer *buf, const uint8_t *str, size_t str_length)
 {
-  buf->Ensure(2 + 4 + str_length);
-  Write16(buf, TAG_String);
-  Write32(buf, str_length);
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    buf->Ensure(2 * VARINT_MAX_LENGTH + str_length);
+    WriteVarint(buf, TAG_String);
+    WriteVarint(buf, str_length);
+  }
+  else {
+    buf->Ensure(2 + 4 + str_length);
+    Write16(buf, TAG_String);
+    Write32(buf, str_length);
+  }
+
   memcpy(buf->pos, str, str_length);
   buf->pos += str_length;
 }
 
 void WriteInt32(Buffer *buf, int32_t val)
 {
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    buf->Ensure(2 * VARINT_MAX_LENGTH);
+    WriteVarint(buf, TAG_Int32);
+    WriteVarint(buf, ZigZagEncode(val));
+    return;
+  }
+
   buf->Ensure(2 + 4);
   Write16(buf, TAG_Int32);
   Write32(buf, (uint32_t) val);
@@ -782,6 +968,15 @@ void WriteInt32(Buffer *buf, int32_t val)
 
 void WriteUInt32(Buffer *buf, uint32_t val)
 {
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    buf->Ensure(2 * VARINT_MAX_LENGTH);
+    WriteVarint(buf, TAG_UInt32);
+    WriteVarint(buf, val);
+    return;
+  }
+
   buf->Ensure(2 + 4);
   Write16(buf, TAG_UInt32);
   Write32(buf, val);
@@ -789,19 +984,121 @@ void WriteUInt32(Buffer *buf, uint32_t val)
 
 void WriteUInt64(Buffer *buf, uint64_t val)
 {
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    buf->Ensure(2 * VARINT_MAX_LENGTH);
+    WriteVarint(buf, TAG_UInt64);
+    WriteVarint(buf, val);
+    return;
+  }
+
   buf->Ensure(2 + 8);
   Write16(buf, TAG_UInt64);
   Write64(buf, val);
 }
 
+// write the lengths for all objects in buf which did not fit in their
+// reserved byte, moving the contents of the buffer to make room for the
+// extra bytes. each byte is moved at most once.
+static void WriteLengthFixups(Buffer *buf, size_t extra)
+{
+  Vector<BufferLengthFixup> &fixups = *buf->length_fixups;
+  SortVector<BufferLengthFixup,BufferLengthFixup>(&fixups);
+
+  buf->Ensure(extra);
+  uint8_t *end = buf->pos + extra;
+
+  // fill in the buffer from the end, working back towards the first fixup.
+  uint8_t *src_end = buf->pos;
+  uint8_t *dst_end = end;
+
+  for (size_t ind = fixups.Size(); ind > 0; ind--) {
+    const BufferLengthFixup &fixup = fixups[ind - 1];
+    uint8_t *data = buf->base + fixup.offset + 1;
+
+    size_t move = src_end - data;
+    dst_end -= move;
+    memmove(dst_end, data, move);
+
+    dst_end -= VarintLength(fixup.length);
+    buf->pos = dst_end;
+    WriteVarint(buf, fixup.length);
+
+    src_end = data - 1;
+  }
+
+  Assert(src_end == dst_end);
+  buf->pos = end;
+
+  fixups.Clear();
+}
+
 void WriteOpenTag(Buffer *buf, tag_t tag)
 {
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    // reserve a single byte for the length, which will be filled in
+    // (and expanded if necessary) by WriteCloseTag.
+    buf->Ensure(VARINT_MAX_LENGTH + 1);
+    WriteVarint(buf, tag);
+
+    BufferTag open;
+    open.offset = buf->pos - buf->base;
+    open.tag = tag;
+    open.extra = 0;
+    GetTagStack(buf)->PushBack(open);
+
+    buf->pos++;
+    return;
+  }
+
   buf->Ensure(2);
   Write16(buf, tag);
 }
 
 void WriteCloseTag(Buffer *buf, tag_t tag)
 {
+  StartWrite(buf);
+
+  if (buf->version == 2) {
+    Assert(GetTagDepth(buf) != 0);
+    BufferTag open = buf->tag_stack->Back();
+    buf->tag_stack->PopBack();
+    Assert(open.tag == tag);
+
+    // the length includes the expansion of any nested lengths, which
+    // have not been written out yet.
+    size_t length = buf->pos - (buf->base + open.offset + 1) + open.extra;
+    size_t length_bytes = VarintLength(length);
+
+    if (length_bytes == 1) {
+      buf->base[open.offset] = (uint8_t) length;
+    }
+    else {
+      // the length doesn't fit in its reserved byte. rather than move the
+      // object's contents now, which would move the contents of nested
+      // objects once for each enclosing object, remember the length and
+      // make room for all such lengths at once.
+      if (buf->length_fixups == NULL)
+        buf->length_fixups = new Vector<BufferLengthFixup>();
+
+      BufferLengthFixup fixup;
+      fixup.offset = open.offset;
+      fixup.length = length;
+      buf->length_fixups->PushBack(fixup);
+    }
+
+    size_t extra = open.extra + length_bytes - 1;
+
+    if (GetTagDepth(buf) != 0)
+      buf->tag_stack->Back().extra += extra;
+    else if (extra != 0)
+      WriteLengthFixups(buf, extra);
+    return;
+  }
+
   buf->Ensure(2);
   Write16(buf, (tag | 0x0001));
 }
@@ -845,8 +1142,61 @@ void WriteTagEmpty(Buffer *buf, tag_t tag)
 // Read methods
 /////////////////////////////////////////////////////////////////////
 
+// read the value for a v2 integer with the specified tag.
+static bool ReadVarintValue(Buffer *buf, tag_t tag, uint64_t *pval)
+{
+  uint8_t *pos = buf->pos;
+  if (!ReadVarintTag(buf, tag))
+    return false;
+  if (!ReadVarint(buf, pval)) {
+    buf->pos = pos;
+    return false;
+  }
+  return true;
+}
+
+// read a v2 complex object containing only an integer with value_tag,
+// without going through the tag stack.
+static bool ReadTagVarintValue(Buffer *buf, tag_t tag, tag_t value_tag,
+                               uint64_t *pval)
+{
+  uint8_t *pos = buf->pos;
+  uint64_t length;
+  if (!ReadVarintValue(buf, tag, &length))
+    return false;
+
+  uint8_t *end = buf->pos + length;
+  if (!buf->HasRemaining(length) ||
+      !ReadVarintValue(buf, value_tag, pval) ||
+      buf->pos != end) {
+    buf->pos = pos;
+    return false;
+  }
+
+  return true;
+}
+
 bool ReadString(Buffer *buf, const uint8_t **pstr, size_t *psize)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t read_length;
+    uint8_t *pos = buf->pos;
+    if (!ReadVarintValue(buf, TAG_String, &read_length))
+      return false;
+
+    if (!buf->HasRemaining(read_length)) {
+      buf->pos = pos;
+      return false;
+    }
+
+    *pstr = buf->pos;
+    *psize = read_length;
+    buf->pos += read_length;
+    return true;
+  }
+
   if (!buf->HasRemaining(2 + 4))
     return false;
 
@@ -874,6 +1224,16 @@ bool ReadString(Buffer *buf, const uint8_t **pstr, size_t *psize)
 
 bool ReadInt32(Buffer *buf, int32_t *pval)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t val;
+    if (!ReadVarintValue(buf, TAG_Int32, &val))
+      return false;
+    *pval = (int32_t) ZigZagDecode(val);
+    return true;
+  }
+
   if (!buf->HasRemaining(2 + 4))
     return false;
 
@@ -890,6 +1250,16 @@ bool ReadInt32(Buffer *buf, int32_t *pval)
 
 bool ReadUInt32(Buffer *buf, uint32_t *pval)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t val;
+    if (!ReadVarintValue(buf, TAG_UInt32, &val))
+      return false;
+    *pval = (uint32_t) val;
+    return true;
+  }
+
   if (!buf->HasRemaining(2 + 4))
     return false;
 
@@ -906,6 +1276,11 @@ bool ReadUInt32(Buffer *buf, uint32_t *pval)
 
 bool ReadUInt64(Buffer *buf, uint64_t *pval)
 {
+  StartRead(buf);
+
+  if (buf->version == 2)
+    return ReadVarintValue(buf, TAG_UInt64, pval);
+
   if (!buf->HasRemaining(2 + 8))
     return false;
 
@@ -922,6 +1297,26 @@ bool ReadUInt64(Buffer *buf, uint64_t *pval)
 
 bool ReadOpenTag(Buffer *buf, tag_t tag)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t length;
+    uint8_t *pos = buf->pos;
+    if (!ReadVarintValue(buf, tag, &length))
+      return false;
+
+    if (!buf->HasRemaining(length)) {
+      buf->pos = pos;
+      return false;
+    }
+
+    BufferTag open;
+    open.offset = buf->pos - buf->base + length;
+    open.tag = tag;
+    GetTagStack(buf)->PushBack(open);
+    return true;
+  }
+
   if (!buf->HasRemaining(2))
     return false;
 
@@ -937,6 +1332,20 @@ bool ReadOpenTag(Buffer *buf, tag_t tag)
 
 bool ReadCloseTag(Buffer *buf, tag_t tag)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    if (GetTagDepth(buf) == 0)
+      return false;
+
+    const BufferTag &open = buf->tag_stack->Back();
+    if (open.tag != tag || (size_t) (buf->pos - buf->base) != open.offset)
+      return false;
+
+    buf->tag_stack->PopBack();
+    return true;
+  }
+
   if (!buf->HasRemaining(2))
     return false;
 
@@ -954,87 +1363,127 @@ bool ReadCloseTag(Buffer *buf, tag_t tag)
 bool ReadTagString(Buffer *buf, tag_t tag,
                    const uint8_t **pstr, size_t *psize)
 {
-  if (!ReadOpenTag(buf, tag))
-    return false;
-  if (!ReadString(buf, pstr, psize)) {
-    Rewind(buf, 2);
-    return false;
-  }
-  if (!ReadCloseTag(buf, tag)) {
-    Rewind(buf, 2 + 4 + *psize);
-    Rewind(buf, 2);
-    return false;
-  }
-  return true;
+  uint8_t *pos = buf->pos;
+  size_t depth = GetTagDepth(buf);
+
+  if (ReadOpenTag(buf, tag) &&
+      ReadString(buf, pstr, psize) &&
+      ReadCloseTag(buf, tag))
+    return true;
+
+  RestoreRead(buf, pos, depth);
+  return false;
 }
 
 bool ReadTagInt32(Buffer *buf, tag_t tag, int32_t *pval)
 {
-  int32_t val;
-  if (!ReadOpenTag(buf, tag))
-    return false;
-  if (!ReadInt32(buf, &val)) {
-    Rewind(buf, 2);
-    return false;
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t val;
+    if (!ReadTagVarintValue(buf, tag, TAG_Int32, &val))
+      return false;
+    *pval = (int32_t) ZigZagDecode(val);
+    return true;
   }
-  if (!ReadCloseTag(buf, tag)) {
-    Rewind(buf, 4);
-    Rewind(buf, 2);
-    return false;
+
+  uint8_t *pos = buf->pos;
+  size_t depth = GetTagDepth(buf);
+
+  int32_t val;
+  if (ReadOpenTag(buf, tag) &&
+      ReadInt32(buf, &val) &&
+      ReadCloseTag(buf, tag)) {
+    *pval = val;
+    return true;
   }
-  *pval = val;
-  return true;
+
+  RestoreRead(buf, pos, depth);
+  return false;
 }
 
 bool ReadTagUInt32(Buffer *buf, tag_t tag, uint32_t *pval)
 {
-  uint32_t val;
-  if (!ReadOpenTag(buf, tag))
-    return false;
-  if (!ReadUInt32(buf, &val)) {
-    Rewind(buf, 2);
-    return false;
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    uint64_t val;
+    if (!ReadTagVarintValue(buf, tag, TAG_UInt32, &val))
+      return false;
+    *pval = (uint32_t) val;
+    return true;
   }
-  if (!ReadCloseTag(buf, tag)) {
-    Rewind(buf, 4);
-    Rewind(buf, 2);
-    return false;
+
+  uint8_t *pos = buf->pos;
+  size_t depth = GetTagDepth(buf);
+
+  uint32_t val;
+  if (ReadOpenTag(buf, tag) &&
+      ReadUInt32(buf, &val) &&
+      ReadCloseTag(buf, tag)) {
+    *pval = val;
+    return true;
   }
-  *pval = val;
-  return true;
+
+  RestoreRead(buf, pos, depth);
+  return false;
 }
 
 bool ReadTagUInt64(Buffer *buf, tag_t tag, uint64_t *pval)
 {
+  StartRead(buf);
+
+  if (buf->version == 2)
+    return ReadTagVarintValue(buf, tag, TAG_UInt64, pval);
+
+  uint8_t *pos = buf->pos;
+  size_t depth = GetTagDepth(buf);
+
   uint64_t val;
-  if (!ReadOpenTag(buf, tag))
-    return false;
-  if (!ReadUInt64(buf, &val)) {
-    Rewind(buf, 2);
-    return false;
-  }
-  if (!ReadCloseTag(buf, tag)) {
-    Rewind(buf, 8);
-    Rewind(buf, 2);
-    return false;
+  if (ReadOpenTag(buf, tag) &&
+      ReadUInt64(buf, &val) &&
+      ReadCloseTag(buf, tag)) {
+    *pval = val;
+    return true;
   }
-  *pval = val;
-  return true;
+
+  RestoreRead(buf, pos, depth);
+  return false;
 }
 
 bool ReadTagEmpty(Buffer *buf, tag_t tag)
 {
-  if (!ReadOpenTag(buf, tag))
-    return false;
-  if (!ReadCloseTag(buf, tag)) {
-    Rewind(buf, 2);
-    return false;
-  }
-  return true;
+  uint8_t *pos = buf->pos;
+  size_t depth = GetTagDepth(buf);
+
+  if (ReadOpenTag(buf, tag) && ReadCloseTag(buf, tag))
+    return true;
+
+  RestoreRead(buf, pos, depth);
+  return false;
 }
 
 tag_t PeekOpenTag(Buffer *buf)
 {
+  StartRead(buf);
+
+  if (buf->version == 2) {
+    // nothing more to read in the innermost open object.
+    if (GetTagDepth(buf) != 0 &&
+        (size_t) (buf->pos - buf->base) >= buf->tag_stack->Back().offset)
+      return 0;
+
+    uint8_t *pos = buf->pos;
+    uint64_t xtag;
+    if (!ReadVarint(buf, &xtag))
+      return 0;
+    buf->pos = pos;
+
+    if (xtag > 0xffff || (xtag & 0x0001) != 0)
+      return 0;
+    return (tag_t) xtag;
+  }
+
   if (!buf->HasRemaining(2))
     return 0;
 
@@ -1048,6 +1497,77 @@ tag_t PeekOpenTag(Buffer *buf)
   return xtag;
 }
 
+bool SkipTag(Buffer *buf)
+{
+  const uint8_t *str_base;
+  size_t str_len;
+  int32_t val;
+  uint32_t uval;
+  uint64_t luval;
+
+  if (ReadString(buf, &str_base, &str_len) ||
+      ReadInt32(buf, &val) ||
+      ReadUInt32(buf, &uval) ||
+      ReadUInt64(buf, &luval))
+    return true;
+
+  tag_t tag = PeekOpenTag(buf);
+  if (!tag || !ReadOpenTag(buf, tag))
+    return false;
+
+  while (!ReadCloseTag(buf, tag)) {
+    if (!SkipTag(buf))
+      return false;
+  }
+
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Shared object methods
+/////////////////////////////////////////////////////////////////////
+
+bool WriteShared(Buffer *buf, const void *v)
+{
+  if (buf->shared == NULL)
+    buf->shared = new Buffer::SeenTable();
+
+  Vector<uint32_t> *data = buf->shared->Lookup((void*) v, true);
+  if (data->Empty()) {
+    data->PushBack(buf->shared_next++);
+    return false;
+  }
+
+  WriteUInt32(buf, data->At(0));
+  return true;
+}
+
+bool ReadShared(Buffer *buf, void **pv, uint32_t *pid)
+{
+  if (buf->shared_rev == NULL)
+    buf->shared_rev = new Vector<void*>();
+
+  uint32_t id = 0;
+  if (ReadUInt32(buf, &id)) {
+    // references must be to objects which have been completely read,
+    // otherwise the data is corrupt and pv will be NULL.
+    *pv = NULL;
+    if (id < buf->shared_rev->Size())
+      *pv = buf->shared_rev->At(id);
+    return true;
+  }
+
+  *pid = buf->shared_rev->Size();
+  buf->shared_rev->PushBack(NULL);
+  return false;
+}
+
+void ReadSharedDone(Buffer *buf, uint32_t id, void *v)
+{
+  Assert(buf->shared_rev && id < buf->shared_rev->Size());
+  buf->shared_rev->At(id) = v;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Packet methods
 /////////////////////////////////////////////////////////////////////
@@ -1079,6 +1599,7 @@ bool ReadPacket(int fd, Buffer *output)
   uint32_t data_length = 0;
 
   Buffer length_buf(output->base, UINT32_LENGTH);
+  length_buf.version = 1;
   if (!ReadUInt32(&length_buf, &data_length)) {
     logout << "ERROR: Malformed data in PacketRead()" << endl;
     return false;
@@ -1097,26 +1618,45 @@ bool ReadPacket(int fd, Buffer *output)
   return (ret == (ssize_t) needed);
 }
 
-bool WritePacket(int fd, Buffer *input)
+bool WritePacket(int fd, const uint8_t *data, size_t data_length,
+                 size_t *pwritten)
 {
-  Assert(input->size >= UINT32_LENGTH);
-  size_t data_length = input->size - UINT32_LENGTH;
+  uint8_t length_data[UINT32_LENGTH];
+  Buffer length_buf(length_data, UINT32_LENGTH);
+  length_buf.version = 1;
+  WriteUInt32(&length_buf, data_length);
+
+  size_t written = *pwritten;
+  Assert(written < UINT32_LENGTH + data_length);
+
+  // gather the remaining portions of the length prefix and data.
+  struct iovec iov[2];
+  int iov_count = 0;
+
+  size_t data_written = 0;
+  if (written < UINT32_LENGTH) {
+    iov[iov_count].iov_base = length_data + written;
+    iov[iov_count].iov_len = UINT32_LENGTH - written;
+    iov_count++;
+  }
+  else {
+    data_written = written - UINT32_LENGTH;
+  }
 
-  // fill in the length information in case it isn't already there.
-  if (input->pos == input->base) {
-    Buffer length_buf(input->base, UINT32_LENGTH);
-    WriteUInt32(&length_buf, data_length);
+  if (data_written < data_length) {
+    iov[iov_count].iov_base = (void*) (data + data_written);
+    iov[iov_count].iov_len = data_length - data_written;
+    iov_count++;
   }
 
-  size_t read_size = input->pos - input->base;
-  size_t needed = UINT32_LENGTH + data_length - read_size;
+  size_t needed = UINT32_LENGTH + data_length - written;
 
-  ssize_t ret = write(fd, input->pos, needed);
+  ssize_t ret = writev(fd, iov, iov_count);
   if (ret == -1) {
-    logout << "ERROR: write() failure: " << errno << endl;
+    logout << "ERROR: writev() failure: " << errno << endl;
     return false;
   }
-  input->pos += ret;
+  *pwritten += ret;
 
   return (ret == (ssize_t) needed);
 }
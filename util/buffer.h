@@ -23,6 +23,7 @@
 // utility functions on strings and buffers.
 
 #include "hashtable.h"
+#include "config.h"
 #include <stdint.h>
 
 #include <gmp.h>
@@ -58,6 +59,25 @@ extern TrackAlloc g_alloc_Buffer;
 // for all 16-bit tags and 32-bit quantities,
 // the byte order is little-endian.
 
+// the above is the v1 encoding. there is also a more compact v2 encoding,
+// which is identified by starting with the two bytes BUFFER_V2_MARKER
+// (a v1 stream can never start with these, as they would be a close tag).
+// in v2 all tags and integers are written as varints (seven bits per byte,
+// least significant group first, high bit set on all but the last byte),
+// and signed integers are zigzag encoded first. the format is:
+// - String: TAG_String LENGTH BYTES
+// - Int32/UInt32/UInt64: TAG VALUE
+// - complex: OPEN-TAG LENGTH (primitive | complex)*
+// where LENGTH is the number of bytes in the object after the LENGTH.
+// there are no close tags; an object ends when its length is consumed.
+
+// the encoding used for a buffer is determined when it is first written
+// or read. writes at the start of an empty buffer use v2 if the buffer-v2
+// option has been specified (marker included), and all other writes use
+// v1. reads at the start of a buffer check for the v2 marker, and all other
+// reads use v1. so that packets and other partial buffers are consistent,
+// data written after the start of a buffer is always v1.
+
 #define TAG_String  2
 #define TAG_Int32   4
 #define TAG_UInt32  6
@@ -74,6 +94,45 @@ extern TrackAlloc g_alloc_Buffer;
 // values of type tag_t MUST have their low bit clear.
 typedef uint16_t tag_t;
 
+// bytes at the start of a buffer in the v2 encoding.
+#define BUFFER_V2_MARKER  "\xff\x02"
+#define BUFFER_V2_MARKER_LENGTH  2
+
+// write buffers using the v2 encoding.
+extern ConfigOption buffer_v2;
+
+// complex object which is being written or read in the v2 encoding.
+struct BufferTag
+{
+  // for writes, offset of the byte reserved for the object's length.
+  // for reads, offset of the end of the object.
+  size_t offset;
+  tag_t tag;
+
+  // for writes, number of bytes by which the lengths of objects nested
+  // in this one will expand past their reserved byte.
+  size_t extra;
+};
+
+// length of a closed object in a v2 buffer which does not fit in the byte
+// reserved for it, and will be written once the outermost object closes.
+struct BufferLengthFixup
+{
+  // offset of the byte reserved for the object's length.
+  size_t offset;
+
+  // length of the object's contents, including any nested lengths.
+  size_t length;
+
+  static int Compare(const BufferLengthFixup &f0,
+                     const BufferLengthFixup &f1)
+  {
+    if (f0.offset < f1.offset) return -1;
+    if (f0.offset > f1.offset) return 1;
+    return 0;
+  }
+};
+
 struct Buffer
 {
   // base pointer of the buffer.
@@ -92,13 +151,17 @@ struct Buffer
   // make a non-resizable buffer for the specified data.
   Buffer(const void *data, size_t data_length)
     : base((uint8_t*) data), pos(base), size(data_length), alloc(NULL),
-      seen(NULL), seen_next(0), seen_rev(NULL)
+      version(0), tag_stack(NULL), length_fixups(NULL),
+      seen(NULL), seen_next(0), seen_rev(NULL),
+      shared(NULL), shared_next(0), shared_rev(NULL)
   {}
 
   // make and allocate data for a resizable buffer that is initially empty.
   Buffer(size_t initial_size = 4096)
     : base(NULL), pos(NULL), size(0), alloc(&g_alloc_Buffer),
-      seen(NULL), seen_next(0), seen_rev(NULL)
+      version(0), tag_stack(NULL), length_fixups(NULL),
+      seen(NULL), seen_next(0), seen_rev(NULL),
+      shared(NULL), shared_next(0), shared_rev(NULL)
   {
     if (initial_size)
       Reset(initial_size);
@@ -108,7 +171,9 @@ struct Buffer
   // and uses the specified allocator.
   Buffer(const char *alloc_name)
     : base(NULL), pos(NULL), size(0), alloc(&LookupAlloc(alloc_name)),
-      seen(NULL), seen_next(0), seen_rev(NULL)
+      version(0), tag_stack(NULL), length_fixups(NULL),
+      seen(NULL), seen_next(0), seen_rev(NULL),
+      shared(NULL), shared_next(0), shared_rev(NULL)
   {
     Reset(4096);
   }
@@ -118,7 +183,14 @@ struct Buffer
   Buffer& operator = (const Buffer&) { Assert(false); return *this; }
 
   // deallocate the buffer's data if it is resizable.
-  ~Buffer() { Reset(0); }
+  ~Buffer()
+  {
+    Reset(0);
+    if (tag_stack)
+      delete tag_stack;
+    if (length_fixups)
+      delete length_fixups;
+  }
 
   // resets the buffer state.
   // if the buffer is not resizable the initial state will be restored.
@@ -156,6 +228,18 @@ struct Buffer
     pos += data_length;
   }
 
+  // binary XML encoding of the data in this buffer (1 or 2), or 0 if it
+  // has not been determined yet. this is reset by Reset().
+  uint8_t version;
+
+  // complex objects currently open in a v2 buffer, innermost last.
+  // NULL until the buffer first uses the v2 encoding.
+  Vector<BufferTag> *tag_stack;
+
+  // lengths which still need to be written for closed objects in a v2
+  // buffer, in the order the objects were closed. NULL until used.
+  Vector<BufferLengthFixup> *length_fixups;
+
   // persistent state within a buffer. the seen/seen_rev table can be used to
   // remember data that previously appeared in the buffer, and instead
   // of writing or reading it again just write/read an integer identifier.
@@ -193,6 +277,15 @@ struct Buffer
   // get the v/cleanup with which id was associated, return false if none.
   bool TestSeenRev(uint32_t id, void **pv);
 
+  // tables for shared objects, see WriteShared/ReadShared. these are
+  // separate from seen/seen_rev as identifiers for shared objects are
+  // assigned implicitly, in the order the objects are first written.
+  // shared maps previously written objects to their identifiers, and
+  // shared_rev maps identifiers to the objects read for them.
+  SeenTable *shared;
+  uint32_t shared_next;
+  Vector<void*> *shared_rev;
+
   ALLOC_OVERRIDE(g_alloc_Buffer);
 };
 
@@ -241,6 +334,10 @@ void SplitBufferStrings(Buffer *buf, char tok, Vector<char*> *strings);
 void UncompressBuffer(Buffer *input, Buffer *output);
 void CompressBuffer(Buffer *input, Buffer *output);
 
+// as UncompressBuffer, except returns false rather than failing if the
+// input is malformed or truncated.
+bool TryUncompressBuffer(Buffer *input, Buffer *output);
+
 // as UncompressBuffer/CompressBuffer, except the input buffer range
 // used is [input->base, input->pos>.
 void UncompressBufferInUse(Buffer *input, Buffer *output);
@@ -291,7 +388,8 @@ void PrintPadding(size_t pad_spaces);
 
 // print the data in buf, ending at the first closing tag after the
 // buffer's current position. returns the number of characters read from
-// the buffer.
+// the buffer. if the buffer's encoding has not been determined, it will
+// be set according to the data at the start of the buffer.
 size_t PrintPartialBuffer(Buffer *buf);
 
 // Primitive write/read methods. byte order of data is least-significant
@@ -428,6 +526,30 @@ bool ReadTagEmpty(Buffer *buf, tag_t tag);
 // return 0 if the buffer is not at a valid primitive or complex open tag
 tag_t PeekOpenTag(Buffer *buf);
 
+// skip over the next primitive or complex value in the input, including
+// all its children. returns false if the value is malformed or truncated,
+// in which case the buffer state is not restored.
+bool SkipTag(Buffer *buf);
+
+// Shared object methods. these are used for hash-consed objects so that
+// each distinct object within a buffer has its contents written only once.
+// the first occurrence of an object is written in full and implicitly
+// numbered; later occurrences are written as an untagged TAG_UInt32 with
+// that number, which is then the only child of the object's tag.
+
+// call after writing the open tag for v. returns true if v was previously
+// written to buf, in which case its identifier has been written and
+// no other children should be written.
+bool WriteShared(Buffer *buf, const void *v);
+
+// call after reading the open tag for an object. returns true if the object
+// was previously read from buf, and stores it in pv (NULL if the reference
+// is not to a completely read object). otherwise reserves
+// an identifier for the object and stores it in pid; after reading the
+// object's children the caller must pass the result to ReadSharedDone.
+bool ReadShared(Buffer *buf, void **pv, uint32_t *pid);
+void ReadSharedDone(Buffer *buf, uint32_t id, void *v);
+
 // Packet methods. a packet is a binary blob of data with a TAG_UInt32
 // prefix indicating the length of the blob (length does not
 // include the prefix).
@@ -439,14 +561,13 @@ tag_t PeekOpenTag(Buffer *buf);
 // in the range [ output->base + UINT32_LENGTH, output->pos >
 bool ReadPacket(int fd, Buffer *output);
 
-// write a packet of data to the specified file descriptor.
-// the range [ input->base, input->pos > indicates the range of
-// data written by this or a previous WritePacket() operation.
+// write a packet of data to the specified file descriptor. the data for
+// the packet is [ data, data + data_length >, and is written directly
+// after the length prefix without being copied.
+// *pwritten indicates the number of bytes of the packet (including the
+// prefix) written by previous WritePacket() operations, and is updated.
 // returns true iff the entire packet was written.
-// the packet data needs to be stored in input starting at
-// offset UINT32_LENGTH; the data in
-// [ input->base, input->base + UINT32_LENGTH > will be filled in by
-// WritePacket before being written.
-bool WritePacket(int fd, Buffer *input);
+bool WritePacket(int fd, const uint8_t *data, size_t data_length,
+                 size_t *pwritten);
 
 NAMESPACE_XGILL_END
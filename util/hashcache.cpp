@@ -0,0 +1,148 @@
+
+// Sixgill: Static assertion checker for C/C++ programs.
+// Copyright (C) 2009-2010  Stanford University
+// Author: Brian Hackett
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include "hashcache.h"
+
+NAMESPACE_XGILL_BEGIN
+
+ConfigOption cache_frequency(CK_Flag, "cache-frequency", NULL,
+                             "use frequency-based eviction for caches");
+
+// caches are constructed during static initialization, but this is
+// zero-initialized before any constructors run.
+BaseHashCache *g_cache_list;
+
+BaseHashCache::BaseHashCache(const char *name)
+  : m_name(name), m_hits(0), m_misses(0), m_evictions(0), m_inserts(0),
+    m_shed_bytes(0), m_shed_entries(0), m_next(NULL)
+{
+  m_next = g_cache_list;
+  g_cache_list = this;
+}
+
+BaseHashCache::~BaseHashCache()
+{
+  BaseHashCache **pcache = &g_cache_list;
+  while (*pcache) {
+    if (*pcache == this) {
+      *pcache = m_next;
+      break;
+    }
+    pcache = &(*pcache)->m_next;
+  }
+}
+
+void SetCachePolicy(HashCachePolicy policy)
+{
+  BaseHashCache *cache = g_cache_list;
+  while (cache) {
+    cache->SetPolicy(policy);
+    cache = cache->m_next;
+  }
+}
+
+void PrintCaches()
+{
+  logout << "Caches:" << endl;
+
+  BaseHashCache *cache = g_cache_list;
+  while (cache) {
+    uint64_t lookups = cache->m_hits + cache->m_misses;
+    if (lookups) {
+      logout << "  " << cache->m_name << " (" << cache->GetEntryCount() << "): "
+             << cache->m_hits << " hits, "
+             << cache->m_misses << " misses ("
+             << cache->m_hits * 100 / lookups << "%), "
+             << cache->m_evictions << " evictions";
+
+      size_t bytes = cache->GetEstimatedBytes();
+      if (bytes)
+        logout << ", ~" << (bytes >> 10) << " kB";
+      logout << endl;
+    }
+    cache = cache->m_next;
+  }
+}
+
+// percentage of a cache's entries to remove at a time when shedding.
+#define CACHE_SHED_PERCENT  25
+
+void ShedCaches()
+{
+  if (!IsHighMemoryUsage())
+    return;
+
+  logout << "WARNING: High memory usage, shedding caches..." << endl;
+  PrintMemoryUsage();
+
+  size_t excess = GetExcessMemoryUsage();
+
+  // heap bytes freed by shedding entries.
+  size_t shed_bytes = 0;
+
+  // caches which can't have any more entries removed.
+  Vector<BaseHashCache*> exhausted;
+
+  while (excess > shed_bytes) {
+    // find the cache with the most estimated memory, falling back to the
+    // most entries for caches whose memory usage is unknown.
+    BaseHashCache *largest = NULL;
+    size_t largest_bytes = 0;
+
+    BaseHashCache *cache = g_cache_list;
+    while (cache) {
+      size_t bytes = cache->GetEstimatedBytes();
+      if (cache->GetEntryCount() != 0 && !exhausted.Contains(cache)) {
+        if (!largest || bytes > largest_bytes ||
+            (bytes == largest_bytes &&
+             cache->GetEntryCount() > largest->GetEntryCount())) {
+          largest = cache;
+          largest_bytes = bytes;
+        }
+      }
+      cache = cache->m_next;
+    }
+
+    if (!largest)
+      break;
+
+    size_t entries = largest->GetEntryCount();
+    size_t count = entries * CACHE_SHED_PERCENT / 100;
+    if (count == 0)
+      count = 1;
+
+    // measure the heap space freed, which is also used to estimate the
+    // cache's memory usage the next time we need to shed.
+    size_t heap_before = GetHeapUsage();
+    size_t removed = largest->Shed(count);
+    size_t heap_after = GetHeapUsage();
+
+    if (removed < count)
+      exhausted.PushBack(largest);
+
+    if (heap_before > heap_after) {
+      shed_bytes += heap_before - heap_after;
+      largest->m_shed_bytes += heap_before - heap_after;
+    }
+    largest->m_shed_entries += removed;
+  }
+
+  TrimHeap();
+  PrintMemoryUsage();
+}
+
+NAMESPACE_XGILL_END
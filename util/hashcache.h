@@ -19,16 +19,110 @@
 #pragma once
 
 #include "hashtable.h"
+#include "config.h"
+#include "monitor.h"
 
 NAMESPACE_XGILL_BEGIN
 
+// policies for choosing which unreferenced entries to remove from a cache
+// once it grows past its maximum entry count.
+enum HashCachePolicy {
+  // remove entries in least recently used order.
+  HCP_Lru = 0,
+
+  // scan-resistant policy modelled on W-TinyLFU. new entries go into a
+  // small LRU window, and when the window overflows its oldest entry only
+  // displaces the oldest entry of the main cache if it has been accessed
+  // more often recently (per an approximate frequency sketch). entries in
+  // the main cache which are hit again are protected from eviction until
+  // they age out. a stream of one-time lookups will only churn the window
+  // and will not flush frequently used entries from the cache.
+  HCP_Frequency = 1
+};
+
+// use HCP_Frequency for all caches in the analysis workers.
+extern ConfigOption cache_frequency;
+
+// non-template superclass of all HashCache structures. keeps hit/miss
+// statistics and threads the cache into a global list so that all caches
+// can be inspected or configured at once.
+class BaseHashCache
+{
+ public:
+  // make a new base cache with a globally unique name.
+  BaseHashCache(const char *name);
+
+  // remove this cache from the global list.
+  virtual ~BaseHashCache();
+
+  // set the policy used for removing entries from this cache.
+  virtual void SetPolicy(HashCachePolicy policy) = 0;
+
+  // get the number of entries currently in this cache.
+  virtual size_t GetEntryCount() const = 0;
+
+  // remove up to count entries without active lookups, in the order given
+  // by the cache's policy, regardless of the maximum entry count. returns
+  // the number of entries removed. caches whose eviction is managed by
+  // the client remove all entries without active lookups, as for Clear().
+  virtual size_t Shed(size_t count) = 0;
+
+  // get the approximate number of heap bytes used by entries in this
+  // cache, 0 if unknown. this is estimated from the heap space freed
+  // when entries were previously shed from the cache.
+  size_t GetEstimatedBytes() const
+  {
+    if (m_shed_entries == 0)
+      return 0;
+    return GetEntryCount() * (m_shed_bytes / m_shed_entries);
+  }
+
+  // name of this cache.
+  const char *m_name;
+
+  // number of lookups which found an existing entry in the cache.
+  uint64_t m_hits;
+
+  // number of lookups which had to go to the external lookup.
+  uint64_t m_misses;
+
+  // number of entries which have been removed from the cache to make room
+  // for new entries (not including calls to Clear()).
+  uint64_t m_evictions;
+
+  // number of new entries which have been inserted into the cache.
+  uint64_t m_inserts;
+
+  // heap space freed and number of entries removed by ShedCaches().
+  uint64_t m_shed_bytes;
+  uint64_t m_shed_entries;
+
+  // next cache in global list.
+  BaseHashCache *m_next;
+};
+
+// head of the global list of caches.
+extern BaseHashCache *g_cache_list;
+
+// set the removal policy for all caches.
+void SetCachePolicy(HashCachePolicy policy);
+
+// print hit/miss information for all caches.
+void PrintCaches();
+
+// if memory usage is above the soft limit, remove entries from caches until
+// it has (probably) dropped back below 2/3 of the limit. entries are taken
+// from the caches using the most memory first, and within each cache in the
+// order given by its policy (i.e. least recently used first).
+void ShedCaches();
+
 // weak cache mapping values to one another. when all references
 // to an entry in the cache go away, it stays in the cache and is
 // eventually removed in an LRU order. when a lookup occurs on an item
 // that is not currently in the cache, an external user-supplied routine
 // is called to fetch the item, possibly from external storage.
 template <class T, class U, class HT>
-class HashCache
+class HashCache : public BaseHashCache
 {
  public:
   // interface structure for looking up items that aren't in a cache
@@ -53,7 +147,8 @@ class HashCache
   // least used entries will be removed from the cache as the total
   // number of entries exceeds max_entry_count. this eviction is automatic
   // if eviction_enabled is true, manual if false (see SetLruEviction()).
-  HashCache(ExternalLookup *external_lookup,
+  HashCache(const char *name,
+            ExternalLookup *external_lookup,
             size_t max_entry_count,
             bool eviction_enabled = true);
 
@@ -63,10 +158,20 @@ class HashCache
   // get whether this cache contains candidates for Lru removal.
   bool HasLru()
   {
-    return (m_entry_count > m_max_entry_count)
-        && (m_free_begin != NULL);
+    if (m_entry_count <= m_max_entry_count)
+      return false;
+    for (size_t ind = 0; ind < SEG_Count; ind++) {
+      if (m_free[ind].begin != NULL)
+        return true;
+    }
+    return false;
   }
 
+  // inherited methods.
+  void SetPolicy(HashCachePolicy policy);
+  size_t GetEntryCount() const { return m_entry_count; }
+  size_t Shed(size_t count);
+
   // get the interface used to lookup entries not currently in the cache.
   ExternalLookup* GetExternalLookup() const { return m_external_lookup; }
 
@@ -95,19 +200,31 @@ class HashCache
   // become the most recently used.
   void Insert(T v, U o);
 
+  // get the keys and values of all entries currently in this cache.
+  void GetEntries(Vector<T> *keys, Vector<U> *values);
+
   // remove all entries in this cache, except for those entries which
   // have active lookups (Release() has not yet been called on a previous
   // Lookup() for the entry).
   void Clear();
 
-  // remove the least recently used entries, until we are under
-  // the maximum the maximum entry count or run out of entries without
-  // active lookups. does not do anything if the maximum entry count
-  // is not exceeded.
+  // remove the least recently used entries (or whichever entries are
+  // chosen by the cache's policy), until we are under the maximum entry
+  // count or run out of entries without active lookups. does not do
+  // anything if the maximum entry count is not exceeded.
   void RemoveLruEntries();
 
  private:
 
+  // segments of the cache an entry can be in. under HCP_Lru all entries
+  // are in the probation segment.
+  enum Segment {
+    SEG_Window = 0,
+    SEG_Probation = 1,
+    SEG_Protected = 2,
+    SEG_Count = 3
+  };
+
   // individual entry associating two objects
   struct HashEntry {
     T source;
@@ -119,9 +236,13 @@ class HashCache
     // linked entry in HashBucket list
     HashEntry *next, **pprev;
 
-    // linked entry in free list. non-NULL iff lookups == 0
+    // linked entry in the free list for its segment.
+    // non-NULL iff lookups == 0
     HashEntry *free_next, **free_pprev;
 
+    // segment containing this entry.
+    Segment segment;
+
     HashEntry(T _source, U _target);
     ALLOC_OVERRIDE(g_alloc_HashCache);
   };
@@ -152,9 +273,50 @@ class HashCache
   // whether lru eviction is enabled
   bool m_eviction_enabled;
 
-  // linked list of all entries in the free list, without any active
-  // lookups on them. entries at the beginning are the least recently used.
-  HashEntry *m_free_begin, **m_free_pend;
+  // policy for choosing entries to remove.
+  HashCachePolicy m_policy;
+
+  struct FreeList {
+    // linked list of all entries in the segment without any active lookups
+    // on them. entries at the beginning are the least recently used.
+    HashEntry *begin, **pend;
+
+    // number of entries in the segment, including those with active lookups.
+    size_t count;
+  };
+
+  FreeList m_free[SEG_Count];
+
+  // approximate access frequencies for HCP_Frequency, as a count-min sketch
+  // of saturating counters indexed by hashes of the keys. NULL for HCP_Lru.
+  uint8_t *m_sketch;
+  size_t m_sketch_size;
+
+  // number of accesses recorded in the sketch since counters were last aged.
+  size_t m_sketch_accesses;
+
+  // find the entry for v in its bucket, NULL if there is none.
+  HashEntry* FindEntry(T v);
+
+  // note a use of an entry, updating its segment per the policy.
+  void TouchEntry(HashEntry *e);
+
+  // get the next entry to evict, NULL if there are no candidates.
+  HashEntry* ChooseVictim();
+
+  // move an entry with no active lookups to the MRU end of a segment.
+  void MoveFreeEntry(HashEntry *e, Segment segment);
+
+  // maximum number of entries for the window and protected segments.
+  size_t WindowCapacity() const;
+  size_t ProtectedCapacity() const;
+
+  // record an access in the frequency sketch, and get its estimated count.
+  void SketchAccess(uint32_t hash);
+  size_t SketchEstimate(uint32_t hash) const;
+
+  // get the index of the counter for a key's hash in a row of the sketch.
+  size_t SketchIndex(uint32_t hash, uint32_t row) const;
 
   struct __HashEntry_BucketList
   {
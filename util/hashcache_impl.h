@@ -20,11 +20,27 @@
 // HashCache
 /////////////////////////////////////////////////////////////////////
 
+// percentage of the cache used for the window segment under HCP_Frequency.
+#define CACHE_WINDOW_PERCENT  1
+
+// percentage of the remaining cache used for the protected segment.
+#define CACHE_PROTECTED_PERCENT  80
+
+// number of counters per key in the frequency sketch, and the maximum
+// value of each counter.
+#define CACHE_SKETCH_DEPTH  4
+#define CACHE_SKETCH_MAX  15
+
+// number of accesses, as a multiple of the sketch size, after which all
+// counters in the sketch are halved so that old accesses age out.
+#define CACHE_SKETCH_AGING  10
+
 template <class T, class U, class HT>
 HashCache<T,U,HT>::HashEntry::HashEntry(T _source, U _target)
   : source(_source), target(_target), lookups(0),
     next(NULL), pprev(NULL),
-    free_next(NULL), free_pprev(NULL)
+    free_next(NULL), free_pprev(NULL),
+    segment(SEG_Probation)
 {}
 
 template <class T, class U, class HT>
@@ -34,20 +50,85 @@ HashCache<T,U,HT>::HashBucket::HashBucket()
 }
 
 template <class T, class U, class HT>
-HashCache<T,U,HT>::HashCache(ExternalLookup *external_lookup,
+HashCache<T,U,HT>::HashCache(const char *name,
+                             ExternalLookup *external_lookup,
                              size_t max_entry_count, bool eviction_enabled)
-  : m_external_lookup(external_lookup),
+  : BaseHashCache(name),
+    m_external_lookup(external_lookup),
     m_buckets(NULL), m_bucket_count(max_entry_count),
     m_entry_count(0), m_max_entry_count(max_entry_count),
-    m_eviction_enabled(eviction_enabled)
+    m_eviction_enabled(eviction_enabled), m_policy(HCP_Lru),
+    m_sketch(NULL), m_sketch_size(0), m_sketch_accesses(0)
 {
   Assert(m_external_lookup);
   Assert(m_bucket_count != 0);
 
-  LinkedListInit<HashEntry>(&m_free_begin, &m_free_pend);
+  for (size_t ind = 0; ind < SEG_Count; ind++) {
+    LinkedListInit<HashEntry>(&m_free[ind].begin, &m_free[ind].pend);
+    m_free[ind].count = 0;
+  }
+
   m_buckets = new HashBucket[m_bucket_count];
 }
 
+template <class T, class U, class HT>
+void HashCache<T,U,HT>::SetPolicy(HashCachePolicy policy)
+{
+  if (policy == m_policy)
+    return;
+  m_policy = policy;
+
+  // move all entries into the probation segment. entries with active
+  // lookups are not in any free list and only need their segment updated.
+  for (size_t ind = 0; ind < m_bucket_count; ind++) {
+    HashEntry *e = m_buckets[ind].e_begin;
+    while (e != NULL) {
+      if (e->lookups == 0)
+        MoveFreeEntry(e, SEG_Probation);
+      else
+        e->segment = SEG_Probation;
+      e = e->next;
+    }
+  }
+
+  m_free[SEG_Window].count = 0;
+  m_free[SEG_Protected].count = 0;
+  m_free[SEG_Probation].count = m_entry_count;
+
+  if (m_sketch) {
+    track_delete<uint8_t>(g_alloc_HashCache, m_sketch);
+    m_sketch = NULL;
+    m_sketch_size = 0;
+    m_sketch_accesses = 0;
+  }
+
+  if (m_policy == HCP_Frequency) {
+    // use a power of two for the sketch size so indexes can be masked.
+    m_sketch_size = 64;
+    while (m_sketch_size < m_max_entry_count)
+      m_sketch_size *= 2;
+
+    m_sketch = track_new<uint8_t>(g_alloc_HashCache, m_sketch_size);
+    memset(m_sketch, 0, m_sketch_size);
+  }
+}
+
+template <class T, class U, class HT>
+typename HashCache<T,U,HT>::HashEntry* HashCache<T,U,HT>::FindEntry(T v)
+{
+  size_t ind = HT::Hash(0, v) % m_bucket_count;
+  HashBucket *bucket = &m_buckets[ind];
+
+  HashEntry *e = bucket->e_begin;
+  while (e != NULL) {
+    if (e->source == v)
+      return e;
+    e = e->next;
+  }
+
+  return NULL;
+}
+
 template <class T, class U, class HT>
 U HashCache<T,U,HT>::Lookup(T v)
 {
@@ -58,40 +139,36 @@ U HashCache<T,U,HT>::Lookup(T v)
 
   // look for v in the existing entries
 
-  size_t ind = HT::Hash(0, v) % m_bucket_count;
-  HashBucket *bucket = &m_buckets[ind];
+  HashEntry *e = FindEntry(v);
+  if (e != NULL) {
+    m_hits++;
 
-  HashEntry *e = bucket->e_begin;
-  while (e != NULL) {
-    if (e->source == v) {
-      if (e->lookups == 0) {
-        Assert(e->free_pprev != NULL);
-        LinkedListRemove<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
-      }
-      e->lookups++;
-      return e->target;
+    if (e->lookups == 0) {
+      Assert(e->free_pprev != NULL);
+      LinkedListRemove<HashEntry,__HashEntry_FreeList>
+        (&m_free[e->segment].pend, e);
     }
-    e = e->next;
+    e->lookups++;
+
+    TouchEntry(e);
+    return e->target;
   }
 
+  m_misses++;
+
   // insert v and any associated entries into the cache.
   m_external_lookup->LookupInsert(this, v);
 
   // look for the new entry for v.
 
-  ind = HT::Hash(0, v) % m_bucket_count;
-  bucket = &m_buckets[ind];
-
-  e = bucket->e_begin;
-  while (e != NULL) {
-    if (e->source == v) {
-      Assert(e->lookups == 0);
-      Assert(e->free_pprev != NULL);
-      LinkedListRemove<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
-      e->lookups++;
-      return e->target;
-    }
-    e = e->next;
+  e = FindEntry(v);
+  if (e != NULL) {
+    Assert(e->lookups == 0);
+    Assert(e->free_pprev != NULL);
+    LinkedListRemove<HashEntry,__HashEntry_FreeList>
+      (&m_free[e->segment].pend, e);
+    e->lookups++;
+    return e->target;
   }
 
   // entry isn't in the cache
@@ -101,50 +178,36 @@ U HashCache<T,U,HT>::Lookup(T v)
 template <class T, class U, class HT>
 bool HashCache<T,U,HT>::IsMember(T v)
 {
-  size_t ind = v->Hash() % m_bucket_count;
-  HashBucket *bucket = &m_buckets[ind];
-
-  HashEntry *e = bucket->e_begin;
-  while (e != NULL) {
-    if (e->source == v) {
-      // move to most recently used
-      if (e->lookups == 0) {
-        Assert(e->free_pprev != NULL);
-        LinkedListRemove<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
-        LinkedListInsert<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
-      }
-
-      return true;
-    }
-    e = e->next;
+  HashEntry *e = FindEntry(v);
+  if (e == NULL)
+    return false;
+
+  // move to most recently used
+  TouchEntry(e);
+  if (e->lookups == 0) {
+    Assert(e->free_pprev != NULL);
+    MoveFreeEntry(e, e->segment);
   }
 
-  return false;
+  return true;
 }
 
 template <class T, class U, class HT>
 void HashCache<T,U,HT>::Release(T v)
 {
-  size_t ind = HT::Hash(0, v) % m_bucket_count;
-  HashBucket *bucket = &m_buckets[ind];
+  HashEntry *e = FindEntry(v);
 
-  HashEntry *e = bucket->e_begin;
-  while (e != NULL) {
-    if (e->source == v) {
-      Assert(e->lookups != 0);
-      e->lookups--;
+  // entry isn't in the cache
+  Assert(e != NULL);
 
-      if (e->lookups == 0) {
-        Assert(e->free_pprev == NULL);
-        LinkedListInsert<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
-      }
-      return;
-    }
-    e = e->next;
-  }
+  Assert(e->lookups != 0);
+  e->lookups--;
 
-  // entry isn't in the cache
-  Assert(false);
+  if (e->lookups == 0) {
+    Assert(e->free_pprev == NULL);
+    LinkedListInsert<HashEntry,__HashEntry_FreeList>
+      (&m_free[e->segment].pend, e);
+  }
 }
 
 template <class T, class U, class HT>
@@ -157,14 +220,41 @@ void HashCache<T,U,HT>::Insert(T v, U o)
   }
 
   m_entry_count++;
+  m_inserts++;
 
-  size_t ind = v->Hash() % m_bucket_count;
+  size_t ind = HT::Hash(0, v) % m_bucket_count;
   HashBucket *bucket = &m_buckets[ind];
 
+  // new entries start out in the window segment, if there is one.
+  Segment segment = (m_policy == HCP_Frequency) ? SEG_Window : SEG_Probation;
+
   // make the new entry and add it to the bucket and free lists.
   HashEntry *newe = new HashEntry(v, o);
+  newe->segment = segment;
+  m_free[segment].count++;
+
   LinkedListInsert<HashEntry,__HashEntry_BucketList>(&bucket->e_pend, newe);
-  LinkedListInsert<HashEntry,__HashEntry_FreeList>(&m_free_pend, newe);
+  LinkedListInsert<HashEntry,__HashEntry_FreeList>
+    (&m_free[segment].pend, newe);
+
+  if (m_sketch)
+    SketchAccess(HT::Hash(0, v));
+}
+
+template <class T, class U, class HT>
+void HashCache<T,U,HT>::GetEntries(Vector<T> *keys, Vector<U> *values)
+{
+  keys->Reserve(keys->Size() + m_entry_count);
+  values->Reserve(values->Size() + m_entry_count);
+
+  for (size_t ind = 0; ind < m_bucket_count; ind++) {
+    HashEntry *e = m_buckets[ind].e_begin;
+    while (e != NULL) {
+      keys->PushBack(e->source);
+      values->PushBack(e->target);
+      e = e->next;
+    }
+  }
 }
 
 template <class T, class U, class HT>
@@ -174,24 +264,50 @@ void HashCache<T,U,HT>::Clear()
   size_t old_max_entry_count = m_max_entry_count;
   m_max_entry_count = 0;
 
+  // don't count these removals as evictions.
+  uint64_t old_evictions = m_evictions;
+
   RemoveLruEntries();
 
   // restore the old maximum entry count
   m_max_entry_count = old_max_entry_count;
+  m_evictions = old_evictions;
+}
+
+template <class T, class U, class HT>
+size_t HashCache<T,U,HT>::Shed(size_t count)
+{
+  // caches whose eviction is managed by the client can only be cleared
+  // entirely, as is done between stages.
+  if (!m_eviction_enabled)
+    count = m_entry_count;
+
+  size_t old_entry_count = m_entry_count;
+
+  // temporarily lower the max entry count, as for Clear().
+  size_t old_max_entry_count = m_max_entry_count;
+  m_max_entry_count = (count < m_entry_count) ? m_entry_count - count : 0;
+
+  RemoveLruEntries();
+
+  m_max_entry_count = old_max_entry_count;
+  return old_entry_count - m_entry_count;
 }
 
 template <class T, class U, class HT>
 void HashCache<T,U,HT>::RemoveLruEntries()
 {
   while (m_entry_count > m_max_entry_count) {
-    HashEntry *e = m_free_begin;
+    HashEntry *e = ChooseVictim();
     if (e == NULL) {
       // we have more entries than permitted, but all of them are in use
       return;
     }
 
     // remove the entry from the free list
-    LinkedListRemove<HashEntry,__HashEntry_FreeList>(&m_free_pend, e);
+    LinkedListRemove<HashEntry,__HashEntry_FreeList>
+      (&m_free[e->segment].pend, e);
+    m_free[e->segment].count--;
 
     // get the bucket containing this entry
     size_t ind = HT::Hash(0, e->source) % m_bucket_count;
@@ -218,5 +334,169 @@ void HashCache<T,U,HT>::RemoveLruEntries()
     // do the final delete
     delete e;
     m_entry_count--;
+    m_evictions++;
+  }
+}
+
+template <class T, class U, class HT>
+void HashCache<T,U,HT>::TouchEntry(HashEntry *e)
+{
+  if (m_policy != HCP_Frequency)
+    return;
+
+  SketchAccess(HT::Hash(0, e->source));
+
+  // entries hit again while in probation become protected.
+  if (e->segment != SEG_Probation)
+    return;
+
+  if (e->lookups == 0)
+    MoveFreeEntry(e, SEG_Protected);
+  else {
+    m_free[SEG_Probation].count--;
+    m_free[SEG_Protected].count++;
+    e->segment = SEG_Protected;
+  }
+
+  // if the protected segment is too large then demote its least recently
+  // used entries back to probation, where they can be evicted.
+  while (m_free[SEG_Protected].count > ProtectedCapacity()) {
+    HashEntry *demote = m_free[SEG_Protected].begin;
+    if (demote == NULL)
+      break;
+    MoveFreeEntry(demote, SEG_Probation);
+  }
+}
+
+template <class T, class U, class HT>
+typename HashCache<T,U,HT>::HashEntry* HashCache<T,U,HT>::ChooseVictim()
+{
+  if (m_policy != HCP_Frequency)
+    return m_free[SEG_Probation].begin;
+
+  // move entries overflowing the window into the main cache while it
+  // still has room for them.
+  size_t main_capacity = m_max_entry_count - WindowCapacity();
+  while (m_free[SEG_Window].count > WindowCapacity() &&
+         m_free[SEG_Probation].count + m_free[SEG_Protected].count
+           < main_capacity) {
+    HashEntry *e = m_free[SEG_Window].begin;
+    if (e == NULL)
+      break;
+    MoveFreeEntry(e, SEG_Probation);
+  }
+
+  // oldest entry in the main cache, preferring probation entries.
+  HashEntry *victim = m_free[SEG_Probation].begin;
+  if (victim == NULL)
+    victim = m_free[SEG_Protected].begin;
+
+  // oldest entry in the window, if the window is over its capacity.
+  HashEntry *candidate = NULL;
+  if (m_free[SEG_Window].count > WindowCapacity())
+    candidate = m_free[SEG_Window].begin;
+
+  if (candidate && victim) {
+    // admit the window's candidate into the main cache only if it is
+    // used more frequently than the entry it would replace.
+    size_t candidate_freq = SketchEstimate(HT::Hash(0, candidate->source));
+    size_t victim_freq = SketchEstimate(HT::Hash(0, victim->source));
+
+    if (candidate_freq > victim_freq) {
+      MoveFreeEntry(candidate, SEG_Probation);
+      return victim;
+    }
+    return candidate;
   }
+
+  if (candidate)
+    return candidate;
+  if (victim)
+    return victim;
+
+  // fall back to any unreferenced window entry.
+  return m_free[SEG_Window].begin;
+}
+
+template <class T, class U, class HT>
+void HashCache<T,U,HT>::MoveFreeEntry(HashEntry *e, Segment segment)
+{
+  Assert(e->lookups == 0);
+
+  LinkedListRemove<HashEntry,__HashEntry_FreeList>
+    (&m_free[e->segment].pend, e);
+  m_free[e->segment].count--;
+
+  e->segment = segment;
+
+  LinkedListInsert<HashEntry,__HashEntry_FreeList>
+    (&m_free[segment].pend, e);
+  m_free[segment].count++;
+}
+
+template <class T, class U, class HT>
+size_t HashCache<T,U,HT>::WindowCapacity() const
+{
+  size_t capacity = m_max_entry_count * CACHE_WINDOW_PERCENT / 100;
+  if (capacity == 0 && m_max_entry_count != 0)
+    capacity = 1;
+  return capacity;
+}
+
+template <class T, class U, class HT>
+size_t HashCache<T,U,HT>::ProtectedCapacity() const
+{
+  size_t main_count = m_max_entry_count - WindowCapacity();
+  return main_count * CACHE_PROTECTED_PERCENT / 100;
+}
+
+template <class T, class U, class HT>
+size_t HashCache<T,U,HT>::SketchIndex(uint32_t hash, uint32_t row) const
+{
+  // mix the hash differently for each row so that keys colliding
+  // in one row are unlikely to collide in the others.
+  uint32_t x = (hash ^ (row * 0x9e3779b9)) * 0x85ebca6b;
+  x ^= x >> 15;
+  x *= 0xc2b2ae35;
+  x ^= x >> 13;
+  return x & (m_sketch_size - 1);
+}
+
+template <class T, class U, class HT>
+void HashCache<T,U,HT>::SketchAccess(uint32_t hash)
+{
+  Assert(m_sketch);
+
+  // conservative update: only increment the counters which are at
+  // the current minimum estimate.
+  size_t estimate = SketchEstimate(hash);
+  if (estimate < CACHE_SKETCH_MAX) {
+    for (uint32_t ind = 0; ind < CACHE_SKETCH_DEPTH; ind++) {
+      uint8_t &counter = m_sketch[SketchIndex(hash, ind)];
+      if (counter == estimate)
+        counter++;
+    }
+  }
+
+  m_sketch_accesses++;
+  if (m_sketch_accesses >= m_sketch_size * CACHE_SKETCH_AGING) {
+    for (size_t ind = 0; ind < m_sketch_size; ind++)
+      m_sketch[ind] /= 2;
+    m_sketch_accesses /= 2;
+  }
+}
+
+template <class T, class U, class HT>
+size_t HashCache<T,U,HT>::SketchEstimate(uint32_t hash) const
+{
+  Assert(m_sketch);
+
+  size_t estimate = CACHE_SKETCH_MAX;
+  for (uint32_t ind = 0; ind < CACHE_SKETCH_DEPTH; ind++) {
+    uint8_t counter = m_sketch[SketchIndex(hash, ind)];
+    if (counter < estimate)
+      estimate = counter;
+  }
+
+  return estimate;
 }
@@ -57,6 +57,22 @@ inline uint32_t Hash32(uint32_t hash, uint32_t value)
   return ELFHash(hash, &value, sizeof(value));
 }
 
+// 64-bit FNV-1a hash of a block of data. this is slower than HashBlock but
+// far less prone to collisions, for hashes which are stored and compared
+// in place of the data itself.
+inline uint64_t HashBlock64(const void *val, size_t len)
+{
+  const uint8_t *dval = (const uint8_t*) val;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= dval[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
 // default hash function just hashes the bits in T.
 template <class T>
 struct DataHash
@@ -255,6 +271,168 @@ class HashSet
   HashTable<T,char,HT> m_table;
 };
 
+// open addressed hash table associating each key with a single value.
+// this has the same interface as HashTable for tables where keys never
+// have more than one value, but stores keys and values directly in a
+// flat array using robin hood probing, with no per-entry allocation.
+// pointers to values are invalidated by any later insert or remove.
+template <class T, class U, class HT>
+class FlatHashTable
+{
+ public:
+  FlatHashTable<T,U,HT>(size_t min_capacity = 16);
+  FlatHashTable<T,U,HT>(const char *alloc_name, size_t min_capacity = 16);
+  ~FlatHashTable<T,U,HT>() { Clear(); }
+
+  // hashtables cannot be copied.
+  FlatHashTable<T,U,HT>(const FlatHashTable<T,U,HT>&) { Assert(false); }
+  FlatHashTable<T,U,HT>& operator =(const FlatHashTable<T,U,HT>&)
+  { Assert(false); }
+
+  // get the value associated with o, NULL if there is none. if force is
+  // true a new, default value will be associated with o and returned.
+  U* Lookup(const T &o, bool force = false);
+
+  // get the value associated with o, which must exist.
+  U& LookupSingle(const T &o);
+
+  // associate v with o in this table, replacing any existing value.
+  // returns whether there was an existing value for o.
+  bool Insert(const T &o, const U &v);
+
+  // get whether this table is empty.
+  bool IsEmpty() const { return m_entry_count == 0; }
+
+  // get the number of keys in this table.
+  size_t GetEntryCount() const { return m_entry_count; }
+
+  // remove any value associated with o from this table.
+  void Remove(const T &o);
+
+  // clears all entries from this table.
+  void Clear();
+
+  // choose an arbitrary key from this table.
+  T ChooseKey() const;
+
+  // iteration methods, with the same restrictions as for HashTable.
+  // lookups which do not add entries are allowed during iteration.
+  void ItStart();
+  bool ItDone();
+  void ItNext();
+  const T& ItKey();
+  U& ItValueSingle();
+
+ private:
+  struct Slot {
+    T key;
+    U value;
+
+    // hash of the key.
+    uint32_t hash;
+
+    // zero if the slot is empty, otherwise one more than the distance
+    // between the slot and the one the key hashes to.
+    uint32_t distance;
+
+    Slot() : key(), value(), hash(0), distance(0) {}
+  };
+
+  // get the slot a hash value will probe first.
+  size_t HashSlot(uint32_t hash) const
+  {
+    // scramble the hash so that the high bits pick the slot.
+    return (uint32_t) (hash * 2654435769U) >> m_shift;
+  }
+
+  // get the index of the slot holding o, m_capacity if there is none.
+  size_t FindSlot(const T &o, uint32_t hash) const;
+
+  // place an entry in the table, displacing entries which are closer to
+  // their initial slot. returns the index where the entry was placed.
+  size_t PlaceSlot(Slot entry);
+
+  // resize for a new capacity, which must be a power of two.
+  void Resize(size_t capacity);
+
+  // allocator used for slots in this table.
+  TrackAlloc &m_alloc;
+
+  // slots in this table, and their count.
+  Slot *m_slots;
+  size_t m_capacity;
+
+  // shift used by HashSlot to get an index from a scrambled hash.
+  uint32_t m_shift;
+
+  // number of occupied slots.
+  size_t m_entry_count;
+
+  // minimum capacity this table will resize to.
+  size_t m_min_capacity;
+
+  // slot for any active iteration, m_capacity if there is none.
+  size_t m_iter_slot;
+
+ public:
+  ALLOC_OVERRIDE(g_alloc_HashTable);
+};
+
+// set of objects stored in a FlatHashTable.
+template <class T, class HT>
+class FlatHashSet
+{
+ public:
+  FlatHashSet<T,HT>(size_t min_capacity = 16)
+    : m_table(min_capacity)
+  {}
+
+  FlatHashSet<T,HT>(const char *alloc_name, size_t min_capacity = 16)
+    : m_table(alloc_name, min_capacity)
+  {}
+
+  // is the specified element in the set?
+  bool Lookup(const T &o) {
+    return m_table.Lookup(o) != NULL;
+  }
+
+  // insert the specified element into the set. return value is whether the
+  // element was previously in the set.
+  bool Insert(const T &o) {
+    return m_table.Insert(o, 0);
+  }
+
+  // there are no entries in this table.
+  bool IsEmpty() const {
+    return m_table.IsEmpty();
+  }
+
+  // get the number of elements in this set.
+  size_t GetEntryCount() const {
+    return m_table.GetEntryCount();
+  }
+
+  // remove the specified element from the set.
+  void Remove(const T &o) {
+    m_table.Remove(o);
+  }
+
+  // clears all entries from this set.
+  void Clear() {
+    m_table.Clear();
+  }
+
+  // iteration methods for the elements of this set, as for a hashtable.
+
+  void ItStart() { m_table.ItStart(); }
+  bool ItDone() { return m_table.ItDone(); }
+  void ItNext() { m_table.ItNext(); }
+  const T& ItKey() { return m_table.ItKey(); }
+
+ private:
+  FlatHashTable<T,char,HT> m_table;
+};
+
 // macro with the for loop header for iterating through a HashTable or HashSet.
 #define HashIterate(TABLE)                                         \
   for ((TABLE).ItStart(); !(TABLE).ItDone(); (TABLE).ItNext())
@@ -278,3 +278,261 @@ void HashTable<T,U,HT>::Resize(size_t bucket_count)
   m_buckets = buckets;
   m_bucket_count = bucket_count;
 }
+
+/////////////////////////////////////////////////////////////////////
+// FlatHashTable
+/////////////////////////////////////////////////////////////////////
+
+// fraction of slots in a FlatHashTable which may be occupied, in eighths.
+#define FLAT_HASH_LOAD 7
+
+template <class T, class U, class HT>
+FlatHashTable<T,U,HT>::FlatHashTable(size_t min_capacity)
+  : m_alloc(g_alloc_HashTable), m_slots(NULL), m_capacity(0), m_shift(0),
+    m_entry_count(0), m_min_capacity(8), m_iter_slot(0)
+{
+  // we're not allocating until the first insert occurs.
+  while (m_min_capacity < min_capacity)
+    m_min_capacity *= 2;
+}
+
+template <class T, class U, class HT>
+FlatHashTable<T,U,HT>::FlatHashTable(const char *alloc_name,
+                                     size_t min_capacity)
+  : m_alloc(LookupAlloc(alloc_name)), m_slots(NULL), m_capacity(0),
+    m_shift(0), m_entry_count(0), m_min_capacity(8), m_iter_slot(0)
+{
+  // ditto.
+  while (m_min_capacity < min_capacity)
+    m_min_capacity *= 2;
+}
+
+template <class T, class U, class HT>
+U* FlatHashTable<T,U,HT>::Lookup(const T &o, bool force)
+{
+  uint32_t hash = HT::Hash(0, o);
+
+  if (m_capacity != 0) {
+    size_t ind = FindSlot(o, hash);
+    if (ind != m_capacity)
+      return &m_slots[ind].value;
+  }
+
+  if (!force)
+    return NULL;
+
+  Assert(m_iter_slot == m_capacity);
+
+  if ((m_entry_count + 1) * 8 > m_capacity * FLAT_HASH_LOAD)
+    Resize(m_capacity ? m_capacity * 2 : m_min_capacity);
+
+  Slot entry;
+  entry.key = o;
+  entry.hash = hash;
+  entry.distance = 1;
+
+  size_t ind = PlaceSlot(entry);
+  m_entry_count++;
+
+  return &m_slots[ind].value;
+}
+
+template <class T, class U, class HT>
+U& FlatHashTable<T,U,HT>::LookupSingle(const T &o)
+{
+  U *value = Lookup(o, false);
+  Assert(value != NULL);
+  return *value;
+}
+
+template <class T, class U, class HT>
+bool FlatHashTable<T,U,HT>::Insert(const T &o, const U &v)
+{
+  size_t old_count = m_entry_count;
+  *Lookup(o, true) = v;
+  return (m_entry_count == old_count);
+}
+
+template <class T, class U, class HT>
+void FlatHashTable<T,U,HT>::Remove(const T &o)
+{
+  Assert(m_iter_slot == m_capacity);
+
+  if (m_capacity == 0)
+    return;
+
+  size_t ind = FindSlot(o, HT::Hash(0, o));
+  if (ind == m_capacity)
+    return;
+
+  // shift back any following entries which are not in their initial slot.
+  while (true) {
+    size_t next = (ind + 1) & (m_capacity - 1);
+    if (m_slots[next].distance <= 1)
+      break;
+
+    m_slots[ind] = m_slots[next];
+    m_slots[ind].distance--;
+    ind = next;
+  }
+
+  m_slots[ind] = Slot();
+  m_entry_count--;
+
+  // use the same shrinking as HashTable::CheckBucketCount.
+  if (m_capacity > m_min_capacity && m_capacity > m_entry_count * 4)
+    Resize(m_capacity / 2);
+}
+
+template <class T, class U, class HT>
+void FlatHashTable<T,U,HT>::Clear()
+{
+  Assert(m_iter_slot == m_capacity);
+
+  if (m_slots != NULL) {
+    track_delete<Slot>(m_alloc, m_slots);
+    m_slots = NULL;
+  }
+
+  m_capacity = 0;
+  m_shift = 0;
+  m_entry_count = 0;
+  m_iter_slot = 0;
+}
+
+template <class T, class U, class HT>
+T FlatHashTable<T,U,HT>::ChooseKey() const
+{
+  Assert(!IsEmpty());
+
+  // get a random index to start at, as for HashTable::ChooseKey.
+  size_t start_ind = rand() % m_capacity;
+
+  for (size_t ind = start_ind; ind < m_capacity; ind++) {
+    if (m_slots[ind].distance)
+      return m_slots[ind].key;
+  }
+
+  for (size_t ind = 0; ind < start_ind; ind++) {
+    if (m_slots[ind].distance)
+      return m_slots[ind].key;
+  }
+
+  Assert(false);
+  return T();
+}
+
+template <class T, class U, class HT>
+void FlatHashTable<T,U,HT>::ItStart()
+{
+  Assert(m_iter_slot == m_capacity);
+
+  m_iter_slot = 0;
+  while (m_iter_slot < m_capacity && !m_slots[m_iter_slot].distance)
+    m_iter_slot++;
+}
+
+template <class T, class U, class HT>
+bool FlatHashTable<T,U,HT>::ItDone()
+{
+  return (m_iter_slot == m_capacity);
+}
+
+template <class T, class U, class HT>
+void FlatHashTable<T,U,HT>::ItNext()
+{
+  Assert(m_iter_slot < m_capacity);
+
+  m_iter_slot++;
+  while (m_iter_slot < m_capacity && !m_slots[m_iter_slot].distance)
+    m_iter_slot++;
+}
+
+template <class T, class U, class HT>
+const T& FlatHashTable<T,U,HT>::ItKey()
+{
+  Assert(m_iter_slot < m_capacity);
+  return m_slots[m_iter_slot].key;
+}
+
+template <class T, class U, class HT>
+U& FlatHashTable<T,U,HT>::ItValueSingle()
+{
+  Assert(m_iter_slot < m_capacity);
+  return m_slots[m_iter_slot].value;
+}
+
+template <class T, class U, class HT>
+size_t FlatHashTable<T,U,HT>::FindSlot(const T &o, uint32_t hash) const
+{
+  size_t ind = HashSlot(hash);
+
+  // entries are ordered so that once we find one closer to its initial
+  // slot than o would be, o cannot be in the table.
+  for (uint32_t distance = 1; true; distance++) {
+    const Slot &slot = m_slots[ind];
+    if (slot.distance < distance)
+      return m_capacity;
+    if (slot.hash == hash && slot.key == o)
+      return ind;
+    ind = (ind + 1) & (m_capacity - 1);
+  }
+}
+
+template <class T, class U, class HT>
+size_t FlatHashTable<T,U,HT>::PlaceSlot(Slot entry)
+{
+  size_t ind = HashSlot(entry.hash);
+  size_t res = m_capacity;
+
+  while (true) {
+    Slot &slot = m_slots[ind];
+
+    if (slot.distance == 0) {
+      slot = entry;
+      return (res == m_capacity) ? ind : res;
+    }
+
+    if (slot.distance < entry.distance) {
+      Slot displaced = slot;
+      slot = entry;
+      entry = displaced;
+
+      if (res == m_capacity)
+        res = ind;
+    }
+
+    ind = (ind + 1) & (m_capacity - 1);
+    entry.distance++;
+  }
+}
+
+template <class T, class U, class HT>
+void FlatHashTable<T,U,HT>::Resize(size_t capacity)
+{
+  Assert(capacity >= m_min_capacity);
+  Assert((capacity & (capacity - 1)) == 0);
+
+  Slot *old_slots = m_slots;
+  size_t old_capacity = m_capacity;
+
+  m_slots = track_new<Slot>(m_alloc, capacity);
+  m_capacity = capacity;
+
+  m_shift = 32;
+  for (size_t count = capacity; count > 1; count /= 2)
+    m_shift--;
+
+  for (size_t ind = 0; ind < old_capacity; ind++) {
+    Slot &slot = old_slots[ind];
+    if (slot.distance) {
+      slot.distance = 1;
+      PlaceSlot(slot);
+    }
+  }
+
+  if (old_slots != NULL)
+    track_delete<Slot>(m_alloc, old_slots);
+
+  m_iter_slot = m_capacity;
+}
@@ -19,49 +19,127 @@
 #include "monitor.h"
 
 #include <unistd.h>
+#include <stdio.h>
+#include <malloc.h>
 
 NAMESPACE_XGILL_BEGIN
 
 ConfigOption memory_limit(CK_UInt, "memory-limit", "0",
                           "Soft process memory limit, in MB (0 == no limit)");
 
-// get the amount of virtual memory this process is using, in megabytes.
-// returns 0 if the amount could not be determined. only includes memory
-// that has been heap-allocated but not yet freed, i.e. omits memory
-// allocated for this process but either:
-// - not in use
-// - used for the stack
-// - used for heap allocator control structures
-// the number reported is smaller than but usually close to the complete
-// usage reported by, e.g. 'ps aux'
-uint32_t GetVmUsage()
+// get the resident set size of this process in kB, 0 on failure.
+// this just reads /proc/self/statm and is cheap enough to call frequently.
+static size_t GetResidentKB()
 {
-  return g_alloc_total >> 20;
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (file == NULL)
+    return 0;
+
+  unsigned long size = 0, resident = 0;
+  int count = fscanf(file, "%lu %lu", &size, &resident);
+  fclose(file);
+
+  if (count != 2)
+    return 0;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// get the proportional set size of this process in kB, 0 on failure.
+// this is never more than the resident set size, but is much more expensive
+// to compute as the kernel has to walk the process page tables.
+static size_t GetProportionalKB()
+{
+  FILE *file = fopen("/proc/self/smaps_rollup", "r");
+  if (file == NULL)
+    return 0;
+
+  size_t pss = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long value;
+    if (sscanf(line, "Pss: %lu kB", &value) == 1) {
+      pss = value;
+      break;
+    }
+  }
+
+  fclose(file);
+  return pss;
+}
+
+// get the memory usage in kB, only computing the proportional set size
+// if the resident set size is above threshold_kb.
+static size_t GetUsageKB(size_t threshold_kb)
+{
+  size_t rss = GetResidentKB();
+  if (rss <= threshold_kb)
+    return rss;
+
+  size_t pss = GetProportionalKB();
+  return pss ? pss : rss;
+}
+
+uint32_t GetMemoryUsage()
+{
+  return GetUsageKB(0) >> 10;
+}
+
+size_t GetHeapUsage()
+{
+#ifdef USE_COUNT_ALLOCATOR
+  return g_alloc_total;
+#elif defined(__GLIBC__) && \
+  (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return g_alloc_total;
+#endif
+}
+
+void TrimHeap()
+{
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
 }
 
-void PrintVmUsage()
+void PrintMemoryUsage()
 {
-  logout << "VM Usage: " << GetVmUsage() << " mB" << endl;
+  logout << "Memory Usage: RSS " << (GetResidentKB() >> 10) << " mB, "
+         << "PSS " << (GetProportionalKB() >> 10) << " mB, "
+         << "heap " << (GetHeapUsage() >> 20) << " mB" << endl;
 }
 
-bool IsHighVmUsage()
+bool IsHighMemoryUsage()
 {
   uint32_t limit = memory_limit.UIntValue();
   if (limit == 0)
     return false;
 
-  uint32_t mb_usage = GetVmUsage();
-  return mb_usage > limit;
+  size_t limit_kb = (size_t) limit << 10;
+  return GetUsageKB(limit_kb) > limit_kb;
 }
 
-bool IsModerateVmUsage()
+bool IsModerateMemoryUsage()
 {
   uint32_t limit = memory_limit.UIntValue();
   if (limit == 0)
     return false;
 
-  uint32_t mb_usage = GetVmUsage();
-  return mb_usage > limit * 2 / 3;
+  size_t limit_kb = ((size_t) limit << 10) * 2 / 3;
+  return GetUsageKB(limit_kb) > limit_kb;
+}
+
+size_t GetExcessMemoryUsage()
+{
+  uint32_t limit = memory_limit.UIntValue();
+  if (limit == 0)
+    return 0;
+
+  size_t limit_kb = ((size_t) limit << 10) * 2 / 3;
+  size_t usage_kb = GetUsageKB(limit_kb);
+  return (usage_kb > limit_kb) ? (usage_kb - limit_kb) << 10 : 0;
 }
 
 NAMESPACE_XGILL_END
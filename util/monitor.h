@@ -28,15 +28,34 @@ NAMESPACE_XGILL_BEGIN
 
 // soft memory limit for the process, in MB. when usage goes above this
 // caches will be cleaned out to bring usage back below (hopefully).
+// usage is measured as the proportional set size of the process if the
+// kernel reports it (so that pages shared with other workers are only
+// partially charged), otherwise as the resident set size.
 extern ConfigOption memory_limit;
 
-// print the virtual memory usage of this process.
-void PrintVmUsage();
+// get the memory usage of this process in MB, per above. returns 0 if
+// the usage could not be determined.
+uint32_t GetMemoryUsage();
 
-// virtual memory usage exceeds the soft memory limit.
-bool IsHighVmUsage();
+// get the number of bytes currently allocated from the heap. this is only
+// an approximation if the counting allocator is not in use.
+size_t GetHeapUsage();
 
-// virtual memory usage exceeds 2/3 of the soft memory limit.
-bool IsModerateVmUsage();
+// return any free memory at the top of the heap to the system, so that
+// it is no longer counted in the memory usage.
+void TrimHeap();
+
+// print the memory usage of this process.
+void PrintMemoryUsage();
+
+// memory usage exceeds the soft memory limit.
+bool IsHighMemoryUsage();
+
+// memory usage exceeds 2/3 of the soft memory limit.
+bool IsModerateMemoryUsage();
+
+// get the number of bytes memory usage needs to drop by to get back
+// below 2/3 of the soft memory limit, 0 if it is already below this.
+size_t GetExcessMemoryUsage();
 
 NAMESPACE_XGILL_END
@@ -323,10 +323,76 @@ class FileOutStream : public OutStream {
 // alias for code using std::ofstream
 typedef FileOutStream ofstream;
 
+// size of the data buffered by a BufferedOutStream.
+#define BUFFERED_STREAM_SIZE (64 * 1024)
+
+class BufferedOutStream : public OutStream {
+ public:
+
+  // make a stream which buffers data for the specified file descriptor.
+  // buffered data is written out when the buffer fills up, or on a
+  // Flush() at least flush_ms milliseconds after the last write.
+  BufferedOutStream(int fd, uint32_t flush_ms)
+    : m_fd(fd), m_length(0), m_flush_ms(flush_ms), m_last_write(0)
+  {}
+
+  // write out any remaining data.
+  ~BufferedOutStream() {
+    WriteBuffer();
+  }
+
+  // write out all buffered data. this only uses write() and is safe to
+  // call from signal handlers.
+  void WriteBuffer();
+
+  // inherited methods.
+
+  virtual void Put(const void *buf, size_t len);
+  virtual void Flush();
+
+ private:
+
+  // underlying file descriptor.
+  int m_fd;
+
+  // data which has not been written yet.
+  char m_data[BUFFERED_STREAM_SIZE];
+  size_t m_length;
+
+  // minimum interval between writes caused by Flush(), and the time
+  // in milliseconds of the last write.
+  uint32_t m_flush_ms;
+  uint64_t m_last_write;
+};
+
 // the active logging stream. pretty much all output should go here.
 extern OutStream *log_stream;
 
 // write to the logging stream.
 #define logout (*log_stream)
 
+// levels for log output. messages written with logout_at are only
+// written if their level is no greater than log_level. messages written
+// directly with logout are always written.
+enum LogLevel {
+  LOG_Error = 0,
+  LOG_Warning = 1,
+  LOG_Info = 2,
+  LOG_Verbose = 3
+};
+
+extern LogLevel log_level;
+
+// write to the logging stream if the specified level is enabled.
+// the streamed values are not computed if the level is disabled.
+#define logout_at(LEVEL) if ((LEVEL) > log_level) {} else logout
+
+// when logout is buffered, the stream it is using.
+extern BufferedOutStream *log_buffered;
+
+// immediately write out any data buffered for the logging stream.
+// this is safe to call from signal handlers if the logging stream
+// is buffered.
+void FlushLog();
+
 // see BufferOutStream in buffer.h for a stream that appends to a char buffer.
@@ -17,6 +17,8 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "stream.h"
+#include <time.h>
+#include <unistd.h>
 
 PrintInStream cin(stdin);
 
@@ -30,3 +32,67 @@ PrintOutStream cerr(stderr);
 //PrintOutStream clog(stderr);
 
 OutStream *log_stream = &cout;
+
+LogLevel log_level = LOG_Verbose;
+
+BufferedOutStream *log_buffered = NULL;
+
+void FlushLog()
+{
+  if (log_buffered)
+    log_buffered->WriteBuffer();
+  else if (log_stream)
+    log_stream->Flush();
+}
+
+// get the current monotonic time in milliseconds.
+static uint64_t GetMilliseconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// write all of the specified data to fd, using only async-signal-safe calls.
+static void WriteAll(int fd, const char *data, size_t len)
+{
+  size_t written = 0;
+  while (written < len) {
+    ssize_t ret = write(fd, data + written, len - written);
+    if (ret == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    written += ret;
+  }
+}
+
+void BufferedOutStream::WriteBuffer()
+{
+  WriteAll(m_fd, m_data, m_length);
+  m_length = 0;
+  m_last_write = GetMilliseconds();
+}
+
+void BufferedOutStream::Put(const void *buf, size_t len)
+{
+  if (m_length + len > sizeof(m_data)) {
+    WriteBuffer();
+
+    // data which doesn't fit in the buffer is written directly.
+    if (len > sizeof(m_data)) {
+      WriteAll(m_fd, (const char*) buf, len);
+      return;
+    }
+  }
+
+  memcpy(m_data + m_length, buf, len);
+  m_length += len;
+}
+
+void BufferedOutStream::Flush()
+{
+  if (m_length && GetMilliseconds() >= m_last_write + m_flush_ms)
+    WriteBuffer();
+}
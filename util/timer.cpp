@@ -17,15 +17,25 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "timer.h"
+#include "monitor.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 
 NAMESPACE_XGILL_BEGIN
 
+ConfigOption timer_trace(CK_String, "timer-trace", "",
+                         "file prefix to write timer trace events to");
+
+Timer *g_active_timer = NULL;
+
 // BaseTimer() initializes this variable the first time it is called,
 // to avoid issues with timing functions called during static initialization.
 BaseTimer *g_timer_list;
 
 BaseTimer::BaseTimer(const char *name)
-  : m_name(name), m_count(0), m_usec(0), m_next(NULL)
+  : m_name(name), m_count(0), m_usec(0), m_self_usec(0),
+    m_children(NULL), m_next(NULL)
 {
   // make sure the global timer list is initialized, per above.
   static bool init_timer_list = false;
@@ -38,6 +48,135 @@ BaseTimer::BaseTimer(const char *name)
   g_timer_list = this;
 }
 
+void BaseTimer::AddChild(BaseTimer *child, uint64_t usec)
+{
+  TimerChild **pchild = &m_children;
+  while (*pchild && (*pchild)->m_child != child)
+    pchild = &(*pchild)->m_next;
+
+  if (*pchild == NULL) {
+    *pchild = new TimerChild();
+    (*pchild)->m_child = child;
+    (*pchild)->m_count = 0;
+    (*pchild)->m_usec = 0;
+    (*pchild)->m_next = NULL;
+  }
+
+  (*pchild)->m_count++;
+  (*pchild)->m_usec += usec;
+}
+
+/////////////////////////////////////////////////////////////////////
+// Trace events
+/////////////////////////////////////////////////////////////////////
+
+// whether we have checked the timer_trace option yet.
+static bool trace_checked = false;
+
+// file receiving trace events, NULL if tracing is disabled.
+static FILE *trace_file = NULL;
+
+// process ID written with each event.
+static int trace_pid = 0;
+
+static bool IsTraceEnabled()
+{
+  if (!trace_checked) {
+    trace_checked = true;
+
+    if (timer_trace.IsSpecified()) {
+      trace_pid = getpid();
+
+      char name[512];
+      snprintf(name, sizeof(name), "%s.%d.json",
+               timer_trace.StringValue(), trace_pid);
+
+      trace_file = fopen(name, "w");
+      if (trace_file == NULL)
+        logout << "WARNING: Could not open trace file: " << name << endl;
+      else
+        fprintf(trace_file, "[\n");
+    }
+  }
+
+  return trace_file != NULL;
+}
+
+// write str as a JSON string literal to the trace file.
+static void WriteTraceString(const char *str)
+{
+  fputc('"', trace_file);
+  for (; *str; str++) {
+    unsigned char c = *str;
+    if (c == '"' || c == '\\')
+      fprintf(trace_file, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(trace_file, "\\u%04x", c);
+    else
+      fputc(c, trace_file);
+  }
+  fputc('"', trace_file);
+}
+
+// write a complete event for a timer use. the closing ']' of the event
+// array is never written, the trace viewer accepts files without it
+// and this way the trace is usable if the process is killed.
+static void WriteTraceEvent(BaseTimer *base, const char *detail,
+                            uint64_t start, uint64_t elapsed)
+{
+  fprintf(trace_file, "{\"name\":");
+  WriteTraceString(base->m_name);
+  fprintf(trace_file, ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu"
+          ",\"pid\":%d,\"tid\":%d",
+          (unsigned long long) start, (unsigned long long) elapsed,
+          trace_pid, trace_pid);
+
+  if (detail) {
+    fprintf(trace_file, ",\"args\":{\"detail\":");
+    WriteTraceString(detail);
+    fprintf(trace_file, "}");
+  }
+
+  fprintf(trace_file, "},\n");
+}
+
+void Timer::SetDetail(const char *detail)
+{
+  if (m_base && IsTraceEnabled()) {
+    if (m_detail)
+      free(m_detail);
+    m_detail = strdup(detail);
+  }
+}
+
+void Timer::Finish(uint64_t elapsed)
+{
+  Assert(g_active_timer == this);
+  g_active_timer = m_parent;
+
+  uint64_t self = (elapsed >= m_child_usec) ? elapsed - m_child_usec : 0;
+  m_base->AddUse(elapsed, self);
+
+  if (m_parent) {
+    m_parent->m_child_usec += elapsed;
+    m_parent->m_base->AddChild(m_base, elapsed);
+  }
+
+  if (IsTraceEnabled()) {
+    WriteTraceEvent(m_base, m_detail, m_start, elapsed);
+
+    // flush whenever an outermost timer finishes, so the trace is
+    // complete up to the last analyzed function.
+    if (!m_parent)
+      fflush(trace_file);
+  }
+
+  if (m_detail) {
+    free(m_detail);
+    m_detail = NULL;
+  }
+}
+
 #define USEC_PER_SECOND  1000000
 
 void PrintTime(uint64_t usec)
@@ -74,12 +213,230 @@ void PrintTimers()
     if (timer->m_count) {
       logout << "  " << timer->m_name << " (" << timer->m_count << "): ";
       PrintTime(timer->m_usec);
+
+      if (timer->m_children) {
+        logout << " [self ";
+        PrintTime(timer->m_self_usec);
+        logout << "]";
+      }
       logout << endl;
+
+      TimerChild *child = timer->m_children;
+      while (child) {
+        logout << "    " << child->m_child->m_name
+               << " (" << child->m_count << "): ";
+        PrintTime(child->m_usec);
+        logout << endl;
+        child = child->m_next;
+      }
     }
     timer = timer->m_next;
   }
+
+  PrintPhaseBudgets();
+}
+
+/////////////////////////////////////////////////////////////////////
+// TimerAlarm
+/////////////////////////////////////////////////////////////////////
+
+// minimum interval in microseconds between heap samples for an alarm.
+#define ALARM_HEAP_SAMPLE_USEC 1000
+
+// usage information for each phase.
+struct PhaseUsage
+{
+  // number of units of work in this phase.
+  uint64_t count;
+
+  // number of those units which exceeded their time or heap budget.
+  uint64_t time_exceeded;
+  uint64_t heap_exceeded;
+
+  // total time used by units in this phase.
+  uint64_t usec;
+
+  // largest heap growth seen for a unit in this phase, if sampled.
+  size_t heap_peak;
+};
+
+static PhaseUsage g_phase_usage[PHASE_Count];
+
+// add the usage for an alarm or, if there is no alarm, the elapsed time
+// since start to the totals for phase.
+static void AddPhaseUsage(AnalysisPhase phase, TimerAlarm *alarm,
+                          uint64_t start = 0)
+{
+  PhaseUsage &usage = g_phase_usage[phase];
+  usage.count++;
+
+  if (alarm) {
+    if (alarm->HeapExceeded())
+      usage.heap_exceeded++;
+    else if (alarm->Expired())
+      usage.time_exceeded++;
+
+    usage.usec += alarm->Elapsed();
+    if (alarm->HeapGrowth() > usage.heap_peak)
+      usage.heap_peak = alarm->HeapGrowth();
+  }
+  else {
+    usage.usec += GetCurrentTime() - start;
+  }
 }
 
 TimerAlarm* TimerAlarm::g_active_alarm = NULL;
 
+TimerAlarm::TimerAlarm(uint64_t seconds, size_t heap_bytes,
+                       AnalysisPhase phase)
+  : m_start(GetCurrentTime()), m_end(0),
+    m_heap_start(0), m_heap_peak(0), m_heap_budget(heap_bytes),
+    m_heap_sampled(m_start), m_heap_exceeded(false), m_phase(phase)
+{
+  if (seconds)
+    m_end = m_start + (seconds * 1000000);
+
+  if (m_heap_budget) {
+    m_heap_start = GetHeapUsage();
+    m_heap_peak = m_heap_start;
+  }
+}
+
+TimerAlarm::~TimerAlarm()
+{
+  if (m_phase != PHASE_Count)
+    AddPhaseUsage(m_phase, this);
+}
+
+bool TimerAlarm::Expired()
+{
+  if (m_heap_exceeded)
+    return true;
+
+  uint64_t current = GetCurrentTime();
+  if (m_end && current >= m_end)
+    return true;
+
+  if (m_heap_budget && current >= m_heap_sampled + ALARM_HEAP_SAMPLE_USEC) {
+    m_heap_sampled = current;
+
+    size_t heap = GetHeapUsage();
+    if (heap > m_heap_peak)
+      m_heap_peak = heap;
+
+    if (m_heap_peak - m_heap_start > m_heap_budget)
+      m_heap_exceeded = true;
+  }
+
+  return m_heap_exceeded;
+}
+
+/////////////////////////////////////////////////////////////////////
+// PhaseBudget
+/////////////////////////////////////////////////////////////////////
+
+ConfigOption phase_time(CK_String, "phase-time", "",
+  "per-phase soft time budgets in seconds, e.g. memory=30,check=60");
+
+ConfigOption phase_memory(CK_String, "phase-memory", "",
+  "per-phase heap budgets in MB, e.g. memory=512,summary=256");
+
+static const char *g_phase_names[PHASE_Count] =
+  { "memory", "escape", "summary", "check" };
+
+// get the value for phase from a phase=value list, or 0 if not present.
+static unsigned long ParsePhaseValue(const char *list, AnalysisPhase phase)
+{
+  const char *name = g_phase_names[phase];
+  size_t name_length = strlen(name);
+
+  const char *pos = list;
+  while (*pos) {
+    if (!strncmp(pos, name, name_length) && pos[name_length] == '=')
+      return strtoul(pos + name_length + 1, NULL, 10);
+
+    pos = strchr(pos, ',');
+    if (!pos)
+      break;
+    pos++;
+  }
+
+  return 0;
+}
+
+uint32_t GetPhaseTime(AnalysisPhase phase, uint32_t default_seconds)
+{
+  if (phase_time.IsSpecified()) {
+    if (uint32_t seconds = ParsePhaseValue(phase_time.StringValue(), phase))
+      return seconds;
+  }
+  return default_seconds;
+}
+
+size_t GetPhaseMemory(AnalysisPhase phase)
+{
+  if (phase_memory.IsSpecified())
+    return (size_t) ParsePhaseValue(phase_memory.StringValue(), phase) << 20;
+  return 0;
+}
+
+PhaseBudget::PhaseBudget(AnalysisPhase phase, uint32_t default_seconds)
+  : m_phase(phase), m_alarm(NULL), m_active(false), m_start(0)
+{
+  uint32_t seconds = GetPhaseTime(phase, default_seconds);
+  size_t heap_bytes = GetPhaseMemory(phase);
+
+  if (!seconds && !heap_bytes) {
+    m_start = GetCurrentTime();
+    return;
+  }
+
+  if (phase == PHASE_Escape) {
+    m_alarm = new TimerAlarm(seconds, heap_bytes, phase);
+  }
+  else {
+    TimerAlarm::StartActive(seconds, heap_bytes, phase);
+    m_active = true;
+  }
+}
+
+PhaseBudget::~PhaseBudget()
+{
+  // the active alarm may have already been cleared, e.g. when the checker
+  // commits to a report. its usage was recorded at that point.
+  if (m_alarm)
+    delete m_alarm;
+  else if (m_active)
+    TimerAlarm::ClearActive();
+  else
+    AddPhaseUsage(m_phase, NULL, m_start);
+}
+
+void PrintPhaseBudgets()
+{
+  bool printed = false;
+
+  for (size_t phase = 0; phase < PHASE_Count; phase++) {
+    const PhaseUsage &usage = g_phase_usage[phase];
+    if (!usage.count)
+      continue;
+
+    if (!printed) {
+      logout << "Phases:" << endl;
+      printed = true;
+    }
+
+    logout << "  " << g_phase_names[phase] << " (" << usage.count << "): ";
+    PrintTime(usage.usec);
+
+    if (usage.time_exceeded)
+      logout << ", " << usage.time_exceeded << " over time";
+    if (usage.heap_exceeded)
+      logout << ", " << usage.heap_exceeded << " over memory";
+    if (usage.heap_peak)
+      logout << ", peak heap growth " << (usage.heap_peak >> 10) << " kB";
+    logout << endl;
+  }
+}
+
 NAMESPACE_XGILL_END
@@ -21,30 +21,56 @@
 // fairly fine granularity profiling information.
 // for more detailed data use gprof.
 
+// timers nest: each timer started while another is running is a child
+// of that timer, and its time is attributed to both the child and, as
+// inclusive time, the parent. each use of a timer can also be written
+// as a Chrome trace event (viewable with chrome://tracing) by passing
+// -timer-trace=<file> to the analysis; each worker process writes its
+// events to <file>.<pid>.json.
+
 #include "assert.h"
-#include <sys/time.h>
+#include "config.h"
+#include <time.h>
 
 NAMESPACE_XGILL_BEGIN
 
+extern ConfigOption timer_trace;
+
 // print the specified elapsed time, in microseconds, to stdout.
 void PrintTime(uint64_t usec);
 
 // print all timing info to stdout.
 void PrintTimers();
 
+struct BaseTimer;
+
+// aggregate data about uses of one timer while another timer is running.
+struct TimerChild
+{
+  BaseTimer *m_child;
+  uint64_t m_count;
+  uint64_t m_usec;
+  TimerChild *m_next;
+};
+
 // aggregate data about all the times a particular timer is used.
 struct BaseTimer
 {
   // make a new base timer with a globally unique name.
   BaseTimer(const char *name);
 
-  // add a new use of this timer.
-  void AddUse(uint64_t usec)
+  // add a new use of this timer. self_usec excludes the time spent
+  // in any nested timers.
+  void AddUse(uint64_t usec, uint64_t self_usec)
   {
     m_count++;
     m_usec += usec;
+    m_self_usec += self_usec;
   }
 
+  // add a use of child which occurred while this timer was running.
+  void AddChild(BaseTimer *child, uint64_t usec);
+
   // name of this timer.
   const char *m_name;
 
@@ -54,6 +80,12 @@ struct BaseTimer
   // total number of microseconds used for this timer.
   uint64_t m_usec;
 
+  // microseconds used for this timer outside of any nested timers.
+  uint64_t m_self_usec;
+
+  // timers which have been used while this one was running.
+  TimerChild *m_children;
+
   // next timer in global list.
   BaseTimer *m_next;
 };
@@ -61,22 +93,35 @@ struct BaseTimer
 // head of the global list of timers.
 extern BaseTimer *g_timer_list;
 
-// get the time of day in microseconds.
+// get the time in microseconds from a monotonic clock. this is not
+// related to the time of day, and is only meaningful for computing
+// elapsed times within this process.
 static inline uint64_t GetCurrentTime()
 {
-  timeval current;
-  gettimeofday(&current, NULL);
-  return current.tv_sec * (uint64_t) 1000000 + current.tv_usec;
+  timespec current;
+  clock_gettime(CLOCK_MONOTONIC, &current);
+  return current.tv_sec * (uint64_t) 1000000 + current.tv_nsec / 1000;
 }
 
+class Timer;
+
+// innermost running timer with a base timer, NULL if there is none.
+extern Timer *g_active_timer;
+
 // individual timer structure. constructing this starts the timer, destructing
 // it ends the timer and adds a use to the aggregate base timer.
 class Timer
 {
  public:
   Timer(BaseTimer *base = NULL)
-    : m_base(base), m_start(GetCurrentTime())
-  {}
+    : m_base(base), m_start(GetCurrentTime()), m_child_usec(0),
+      m_parent(NULL), m_detail(NULL)
+  {
+    if (m_base) {
+      m_parent = g_active_timer;
+      g_active_timer = this;
+    }
+  }
 
   // time in microseconds which has elapsed since this timer started.
   uint64_t Elapsed()
@@ -86,38 +131,75 @@ class Timer
     return current - m_start;
   }
 
+  // set a string describing this use of the timer, i.e. the function
+  // being analyzed. this only shows up in trace events.
+  void SetDetail(const char *detail);
+
   ~Timer()
   {
     uint64_t elapsed = Elapsed();
     if (m_base)
-      m_base->AddUse(elapsed);
+      Finish(elapsed);
   }
 
  private:
+  // pop this timer from the active timers and add its use to the
+  // base timer, parent timer and trace.
+  void Finish(uint64_t elapsed);
+
   // optional base timer to use. if not specified, the timer does nothing
   // except answer Elapsed() queries.
   BaseTimer *m_base;
 
   // time when this timer was started.
   uint64_t m_start;
+
+  // time used by timers nested within this one.
+  uint64_t m_child_usec;
+
+  // timer which was active when this one started.
+  Timer *m_parent;
+
+  // detail string for trace events, if tracing is enabled.
+  char *m_detail;
 };
 
-// alarm style timer for soft timeouts.
+// analysis phases which are given separate resource budgets.
+enum AnalysisPhase {
+  // computing memory and modset information for a CFG.
+  PHASE_Memory = 0,
+
+  // following escape edges from a single trace.
+  PHASE_Escape = 1,
+
+  // inferring summaries for a function.
+  PHASE_Summary = 2,
+
+  // checking a single assertion.
+  PHASE_Check = 3,
+
+  PHASE_Count = 4
+};
+
+// alarm style timer for soft timeouts. an alarm may also have a heap budget,
+// in which case it expires once the heap has grown by more than that budget
+// since the alarm started.
 class TimerAlarm
 {
  public:
-  // make an alarm which will expire after the specified number of seconds.
-  TimerAlarm(uint64_t seconds)
-    : m_start(GetCurrentTime())
-  {
-    m_end = m_start + (seconds * 1000000);
-  }
+  // make an alarm which will expire after the specified number of seconds
+  // or heap growth in bytes. zero for either indicates no limit. if phase
+  // is specified then usage of the alarm is added to that phase's totals
+  // when the alarm is deleted.
+  TimerAlarm(uint64_t seconds, size_t heap_bytes = 0,
+             AnalysisPhase phase = PHASE_Count);
+  ~TimerAlarm();
 
   // whether this alarm has expired.
-  bool Expired()
-  {
-    return GetCurrentTime() >= m_end;
-  }
+  bool Expired();
+
+  // whether this alarm expired due to its heap budget.
+  bool HeapExceeded() { return m_heap_exceeded; }
 
   // time in microseconds which has elapsed since this alarm started.
   uint64_t Elapsed()
@@ -127,13 +209,34 @@ class TimerAlarm
     return current - m_start;
   }
 
+  // largest heap growth in bytes seen since this alarm started. this is
+  // only updated when the heap is sampled during Expired().
+  size_t HeapGrowth() { return m_heap_peak - m_heap_start; }
+
  private:
   // time when this alarm started.
   uint64_t m_start;
 
-  // time when this alarm will expire.
+  // time when this alarm will expire, 0 for no time limit.
   uint64_t m_end;
 
+  // heap usage when this alarm started, and the most heap usage seen since.
+  size_t m_heap_start;
+  size_t m_heap_peak;
+
+  // heap budget in bytes, 0 for no limit.
+  size_t m_heap_budget;
+
+  // time when the heap was last sampled. sampling the heap is much more
+  // expensive than reading the clock, so is only done periodically.
+  uint64_t m_heap_sampled;
+
+  // whether the heap budget has been exceeded.
+  bool m_heap_exceeded;
+
+  // phase to record usage for, PHASE_Count if none.
+  AnalysisPhase m_phase;
+
   // active alarm for below.
   static TimerAlarm *g_active_alarm;
 
@@ -141,10 +244,11 @@ class TimerAlarm
   // stat/clear/check a global active alarm. various components of the system
   // check these to see if they should finish prematurely.
 
-  static void StartActive(uint64_t seconds)
+  static void StartActive(uint64_t seconds, size_t heap_bytes = 0,
+                          AnalysisPhase phase = PHASE_Count)
   {
     Assert(!g_active_alarm);
-    g_active_alarm = new TimerAlarm(seconds);
+    g_active_alarm = new TimerAlarm(seconds, heap_bytes, phase);
   }
 
   static void ClearActive()
@@ -162,6 +266,13 @@ class TimerAlarm
     return false;
   }
 
+  static bool ActiveHeapExceeded()
+  {
+    if (g_active_alarm)
+      return g_active_alarm->HeapExceeded();
+    return false;
+  }
+
   static uint64_t ActiveElapsed()
   {
     Assert(g_active_alarm);
@@ -169,4 +280,61 @@ class TimerAlarm
   }
 };
 
+// per-phase soft time and heap budgets, as comma separated phase=value
+// lists, e.g. -phase-time=memory=30,check=60 -phase-memory=memory=512.
+// phase names are 'memory', 'escape', 'summary' and 'check'.
+extern ConfigOption phase_time;
+extern ConfigOption phase_memory;
+
+// get the time budget in seconds for phase, or default_seconds if none
+// was specified.
+uint32_t GetPhaseTime(AnalysisPhase phase, uint32_t default_seconds = 0);
+
+// get the heap budget in bytes for phase, 0 if none was specified.
+size_t GetPhaseMemory(AnalysisPhase phase);
+
+// budget for a unit of work within a phase, which tracks the time and heap
+// growth of that work. when exceeded, the work should be cut short and
+// finished with a cheaper, less precise analysis rather than failing the
+// whole worker. except for the escape phase, which is nested within the
+// others, the budget is installed as the active TimerAlarm so that the
+// existing timeout checks throughout the analysis also apply to it.
+class PhaseBudget
+{
+ public:
+  PhaseBudget(AnalysisPhase phase, uint32_t default_seconds = 0);
+  ~PhaseBudget();
+
+  // whether the budget has been exceeded.
+  bool Exceeded()
+  {
+    if (m_alarm)
+      return m_alarm->Expired();
+    return m_active && TimerAlarm::ActiveExpired();
+  }
+
+  // whether the budget was exceeded due to heap growth.
+  bool HeapExceeded()
+  {
+    if (m_alarm)
+      return m_alarm->HeapExceeded();
+    return m_active && TimerAlarm::ActiveHeapExceeded();
+  }
+
+ private:
+  AnalysisPhase m_phase;
+
+  // alarm for an escape phase budget, if there are limits.
+  TimerAlarm *m_alarm;
+
+  // whether this started the active alarm.
+  bool m_active;
+
+  // time when this budget started, if there are no limits.
+  uint64_t m_start;
+};
+
+// print usage and overrun counts for each phase.
+void PrintPhaseBudgets();
+
 NAMESPACE_XGILL_END
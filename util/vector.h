@@ -63,12 +63,14 @@ class Vector
 
   Vector<T>& operator =(const Vector<T> &o)
   {
+    if (this == &o)
+      return *this;
+
     Clear();
 
-    if (o.m_capacity > VECTOR_BASE_CAPACITY) {
-      m_capacity = o.m_capacity;
-      m_data = track_new<T>(g_alloc_Vector, m_capacity);
-    }
+    // only allocate for the entries actually in o, which may have
+    // grown past the built-in storage and then shrunk back into it.
+    Reserve(o.m_count);
 
     m_count = o.m_count;
     for (size_t ind = 0; ind < m_count; ind++)
@@ -123,26 +125,35 @@ class Vector
     return m_count;
   }
 
-  void PushBack(const T &v)
+  // make sure there is storage for at least capacity entries, so that
+  // pushing up to that many entries will not need to reallocate.
+  void Reserve(size_t capacity)
   {
-    Assert(m_capacity != 0);
+    if (capacity <= m_capacity)
+      return;
 
-    if (m_count == m_capacity) {
-      m_capacity *= 2;
+    T *new_data = track_new<T>(g_alloc_Vector, capacity);
+    for (size_t ind = 0; ind < m_count; ind++)
+      new_data[ind] = m_data[ind];
 
-      T *new_data = track_new<T>(g_alloc_Vector, m_capacity);
+    if (m_data == m_base_data) {
       for (size_t ind = 0; ind < m_count; ind++)
-        new_data[ind] = m_data[ind];
-
-      if (m_data == m_base_data) {
-        for (size_t ind = 0; ind < m_count; ind++)
-          m_data[ind] = T();
-      }
-      else {
-        track_delete<T>(g_alloc_Vector, m_data);
-      }
-      m_data = new_data;
+        m_data[ind] = T();
     }
+    else {
+      track_delete<T>(g_alloc_Vector, m_data);
+    }
+
+    m_data = new_data;
+    m_capacity = capacity;
+  }
+
+  void PushBack(const T &v)
+  {
+    Assert(m_capacity != 0);
+
+    if (m_count == m_capacity)
+      Reserve(m_capacity * 2);
 
     m_data[m_count] = v;
     m_count++;
@@ -159,6 +170,7 @@ class Vector
   {
     while (m_count > count)
       PopBack();
+    Reserve(count);
     while (m_count < count)
       PushBack(T());
   }